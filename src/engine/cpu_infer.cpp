@@ -0,0 +1,132 @@
+#include "engine/cpu_infer.h"
+
+#include <algorithm>
+
+#include "engine/onnx_io.h"
+
+namespace cv_infer::cpu
+{
+bool CpuEngine::LoadModel(const std::string& model, bool device_preprocess)
+{
+    if (device_preprocess)
+    {
+        LOGW("CpuEngine not support device preprocess, ignore it");
+    }
+    if (not ReadOnnxIO(model, InputDescs, OutputDescs))
+    {
+        LOGE("ReadOnnxIO failed, model = [%s]", model.c_str());
+        return false;
+    }
+
+    Net = cv::dnn::readNetFromONNX(model);
+    if (Net.empty())
+    {
+        LOGE("readNetFromONNX failed, model = [%s]", model.c_str());
+        return false;
+    }
+    Net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+    Net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+
+    InputBlobs.clear();
+    InputBuffers.clear();
+    for (const auto& input : InputDescs)
+    {
+        // NCHW, batch 维度按 MaxBatch 分配, 其余维度必须是静态的
+        if (input.dims.size() != 4 or input.dtype != DataType::FLOAT32)
+        {
+            LOGE("only support float NCHW input, input = [%s]", input.name.c_str());
+            return false;
+        }
+        if (std::any_of(input.dims.begin() + 1, input.dims.end(), [](std::int64_t d) { return d <= 0; }))
+        {
+            LOGE("dynamic input shape not supported, input = [%s]", input.name.c_str());
+            return false;
+        }
+        if (input.dims[0] > 0 and input.dims[0] != MaxBatch)
+        {
+            LOGW("input [%s] has static batch [%lld], reshape to max batch [%d]", input.name.c_str(),
+                 (long long)input.dims[0], MaxBatch);
+        }
+        int dims[4] = {MaxBatch, (int)input.dims[1], (int)input.dims[2], (int)input.dims[3]};
+        InputBlobs.emplace_back(4, dims, CV_32F);
+        InputBuffers.push_back(InputBlobs.back().ptr<float>());
+        LOGI("input [%s] = [%d, %d, %d, %d]", input.name.c_str(), dims[0], dims[1], dims[2], dims[3]);
+    }
+
+    OutputNames.clear();
+    for (const auto& output : OutputDescs)
+    {
+        OutputNames.push_back(output.name);
+    }
+    // onnx 的输出名字和 OpenCV 的层名字对不上时, 只能按 OpenCV 的顺序取
+    auto unconnected = Net.getUnconnectedOutLayersNames();
+    for (const auto& name : OutputNames)
+    {
+        if (std::find(unconnected.begin(), unconnected.end(), name) == unconnected.end())
+        {
+            LOGW("output [%s] not found in net, use net output order", name.c_str());
+            OutputNames = unconnected;
+            break;
+        }
+    }
+    return true;
+}
+
+Detections CpuEngine::Forwards(const std::vector<cv::Mat>& input_signals)
+{
+    const auto num_inputs = InputBlobs.size();
+    if (input_signals.empty() or input_signals.size() % num_inputs != 0)
+    {
+        LOGE("Input signals size not match, expect n * [%d], but got [%d]", num_inputs, input_signals.size());
+        return {};
+    }
+    const int batch_size = input_signals.size() / num_inputs;
+    if (batch_size > MaxBatch)
+    {
+        LOGE("Batch size [%d] exceeds max batch [%d], see SetMaxBatch", batch_size, MaxBatch);
+        return {};
+    }
+
+    // 输出 buffer 在 Net 之外, 后处理期间不会被下一个请求覆盖
+    auto outputs = AcquireOutputs();
+
+    // 预处理直接写到 input blob 中, 第 i 张图在 blob + i * c * h * w, 不需要额外拷贝
+    std::unique_lock<std::mutex> lock(ForwardMutex);
+    CostTimerPre.StartTimer();
+    if (not PreProcessFunc(input_signals, InputBuffers))
+    {
+        LOGE("PreProcess failed");
+        return {};
+    }
+    CostTimerPre.EndTimer("Preprocess");
+
+    CostTimerInfer.StartTimer();
+    for (int i = 0; i < num_inputs; ++i)
+    {
+        // 只把前 batch_size 张图交给网络, 输出的 batch 维度随之变化
+        const auto& desc    = InputDescs[i];
+        int         dims[4] = {batch_size, (int)desc.dims[1], (int)desc.dims[2], (int)desc.dims[3]};
+        Net.setInput(cv::Mat(4, dims, CV_32F, InputBuffers[i]), desc.name);
+    }
+    Net.forward(OutputBlobs, OutputNames);
+    CostTimerInfer.EndTimer("Infer");
+
+    if (OutputBlobs.size() != OutputNames.size())
+    {
+        LOGE("Output size not match, expect [%d], but got [%d]", OutputNames.size(), OutputBlobs.size());
+        return {};
+    }
+    // OutputBlobs 属于 Net, 下一次 forward 会覆盖, 拷贝到复用的输出 buffer 中 (容量足够时不分配)
+    outputs->resize(OutputBlobs.size());
+    for (int i = 0; i < OutputBlobs.size(); ++i)
+    {
+        const auto& blob = OutputBlobs[i];
+        const auto* data = blob.ptr<float>();
+        (*outputs)[i].assign(data, data + blob.total());
+    }
+    lock.unlock();
+
+    // 后处理不需要持有锁, 可以与下一个请求的推理重叠
+    return PostProcessFunc(input_signals, *outputs);
+}
+}  // namespace cv_infer::cpu
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <opencv2/dnn.hpp>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+#include "engine/engine_base.h"
+#include "tools/logger.h"
+#include "tools/timer.h"
+
+namespace cv_infer::cpu
+{
+// 基于 OpenCV DNN 的 cpu 推理引擎, 接口与 trt::TrtEngine 一致, 模型可以直接替换 EngineType 使用
+// 1. 直接加载 onnx, 输入输出的名字和形状从 onnx 文件中读取
+// 2. 不支持 device 预处理, LoadModel 的 device_preprocess 参数会被忽略
+// 3. cv::dnn::Net 不能并发 forward, 多个请求时只有后处理是并行的
+// 4. 输入 blob 按 SetMaxBatch 的大小预先分配, 一次 Forwards 最多 max_batch 张图, 按实际张数推理,
+//    后处理拿到的每个输出是 [batch, ...] 连续存放
+class CpuEngine : public EngineBase
+{
+public:
+    ~CpuEngine() override { StopSubmit(); }
+
+    virtual bool       LoadModel(const std::string& model, bool device_preprocess = false) override;
+    virtual Detections Forwards(const std::vector<cv::Mat>& input_signals) override;
+
+    // 设置 OpenCV 的线程数, <= 0 恢复 OpenCV 默认的线程数
+    // 注意这是进程全局的设置 (cv::setNumThreads), 不属于某个引擎: 所有 CpuEngine 的推理以及预处理/后处理中的
+    // cv::parallel_for_ 共用同一个线程池, 在进程启动时调用一次即可, 多次调用以最后一次为准
+    static void SetThreadNum(int num) { cv::setNumThreads(num > 0 ? num : -1); }
+    // 在 LoadModel 之前调用, 一次 Forwards 最多输入的图片数
+    void SetMaxBatch(int num) { MaxBatch = std::max(1, num); }
+
+private:
+    cv::dnn::Net Net;
+    int          MaxBatch{1};
+    std::mutex   ForwardMutex;  // 保护 Net 和下面的 buffer
+
+    std::vector<std::string> OutputNames;   // forward 时使用的输出名字, 与 OutputDescs 顺序一致
+    std::vector<cv::Mat>     InputBlobs;    // hold the input blob [max_batch, c, h, w]
+    std::vector<float*>      InputBuffers;  // hold the pre-process buffer, point to InputBlobs
+    std::vector<cv::Mat>     OutputBlobs;
+
+    Timer CostTimerPre{"CpuEnginePreProcess"};
+    Timer CostTimerInfer{"CpuEngineInfer"};
+};
+}  // namespace cv_infer::cpu
@@ -1,14 +1,167 @@
 #pragma once
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <opencv2/opencv.hpp>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "signal/detection.h"
+#include "tools/threadpool.h"
+
 namespace cv_infer
 {
+enum class DataType
+{
+    UNKNOWN,
+    FLOAT32,
+    FLOAT16,
+    INT8,
+    UINT8,
+    INT32,
+    INT64,
+};
+
+enum class TensorLayout
+{
+    UNKNOWN,
+    NCHW,
+    NHWC,
+};
+
+// 模型的输入/输出张量描述, dims 中 -1 表示动态维度 (通常是 batch)
+struct TensorDesc
+{
+    std::string               name;
+    std::vector<std::int64_t> dims;
+    DataType                  dtype  = DataType::FLOAT32;
+    TensorLayout              layout = TensorLayout::UNKNOWN;
+};
+
+// 模型的原始输出, 每个输出张量一个 vector, 交给后处理解析成 Detections
+// 后处理同时拿到本次请求的输入图片, 按每张图自己的尺寸还原坐标
+using EngineOutputs       = std::vector<std::vector<float>>;
+using PreProcessFuncType  = std::function<bool(const std::vector<cv::Mat>& inputs_batch, std::vector<float*>& oupputs)>;
+using PostProcessFuncType =
+    std::function<Detections(const std::vector<cv::Mat>& inputs_batch, const EngineOutputs& oupputs)>;
+
+// 所有推理引擎的公共接口
+// 1. LoadModel 之后可以通过 GetInputs/GetOutputs 拿到输入输出的形状, 模型根据它们计算后处理参数
+// 2. Forwards 是同步接口, Submit 把 Forwards 放到内部线程中执行并返回 future
+// 3. 最多 MaxInFlight 个请求同时执行, 大于 1 时 Forwards 会被并发调用, 子类需要保证线程安全
+// 4. 子类的 Forwards 通过 AcquireOutputs 拿输出 buffer, 每个执行中的请求一份, 跨请求复用
 class EngineBase
 {
-    virtual bool LoadModel(const std::string& model, bool device_preprocess = false) = 0;
+public:
+    virtual ~EngineBase() = default;
+
+    virtual bool       LoadModel(const std::string& model, bool device_preprocess = false) = 0;
+    virtual Detections Forwards(const std::vector<cv::Mat>& input_signals)                 = 0;
+
+    std::future<Detections> Submit(std::vector<cv::Mat> input_signals)
+    {
+        std::call_once(SubmitPoolFlag,
+                       [this]()
+                       {
+                           SubmitPool = std::make_unique<ThreadPool>(static_cast<std::uint8_t>(MaxInFlight));
+                           SubmitPool->Start();
+                       });
+        return SubmitPool->Commit([this](const std::vector<cv::Mat>& inputs) { return Forwards(inputs); },
+                                  std::move(input_signals));
+    }
+
+    bool RegisterPreProcessFunc(PreProcessFuncType func)
+    {
+        PreProcessFunc = func;
+        return true;
+    }
+
+    bool RegisterPostProcessFunc(PostProcessFuncType func)
+    {
+        PostProcessFunc = func;
+        return true;
+    }
+
+    virtual void EnableDevicePreProcess() {}
+    virtual bool IsDevicePreProcess() const { return false; }
+
+    // 在第一次 Submit 之前调用
+    void SetMaxInFlight(int num) { MaxInFlight = std::clamp(num, 1, 255); }
+    int  GetMaxInFlight() const { return MaxInFlight; }
+
+    const std::vector<TensorDesc>& GetInputs() const { return InputDescs; }
+    const std::vector<TensorDesc>& GetOutputs() const { return OutputDescs; }
+
+protected:
+    // 从输出 buffer 池中取出的一份, 离开作用域时归还
+    class OutputsHandle
+    {
+    public:
+        OutputsHandle(EngineBase* engine, EngineOutputs* outputs) : Engine(engine), Outputs(outputs) {}
+        ~OutputsHandle() { Engine->ReleaseOutputs(Outputs); }
+
+        OutputsHandle(const OutputsHandle&)            = delete;
+        OutputsHandle& operator=(const OutputsHandle&) = delete;
+
+        EngineOutputs& operator*() const { return *Outputs; }
+        EngineOutputs* operator->() const { return Outputs; }
+
+    private:
+        EngineBase*    Engine;
+        EngineOutputs* Outputs;
+    };
+
+    // 取一份输出 buffer, 后处理结束后 (handle 析构时) 归还, buffer 只 resize 不释放, 稳定后推理不再分配内存
+    // 最多 MaxInFlight 份, 都被占用时等待, 与 MockEngine 的 slot 相同
+    OutputsHandle AcquireOutputs()
+    {
+        std::unique_lock<std::mutex> lock(OutputsMutex);
+        OutputsCond.wait(lock,
+                         [this]()
+                         {
+                             return not FreeOutputs.empty() or static_cast<int>(OutputsPool.size()) < MaxInFlight;
+                         });
+        if (FreeOutputs.empty())
+        {
+            OutputsPool.push_back(std::make_unique<EngineOutputs>());
+            return OutputsHandle(this, OutputsPool.back().get());
+        }
+        auto* outputs = FreeOutputs.back();
+        FreeOutputs.pop_back();
+        return OutputsHandle(this, outputs);
+    }
+
+    // 等待已提交的请求执行完, 子类析构时必须先调用, 否则线程中的 Forwards 会访问已析构的成员
+    void StopSubmit() { SubmitPool.reset(); }
+
+    std::vector<TensorDesc> InputDescs;
+    std::vector<TensorDesc> OutputDescs;
+    PreProcessFuncType      PreProcessFunc;
+    PostProcessFuncType     PostProcessFunc;
+
+private:
+    void ReleaseOutputs(EngineOutputs* outputs)
+    {
+        {
+            std::lock_guard<std::mutex> lock(OutputsMutex);
+            FreeOutputs.push_back(outputs);
+        }
+        OutputsCond.notify_one();
+    }
+
+    int                         MaxInFlight{1};
+    std::once_flag              SubmitPoolFlag;
+    std::unique_ptr<ThreadPool> SubmitPool;
+
+    std::mutex                                  OutputsMutex;
+    std::condition_variable                     OutputsCond;
+    std::vector<std::unique_ptr<EngineOutputs>> OutputsPool;
+    std::vector<EngineOutputs*>                 FreeOutputs;
 };
 }  // namespace cv_infer
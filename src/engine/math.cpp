@@ -1,19 +1,902 @@
 #include "math.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "tools/logger.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CVINFER_MATH_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CVINFER_MATH_NEON
+#endif
+
 namespace cv_infer
 {
+namespace
+{
+// 一行 BGR 像素最近邻采样后归一化, 分别写到 R/G/B 三个平面
+// src_xs[x] 是第 x 个输出像素在源图像行内的字节偏移, 前 vec_n 个像素可以多读 1 个字节 (AVX2 gather 一次读 4 字节)
+using ResizeRowFunc = void (*)(const unsigned char* src_row, const int* src_xs, int n, int vec_n, float alpha,
+                               float beta, float* dst_r, float* dst_g, float* dst_b);
+
+inline void ResizeRowBGRTail(const unsigned char* src_row, const int* src_xs, int x, int n, float alpha, float beta,
+                             float* dst_r, float* dst_g, float* dst_b)
+{
+    for (; x < n; x++)
+    {
+        const unsigned char* pixel = src_row + src_xs[x];
+        dst_b[x]                   = ((float)pixel[0]) * alpha + beta;
+        dst_g[x]                   = ((float)pixel[1]) * alpha + beta;
+        dst_r[x]                   = ((float)pixel[2]) * alpha + beta;
+    }
+}
+
+void ResizeRowBGRScalar(const unsigned char* src_row, const int* src_xs, int n, int /*vec_n*/, float alpha,
+                        float beta, float* dst_r, float* dst_g, float* dst_b)
+{
+    ResizeRowBGRTail(src_row, src_xs, 0, n, alpha, beta, dst_r, dst_g, dst_b);
+}
+
+#if defined(CVINFER_MATH_X86)
+__attribute__((target("avx2,fma"))) void ResizeRowBGRAvx2(const unsigned char* src_row, const int* src_xs, int n,
+                                                           int vec_n, float alpha, float beta, float* dst_r,
+                                                           float* dst_g, float* dst_b)
+{
+    const __m256  va   = _mm256_set1_ps(alpha);
+    const __m256  vb   = _mm256_set1_ps(beta);
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+
+    int x = 0;
+    for (; x + 8 <= vec_n; x += 8)
+    {
+        // 一次 gather 8 个像素, 每个 32 位中低 3 个字节是 B G R
+        __m256i idx   = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src_xs + x));
+        __m256i pixel = _mm256_i32gather_epi32(reinterpret_cast<const int*>(src_row), idx, 1);
+        __m256  b     = _mm256_cvtepi32_ps(_mm256_and_si256(pixel, mask));
+        __m256  g     = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixel, 8), mask));
+        __m256  r     = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixel, 16), mask));
+        _mm256_storeu_ps(dst_b + x, _mm256_fmadd_ps(b, va, vb));
+        _mm256_storeu_ps(dst_g + x, _mm256_fmadd_ps(g, va, vb));
+        _mm256_storeu_ps(dst_r + x, _mm256_fmadd_ps(r, va, vb));
+    }
+    ResizeRowBGRTail(src_row, src_xs, x, n, alpha, beta, dst_r, dst_g, dst_b);
+}
+#endif
+
+#if defined(CVINFER_MATH_NEON)
+void ResizeRowBGRNeon(const unsigned char* src_row, const int* src_xs, int n, int /*vec_n*/, float alpha, float beta,
+                      float* dst_r, float* dst_g, float* dst_b)
+{
+    const float32x4_t va = vdupq_n_f32(alpha);
+    const float32x4_t vb = vdupq_n_f32(beta);
+
+    // NEON 没有 gather, 先把采样后的 16 个像素拷到连续的 buffer 中, 再用 vld3 解交织
+    unsigned char pixels[48];
+    auto          store = [&](uint8x16_t channel, float* dst)
+    {
+        uint16x8_t lo = vmovl_u8(vget_low_u8(channel));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(channel));
+        vst1q_f32(dst + 0, vmlaq_f32(vb, vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))), va));
+        vst1q_f32(dst + 4, vmlaq_f32(vb, vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo))), va));
+        vst1q_f32(dst + 8, vmlaq_f32(vb, vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))), va));
+        vst1q_f32(dst + 12, vmlaq_f32(vb, vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi))), va));
+    };
+
+    int x = 0;
+    for (; x + 16 <= n; x += 16)
+    {
+        for (int k = 0; k < 16; k++)
+        {
+            std::memcpy(pixels + k * 3, src_row + src_xs[x + k], 3);
+        }
+        uint8x16x3_t bgr = vld3q_u8(pixels);
+        store(bgr.val[0], dst_b + x);
+        store(bgr.val[1], dst_g + x);
+        store(bgr.val[2], dst_r + x);
+    }
+    ResizeRowBGRTail(src_row, src_xs, x, n, alpha, beta, dst_r, dst_g, dst_b);
+}
+#endif
+
+// 运行时选择一次, 之后直接调用
+ResizeRowFunc GetResizeRowBGRFunc()
+{
+    static const ResizeRowFunc func = []() -> ResizeRowFunc
+    {
+#if defined(CVINFER_MATH_X86)
+        if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma"))
+        {
+            return ResizeRowBGRAvx2;
+        }
+#elif defined(CVINFER_MATH_NEON)
+        return ResizeRowBGRNeon;
+#endif
+        return ResizeRowBGRScalar;
+    }();
+    return func;
+}
+
+// 双线性缩放的水平方向: 一行源像素插值成 n 个输出像素, 按通道写到 planes[0..c)
+// xofs0/xofs1 是左右两个源像素在行内的字节偏移, wx 是右侧像素的权重, 前 vec_n 个像素可以多读 1 个字节
+using HResizeRowFunc = void (*)(const unsigned char* src_row, int c, const int* xofs0, const int* xofs1,
+                                const float* wx, int n, int vec_n, float* const* planes);
+// 双线性缩放的垂直方向 + 归一化: dst = (row0 + wy * (row1 - row0) - mean) * inv_scale
+using VBlendRowFunc = void (*)(const float* row0, const float* row1, float wy, float mean, float inv_scale, int n,
+                               float* dst);
+
+inline void HResizeRowTail(const unsigned char* src_row, int c, const int* xofs0, const int* xofs1, const float* wx,
+                           int x, int n, float* const* planes)
+{
+    for (; x < n; x++)
+    {
+        const unsigned char* p0 = src_row + xofs0[x];
+        const unsigned char* p1 = src_row + xofs1[x];
+        for (int z = 0; z < c; z++)
+        {
+            planes[z][x] = (float)p0[z] + wx[x] * ((float)p1[z] - (float)p0[z]);
+        }
+    }
+}
+
+void HResizeRowScalar(const unsigned char* src_row, int c, const int* xofs0, const int* xofs1, const float* wx, int n,
+                      int /*vec_n*/, float* const* planes)
+{
+    HResizeRowTail(src_row, c, xofs0, xofs1, wx, 0, n, planes);
+}
+
+void VBlendRowScalar(const float* row0, const float* row1, float wy, float mean, float inv_scale, int n, float* dst)
+{
+    for (int x = 0; x < n; x++)
+    {
+        dst[x] = (row0[x] + wy * (row1[x] - row0[x]) - mean) * inv_scale;
+    }
+}
+
+#if defined(CVINFER_MATH_X86)
+__attribute__((target("avx2,fma"))) void HResizeRowAvx2(const unsigned char* src_row, int c, const int* xofs0,
+                                                         const int* xofs1, const float* wx, int n, int vec_n,
+                                                         float* const* planes)
+{
+    if (c != 3)
+    {
+        return HResizeRowScalar(src_row, c, xofs0, xofs1, wx, n, vec_n, planes);
+    }
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    const auto*   base = reinterpret_cast<const int*>(src_row);
+
+    int x = 0;
+    for (; x + 8 <= vec_n; x += 8)
+    {
+        __m256i p0 = _mm256_i32gather_epi32(base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xofs0 + x)), 1);
+        __m256i p1 = _mm256_i32gather_epi32(base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xofs1 + x)), 1);
+        __m256  w  = _mm256_loadu_ps(wx + x);
+        for (int z = 0; z < 3; z++)
+        {
+            __m256 v0 = _mm256_cvtepi32_ps(_mm256_and_si256(p0, mask));
+            __m256 v1 = _mm256_cvtepi32_ps(_mm256_and_si256(p1, mask));
+            _mm256_storeu_ps(planes[z] + x, _mm256_fmadd_ps(w, _mm256_sub_ps(v1, v0), v0));
+            p0 = _mm256_srli_epi32(p0, 8);
+            p1 = _mm256_srli_epi32(p1, 8);
+        }
+    }
+    HResizeRowTail(src_row, c, xofs0, xofs1, wx, x, n, planes);
+}
+
+__attribute__((target("avx2,fma"))) void VBlendRowAvx2(const float* row0, const float* row1, float wy, float mean,
+                                                        float inv_scale, int n, float* dst)
+{
+    const __m256 vw = _mm256_set1_ps(wy);
+    const __m256 vm = _mm256_set1_ps(mean);
+    const __m256 vs = _mm256_set1_ps(inv_scale);
+
+    int x = 0;
+    for (; x + 8 <= n; x += 8)
+    {
+        __m256 v0 = _mm256_loadu_ps(row0 + x);
+        __m256 v  = _mm256_fmadd_ps(vw, _mm256_sub_ps(_mm256_loadu_ps(row1 + x), v0), v0);
+        _mm256_storeu_ps(dst + x, _mm256_mul_ps(_mm256_sub_ps(v, vm), vs));
+    }
+    VBlendRowScalar(row0 + x, row1 + x, wy, mean, inv_scale, n - x, dst + x);
+}
+#endif
+
+#if defined(CVINFER_MATH_NEON)
+void VBlendRowNeon(const float* row0, const float* row1, float wy, float mean, float inv_scale, int n, float* dst)
+{
+    const float32x4_t vm = vdupq_n_f32(mean);
+    const float32x4_t vs = vdupq_n_f32(inv_scale);
+
+    int x = 0;
+    for (; x + 4 <= n; x += 4)
+    {
+        float32x4_t v0 = vld1q_f32(row0 + x);
+        float32x4_t v  = vmlaq_n_f32(v0, vsubq_f32(vld1q_f32(row1 + x), v0), wy);
+        vst1q_f32(dst + x, vmulq_f32(vsubq_f32(v, vm), vs));
+    }
+    VBlendRowScalar(row0 + x, row1 + x, wy, mean, inv_scale, n - x, dst + x);
+}
+#endif
+
+std::pair<HResizeRowFunc, VBlendRowFunc> GetBilinearRowFuncs()
+{
+    static const std::pair<HResizeRowFunc, VBlendRowFunc> funcs = []() -> std::pair<HResizeRowFunc, VBlendRowFunc>
+    {
+#if defined(CVINFER_MATH_X86)
+        if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma"))
+        {
+            return {HResizeRowAvx2, VBlendRowAvx2};
+        }
+#elif defined(CVINFER_MATH_NEON)
+        // NEON 没有 gather, 水平方向用标量
+        return {HResizeRowScalar, VBlendRowNeon};
+#endif
+        return {HResizeRowScalar, VBlendRowScalar};
+    }();
+    return funcs;
+}
+
+// yolo 的一行输出还原成检测框, 写到 boxes 末尾: x1, y1, x2, y2, obj, label
+inline void EmitYoloBox(const float* row, int label, float scale, float pad_x, float pad_y, std::vector<float>& boxes)
+{
+    float left   = row[0] - row[2] * 0.5f;
+    float top    = row[1] - row[3] * 0.5f;
+    float right  = row[0] + row[2] * 0.5f;
+    float bottom = row[1] + row[3] * 0.5f;
+    boxes.insert(boxes.end(), {(left - pad_x) / scale, (top - pad_y) / scale, (right - pad_x) / scale,
+                               (bottom - pad_y) / scale, row[4], (float)label});
+}
+
+// 第一个最大且大于 0 的类别, 没有则返回 -1
+inline int ArgMaxPositiveScalar(const float* scores, int n)
+{
+    float max_score = 0.0f;
+    int   label     = -1;
+    for (int j = 0; j < n; j++)
+    {
+        if (scores[j] > max_score)
+        {
+            max_score = scores[j];
+            label     = j;
+        }
+    }
+    return label;
+}
+
+using DecodeYoloFunc = int (*)(const float* data, int anchor_num, int anchor_len, float conf_threshold, float scale,
+                               float pad_x, float pad_y, std::vector<float>& boxes);
+
+int DecodeYoloRowsScalar(const float* data, int anchor_num, int anchor_len, float conf_threshold, float scale,
+                         float pad_x, float pad_y, std::vector<float>& boxes)
+{
+    int count = 0;
+    for (int a = 0; a < anchor_num; a++)
+    {
+        const float* row = data + (std::size_t)a * anchor_len;
+        if (row[4] < conf_threshold)
+        {
+            continue;
+        }
+        EmitYoloBox(row, ArgMaxPositiveScalar(row + 5, anchor_len - 5), scale, pad_x, pad_y, boxes);
+        count++;
+    }
+    return count;
+}
+
+#if defined(CVINFER_MATH_X86)
+__attribute__((target("avx2,fma"))) int ArgMaxPositiveAvx2(const float* scores, int n)
+{
+    // 1. 求最大值 (NaN 被忽略, 与标量版本的 > 比较一致)
+    __m256 vmax = _mm256_setzero_ps();
+    int    j    = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        vmax = _mm256_max_ps(_mm256_loadu_ps(scores + j), vmax);
+    }
+    __m128 m = _mm_max_ps(_mm256_castps256_ps128(vmax), _mm256_extractf128_ps(vmax, 1));
+    m        = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    m        = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+
+    float max_score = _mm_cvtss_f32(m);
+    for (int k = j; k < n; k++)
+    {
+        max_score = scores[k] > max_score ? scores[k] : max_score;
+    }
+    if (not(max_score > 0.0f))
+    {
+        return -1;
+    }
+    // 2. 找第一个等于最大值的位置
+    const __m256 target = _mm256_set1_ps(max_score);
+    for (j = 0; j + 8 <= n; j += 8)
+    {
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(scores + j), target, _CMP_EQ_OQ));
+        if (mask != 0)
+        {
+            return j + __builtin_ctz(mask);
+        }
+    }
+    for (; j < n; j++)
+    {
+        if (scores[j] == max_score)
+        {
+            return j;
+        }
+    }
+    return -1;
+}
+
+__attribute__((target("avx2,fma"))) int DecodeYoloRowsAvx2(const float* data, int anchor_num, int anchor_len,
+                                                            float conf_threshold, float scale, float pad_x,
+                                                            float pad_y, std::vector<float>& boxes)
+{
+    // 一次 gather 8 个 anchor 的 obj, 比较后只处理通过的 anchor
+    const __m256i offsets =
+        _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(anchor_len));
+    const __m256  vthr    = _mm256_set1_ps(conf_threshold);
+
+    int count = 0;
+    int a     = 0;
+    for (; a + 8 <= anchor_num; a += 8)
+    {
+        const float* block = data + (std::size_t)a * anchor_len;
+        __m256       obj   = _mm256_i32gather_ps(block + 4, offsets, 4);
+        int          mask  = _mm256_movemask_ps(_mm256_cmp_ps(obj, vthr, _CMP_NLT_UQ));
+        while (mask != 0)
+        {
+            const float* row = block + (std::size_t)__builtin_ctz(mask) * anchor_len;
+            mask &= mask - 1;
+            EmitYoloBox(row, ArgMaxPositiveAvx2(row + 5, anchor_len - 5), scale, pad_x, pad_y, boxes);
+            count++;
+        }
+    }
+    return count + DecodeYoloRowsScalar(data + (std::size_t)a * anchor_len, anchor_num - a, anchor_len,
+                                        conf_threshold, scale, pad_x, pad_y, boxes);
+}
+#endif
+
+DecodeYoloFunc GetDecodeYoloFunc()
+{
+    static const DecodeYoloFunc func = []() -> DecodeYoloFunc
+    {
+#if defined(CVINFER_MATH_X86)
+        if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma"))
+        {
+            return DecodeYoloRowsAvx2;
+        }
+#endif
+        return DecodeYoloRowsScalar;
+    }();
+    return func;
+}
+
+// yolov8/v9 的一列输出还原成检测框: 第 k 个分量在 data[k * anchor_num + a]
+inline void EmitYoloColumn(const float* data, int anchor_num, int a, float score, int label, float scale,
+                           float pad_x, float pad_y, std::vector<float>& boxes)
+{
+    float cx = data[a];
+    float cy = data[anchor_num + a];
+    float w  = data[2 * anchor_num + a];
+    float h  = data[3 * anchor_num + a];
+    boxes.insert(boxes.end(), {(cx - w * 0.5f - pad_x) / scale, (cy - h * 0.5f - pad_y) / scale,
+                               (cx + w * 0.5f - pad_x) / scale, (cy + h * 0.5f - pad_y) / scale, score, (float)label});
+}
+
+using DecodeYoloColumnsFunc = int (*)(const float* data, int anchor_num, int class_num, float conf_threshold,
+                                      float scale, float pad_x, float pad_y, std::vector<float>& boxes);
+
+// 解码 [begin, end) 范围内的 anchor, 类别取第一个最大值
+int DecodeYoloColumnsRange(const float* data, int anchor_num, int class_num, int begin, int end, float conf_threshold,
+                           float scale, float pad_x, float pad_y, std::vector<float>& boxes)
+{
+    int count = 0;
+    for (int a = begin; a < end; a++)
+    {
+        const float* scores    = data + 4 * (std::size_t)anchor_num + a;
+        float        max_score = scores[0];
+        int          label     = 0;
+        for (int c = 1; c < class_num; c++)
+        {
+            if (scores[(std::size_t)c * anchor_num] > max_score)
+            {
+                max_score = scores[(std::size_t)c * anchor_num];
+                label     = c;
+            }
+        }
+        if (max_score >= conf_threshold)
+        {
+            EmitYoloColumn(data, anchor_num, a, max_score, label, scale, pad_x, pad_y, boxes);
+            count++;
+        }
+    }
+    return count;
+}
+
+int DecodeYoloColumnsScalar(const float* data, int anchor_num, int class_num, float conf_threshold, float scale,
+                            float pad_x, float pad_y, std::vector<float>& boxes)
+{
+    return DecodeYoloColumnsRange(data, anchor_num, class_num, 0, anchor_num, conf_threshold, scale, pad_x, pad_y,
+                                  boxes);
+}
+
+#if defined(CVINFER_MATH_X86)
+__attribute__((target("avx2,fma"))) int DecodeYoloColumnsAvx2(const float* data, int anchor_num, int class_num,
+                                                               float conf_threshold, float scale, float pad_x,
+                                                               float pad_y, std::vector<float>& boxes)
+{
+    // 类别分数按行连续存放, 一次处理相邻的 8 个 anchor, 逐类别取最大值和对应的类别号
+    const __m256 vthr  = _mm256_set1_ps(conf_threshold);
+    int          count = 0;
+    int          a     = 0;
+    for (; a + 8 <= anchor_num; a += 8)
+    {
+        const float* scores    = data + 4 * (std::size_t)anchor_num + a;
+        __m256       max_score = _mm256_loadu_ps(scores);
+        __m256       label     = _mm256_setzero_ps();
+        for (int c = 1; c < class_num; c++)
+        {
+            __m256 s  = _mm256_loadu_ps(scores + (std::size_t)c * anchor_num);
+            __m256 gt = _mm256_cmp_ps(s, max_score, _CMP_GT_OQ);
+            max_score = _mm256_blendv_ps(max_score, s, gt);
+            label     = _mm256_blendv_ps(label, _mm256_set1_ps((float)c), gt);
+        }
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(max_score, vthr, _CMP_GE_OQ));
+        if (mask == 0)
+        {
+            continue;
+        }
+        alignas(32) float max_scores[8];
+        alignas(32) float labels[8];
+        _mm256_store_ps(max_scores, max_score);
+        _mm256_store_ps(labels, label);
+        while (mask != 0)
+        {
+            int k = __builtin_ctz(mask);
+            mask &= mask - 1;
+            EmitYoloColumn(data, anchor_num, a + k, max_scores[k], (int)labels[k], scale, pad_x, pad_y, boxes);
+            count++;
+        }
+    }
+    return count + DecodeYoloColumnsRange(data, anchor_num, class_num, a, anchor_num, conf_threshold, scale, pad_x,
+                                          pad_y, boxes);
+}
+#endif
+
+DecodeYoloColumnsFunc GetDecodeYoloColumnsFunc()
+{
+    static const DecodeYoloColumnsFunc func = []() -> DecodeYoloColumnsFunc
+    {
+#if defined(CVINFER_MATH_X86)
+        if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma"))
+        {
+            return DecodeYoloColumnsAvx2;
+        }
+#endif
+        return DecodeYoloColumnsScalar;
+    }();
+    return func;
+}
+
+// exp 的多项式近似 (cephes expf), 相对误差约 2e-7
+// 输入截断到 [-87.3, 88], 保证 2^n 是正规数
+// exp(x) = 2^n * exp(r), n = round(x / ln2), r = x - n * ln2 分两部分减去以保留精度
+using ExpArrayFunc = void (*)(const float* src, int n, float* dst);
+
+void ExpArrayScalar(const float* src, int n, float* dst)
+{
+    for (int i = 0; i < n; i++)
+    {
+        dst[i] = std::exp(src[i]);
+    }
+}
+
+#if defined(CVINFER_MATH_X86)
+__attribute__((target("avx2,fma"))) void ExpArrayAvx2(const float* src, int n, float* dst)
+{
+    const __m256 hi    = _mm256_set1_ps(88.0f);
+    const __m256 lo    = _mm256_set1_ps(-87.3f);
+    const __m256 log2e = _mm256_set1_ps(1.44269504088896341f);
+    const __m256 c1    = _mm256_set1_ps(0.693359375f);
+    const __m256 c2    = _mm256_set1_ps(-2.12194440e-4f);
+    const __m256 half  = _mm256_set1_ps(0.5f);
+    const __m256 one   = _mm256_set1_ps(1.0f);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 x  = _mm256_max_ps(_mm256_min_ps(_mm256_loadu_ps(src + i), hi), lo);
+        __m256 fx = _mm256_floor_ps(_mm256_fmadd_ps(x, log2e, half));
+        x         = _mm256_fnmadd_ps(fx, c1, x);
+        x         = _mm256_fnmadd_ps(fx, c2, x);
+
+        __m256 y = _mm256_set1_ps(1.9875691500E-4f);
+        y        = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507E-3f));
+        y        = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073E-3f));
+        y        = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894E-2f));
+        y        = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459E-1f));
+        y        = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201E-1f));
+        y        = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x), _mm256_add_ps(x, one));
+
+        __m256i pow2n = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(fx), _mm256_set1_epi32(127)), 23);
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(y, _mm256_castsi256_ps(pow2n)));
+    }
+    ExpArrayScalar(src + i, n - i, dst + i);
+}
+#endif
+
+#if defined(CVINFER_MATH_NEON)
+void ExpArrayNeon(const float* src, int n, float* dst)
+{
+    const float32x4_t hi  = vdupq_n_f32(88.0f);
+    const float32x4_t lo  = vdupq_n_f32(-87.3f);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        float32x4_t x  = vmaxq_f32(vminq_f32(vld1q_f32(src + i), hi), lo);
+        float32x4_t fx = vmlaq_n_f32(vdupq_n_f32(0.5f), x, 1.44269504088896341f);
+        // floor: 截断后大于原值的减 1
+        float32x4_t t = vcvtq_f32_s32(vcvtq_s32_f32(fx));
+        fx            = vsubq_f32(t, vreinterpretq_f32_u32(vandq_u32(vcgtq_f32(t, fx), vreinterpretq_u32_f32(one))));
+        x             = vmlsq_n_f32(x, fx, 0.693359375f);
+        x             = vmlsq_n_f32(x, fx, -2.12194440e-4f);
+
+        float32x4_t y = vdupq_n_f32(1.9875691500E-4f);
+        y             = vmlaq_f32(vdupq_n_f32(1.3981999507E-3f), y, x);
+        y             = vmlaq_f32(vdupq_n_f32(8.3334519073E-3f), y, x);
+        y             = vmlaq_f32(vdupq_n_f32(4.1665795894E-2f), y, x);
+        y             = vmlaq_f32(vdupq_n_f32(1.6666665459E-1f), y, x);
+        y             = vmlaq_f32(vdupq_n_f32(5.0000001201E-1f), y, x);
+        y             = vmlaq_f32(vaddq_f32(x, one), y, vmulq_f32(x, x));
+
+        int32x4_t pow2n = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(fx), vdupq_n_s32(127)), 23);
+        vst1q_f32(dst + i, vmulq_f32(y, vreinterpretq_f32_s32(pow2n)));
+    }
+    ExpArrayScalar(src + i, n - i, dst + i);
+}
+#endif
+
+ExpArrayFunc GetExpArrayFunc()
+{
+    static const ExpArrayFunc func = []() -> ExpArrayFunc
+    {
+#if defined(CVINFER_MATH_X86)
+        if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma"))
+        {
+            return ExpArrayAvx2;
+        }
+#elif defined(CVINFER_MATH_NEON)
+        return ExpArrayNeon;
+#endif
+        return ExpArrayScalar;
+    }();
+    return func;
+}
+
+using SelectRowsFunc = int (*)(const float* data, int rows, int row_len, int col, float threshold,
+                               std::vector<int>& selected);
+
+int SelectRowsScalar(const float* data, int rows, int row_len, int col, float threshold, std::vector<int>& selected)
+{
+    int count = 0;
+    for (int i = 0; i < rows; i++)
+    {
+        if (data[(std::size_t)i * row_len + col] >= threshold)
+        {
+            selected.push_back(i);
+            count++;
+        }
+    }
+    return count;
+}
+
+#if defined(CVINFER_MATH_X86)
+__attribute__((target("avx2,fma"))) int SelectRowsAvx2(const float* data, int rows, int row_len, int col,
+                                                        float threshold, std::vector<int>& selected)
+{
+    // 一次 gather 8 行的同一列
+    const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(row_len));
+    const __m256  vthr    = _mm256_set1_ps(threshold);
+
+    int count = 0;
+    int i     = 0;
+    for (; i + 8 <= rows; i += 8)
+    {
+        __m256 v    = _mm256_i32gather_ps(data + (std::size_t)i * row_len + col, offsets, 4);
+        int    mask = _mm256_movemask_ps(_mm256_cmp_ps(v, vthr, _CMP_GE_OQ));
+        for (; mask != 0; mask &= mask - 1)
+        {
+            selected.push_back(i + __builtin_ctz(mask));
+            count++;
+        }
+    }
+    const std::size_t first = selected.size();
+    count += SelectRowsScalar(data + (std::size_t)i * row_len, rows - i, row_len, col, threshold, selected);
+    for (std::size_t k = first; k < selected.size(); k++)
+    {
+        selected[k] += i;
+    }
+    return count;
+}
+#endif
+
+SelectRowsFunc GetSelectRowsFunc()
+{
+    static const SelectRowsFunc func = []() -> SelectRowsFunc
+    {
+#if defined(CVINFER_MATH_X86)
+        if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma"))
+        {
+            return SelectRowsAvx2;
+        }
+#endif
+        return SelectRowsScalar;
+    }();
+    return func;
+}
+
+// 双线性插值的坐标表, 坐标映射与 cv::resize(INTER_LINEAR) 一致 (像素中心对齐)
+struct BilinearTable
+{
+    int                src_h = 0;
+    int                src_w = 0;
+    std::vector<int>   xofs0, xofs1;
+    std::vector<float> wx;
+    std::vector<int>   yofs0, yofs1;
+    std::vector<float> wy;
+    int                vec_n = 0;
+
+    BilinearTable(int src_h, int src_w, int c, int dst_h, int dst_w)
+        : src_h(src_h), src_w(src_w), xofs0(dst_w), xofs1(dst_w), wx(dst_w), yofs0(dst_h), yofs1(dst_h), wy(dst_h)
+    {
+        auto compute = [](int src_len, int dst_len, int* ofs0, int* ofs1, float* weight)
+        {
+            double scale = (double)src_len / dst_len;
+            for (int i = 0; i < dst_len; i++)
+            {
+                float f = (float)((i + 0.5) * scale - 0.5);
+                int   s = (int)std::floor(f);
+                f -= s;
+                if (s < 0)
+                {
+                    s = 0;
+                    f = 0;
+                }
+                if (s >= src_len - 1)
+                {
+                    s = src_len - 1;
+                    f = 0;
+                }
+                ofs0[i]   = s;
+                ofs1[i]   = std::min(s + 1, src_len - 1);
+                weight[i] = f;
+            }
+        };
+        compute(src_w, dst_w, xofs0.data(), xofs1.data(), wx.data());
+        compute(src_h, dst_h, yofs0.data(), yofs1.data(), wy.data());
+        for (int x = 0; x < dst_w; x++)
+        {
+            xofs0[x] *= c;
+            xofs1[x] *= c;
+        }
+        // gather 一次读 4 个字节, 行尾的像素多读的 1 个字节可能越界 (最后一行或者 ROI), 这部分走标量
+        const int row_bytes = src_w * c;
+        vec_n = std::partition_point(xofs1.begin(), xofs1.end(), [&](int offset) { return offset + 4 <= row_bytes; }) -
+                xofs1.begin();
+    }
+};
+}  // namespace
+
 void ConverHWC2CHWMeanStd(const unsigned char* src, int h, int w, int c, const float* mean, const float* scale,
                           float* dst)
 {
-    for (int i = 0; i < c; i++)
+    cv::Mat image(h, w, CV_8UC(c), const_cast<unsigned char*>(src));
+    ConverHWC2CHWResizeMeanStd({image}, h, w, mean, scale, {dst});
+}
+
+void ConverHWC2CHWResizeMeanStd(const std::vector<cv::Mat>& images, int dst_h, int dst_w, const float* mean,
+                                const float* scale, const std::vector<float*>& dst)
+{
+    if (images.empty())
+    {
+        return;
+    }
+    const int c          = images[0].channels();
+    const int plane_size = dst_h * dst_w;
+    if (c > 4)
+    {
+        LOGE("only support 1 ~ 4 channels, but got [%d]", c);
+        return;
+    }
+
+    // 同一批图片的尺寸通常相同, 坐标表只算一次
+    std::vector<std::shared_ptr<BilinearTable>> tables(images.size());
+    for (int i = 0; i < images.size(); i++)
+    {
+        const auto& image = images[i];
+        if (i > 0 and image.rows == tables[i - 1]->src_h and image.cols == tables[i - 1]->src_w)
+        {
+            tables[i] = tables[i - 1];
+            continue;
+        }
+        tables[i] = std::make_shared<BilinearTable>(image.rows, image.cols, c, dst_h, dst_w);
+    }
+    std::vector<float> inv_scale(c);
+    for (int z = 0; z < c; z++)
+    {
+        inv_scale[z] = 1.0f / scale[z];
+    }
+
+    const auto [hresize_row, vblend_row] = GetBilinearRowFuncs();
+
+    // 按 (图片, 行) 并行, 每个任务处理连续的若干行, 相邻行共用的水平插值结果会被复用
+    auto process_rows = [&](const cv::Range& range)
     {
-        for (int j = 0; j < h; j++)
+        std::vector<float> buffers[2] = {std::vector<float>(c * dst_w), std::vector<float>(c * dst_w)};
+        int                cached[2]  = {-1, -1};
+        int                cached_img = -1;
+
+        // 取得源图像第 sy 行的水平插值结果, 不会覆盖 keep 指向的缓存
+        auto load_row = [&](const BilinearTable& table, const cv::Mat& image, int sy, int keep) -> const float*
         {
-            for (int k = 0; k < w; k++)
+            for (int k = 0; k < 2; k++)
+            {
+                if (cached[k] == sy)
+                {
+                    return buffers[k].data();
+                }
+            }
+            int    slot = keep >= 0 ? 1 - keep : (cached[0] < cached[1] ? 0 : 1);
+            float* planes[4];
+            for (int z = 0; z < c; z++)
+            {
+                planes[z] = buffers[slot].data() + z * dst_w;
+            }
+            hresize_row(image.ptr<unsigned char>(sy), c, table.xofs0.data(), table.xofs1.data(), table.wx.data(),
+                        dst_w, table.vec_n, planes);
+            cached[slot] = sy;
+            return buffers[slot].data();
+        };
+
+        for (int row = range.start; row < range.end; row++)
+        {
+            const int   img   = row / dst_h;
+            const int   y     = row % dst_h;
+            const auto& table = *tables[img];
+            if (img != cached_img)
+            {
+                cached[0] = cached[1] = -1;
+                cached_img            = img;
+            }
+            const int    y0   = table.yofs0[y];
+            const int    y1   = table.yofs1[y];
+            const float* row0 = load_row(table, images[img], y0, -1);
+            const int    keep = cached[0] == y0 ? 0 : 1;
+            const float* row1 = y1 == y0 ? row0 : load_row(table, images[img], y1, keep);
+            for (int z = 0; z < c; z++)
             {
-                dst[i * h * w + j * w + k] = ((float)(src[j * w * c + k * c + i] - mean[i])) / scale[i];
+                vblend_row(row0 + z * dst_w, row1 + z * dst_w, table.wy[y], mean[z], inv_scale[z], dst_w,
+                           dst[img] + z * plane_size + y * dst_w);
             }
         }
+    };
+    cv::parallel_for_(cv::Range(0, (int)images.size() * dst_h), process_rows);
+}
+
+void ConverHWC2CHWAlpahNormResizeKeepRatio(const unsigned char* src, int src_h, int src_w, int src_c, int dst_h,
+                                           int dst_w, int dst_c, float alpha, float beta, float fill_value, float* dst,
+                                           std::size_t src_step)
+{
+    // 计算缩放比例和填充, 与 kernel 保持一致
+    float scale = std::min((float)dst_w / src_w, (float)dst_h / src_h);
+    int   new_w = (int)(src_w * scale);
+    int   new_h = (int)(src_h * scale);
+    int   pad_x = (dst_w - new_w) / 2;
+    int   pad_y = (dst_h - new_h) / 2;
+    float fill  = fill_value * alpha + beta;
+
+    // 每一列对应的源图像列只和 x 有关, 提前算好
+    std::vector<int> src_xs(new_w);
+    for (int x = 0; x < new_w; x++)
+    {
+        src_xs[x] = (int)(x / scale) * src_c;
     }
+    // 行之间可能有填充 (ROI 或对齐的 Mat), 按 step 定位每一行; gather 在行尾多读的 1 个字节落在下一行或填充中,
+    // 只有最后一行之后的内存不属于图像, 这一行只有前 last_vec_n 个像素可以走 gather
+    const int         src_row_bytes = src_w * src_c;
+    const std::size_t src_row_step  = src_step == 0 ? src_row_bytes : src_step;
+    const int         last_vec_n =
+        std::partition_point(src_xs.begin(), src_xs.end(), [&](int offset) { return offset + 4 <= src_row_bytes; }) -
+        src_xs.begin();
+
+    const bool          bgr        = src_c == 3 and dst_c == 3;
+    const ResizeRowFunc resize_row = GetResizeRowBGRFunc();
+    const int           plane_size = dst_h * dst_w;
+
+    // 按行并行, 每一行一次写完所有通道, 源图像的一行只读一次
+    auto process_rows = [&](const cv::Range& range)
+    {
+        for (int y = range.start; y < range.end; y++)
+        {
+            if (y < pad_y || y >= pad_y + new_h)
+            {
+                for (int z = 0; z < dst_c; z++)
+                {
+                    float* row = dst + z * plane_size + y * dst_w;
+                    std::fill(row, row + dst_w, fill);
+                }
+                continue;
+            }
+
+            const int            src_y   = (int)((y - pad_y) / scale);
+            const unsigned char* src_row = src + src_y * src_row_step;
+            for (int z = 0; z < dst_c; z++)
+            {
+                float* row = dst + z * plane_size + y * dst_w;
+                std::fill(row, row + pad_x, fill);
+                std::fill(row + pad_x + new_w, row + dst_w, fill);
+            }
+            if (bgr)
+            {
+                float* row_r = dst + 0 * plane_size + y * dst_w + pad_x;
+                float* row_g = dst + 1 * plane_size + y * dst_w + pad_x;
+                float* row_b = dst + 2 * plane_size + y * dst_w + pad_x;
+                int    vec_n = src_y == src_h - 1 ? last_vec_n : new_w;
+                resize_row(src_row, src_xs.data(), new_w, vec_n, alpha, beta, row_r, row_g, row_b);
+                continue;
+            }
+            for (int z = 0; z < dst_c; z++)
+            {
+                float*               row     = dst + z * plane_size + y * dst_w + pad_x;
+                const unsigned char* src_ptr = src_row + (src_c - 1 - z);  // BGR -> RGB
+                for (int x = 0; x < new_w; x++)
+                {
+                    row[x] = ((float)src_ptr[src_xs[x]]) * alpha + beta;
+                }
+            }
+        }
+    };
+    cv::parallel_for_(cv::Range(0, dst_h), process_rows);
 }
-}  // namespace cv_infer
\ No newline at end of file
+
+int DecodeYoloRows(const float* data, int anchor_num, int anchor_len, float conf_threshold, float scale, float pad_x,
+                   float pad_y, std::vector<float>& boxes)
+{
+    if (anchor_len <= 5)
+    {
+        LOGE("anchor len must be greater than 5, but got [%d]", anchor_len);
+        return 0;
+    }
+    return GetDecodeYoloFunc()(data, anchor_num, anchor_len, conf_threshold, scale, pad_x, pad_y, boxes);
+}
+
+int DecodeYoloColumns(const float* data, int anchor_num, int class_num, float conf_threshold, float scale, float pad_x,
+                      float pad_y, std::vector<float>& boxes)
+{
+    if (class_num <= 0)
+    {
+        LOGE("class num must be greater than 0, but got [%d]", class_num);
+        return 0;
+    }
+    return GetDecodeYoloColumnsFunc()(data, anchor_num, class_num, conf_threshold, scale, pad_x, pad_y, boxes);
+}
+
+int SelectRows(const float* data, int rows, int row_len, int col, float threshold, std::vector<int>& selected)
+{
+    if (col < 0 or col >= row_len)
+    {
+        LOGE("column [%d] out of range [0, %d)", col, row_len);
+        return 0;
+    }
+    return GetSelectRowsFunc()(data, rows, row_len, col, threshold, selected);
+}
+
+void ExpArray(const float* src, int n, float* dst) { GetExpArrayFunc()(src, n, dst); }
+}  // namespace cv_infer
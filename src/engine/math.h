@@ -1,7 +1,38 @@
 #pragma once
 
+#include <cstddef>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
 namespace cv_infer
 {
+// (x - mean) / scale, HWC -> CHW, 通道顺序不变
 void ConverHWC2CHWMeanStd(const unsigned char* src, int h, int w, int c, const float* mean, const float* scale,
                           float* dst);
-}  // namespace cv_infer
\ No newline at end of file
+// 批量版本: 每张图双线性缩放到 dst_h x dst_w (与 cv::resize INTER_LINEAR 的坐标映射一致), 同时完成归一化和 HWC -> CHW
+// dst[i] 指向第 i 张图在 batch 输入 buffer 中的位置, 按图片和行并行, 不需要单独的 cv::resize
+void ConverHWC2CHWResizeMeanStd(const std::vector<cv::Mat>& images, int dst_h, int dst_w, const float* mean,
+                                const float* scale, const std::vector<float*>& dst);
+// CUDAKernal::ConverHWC2CHWAlpahNormResizeKeepRatio 的 cpu 版本, 结果与 gpu 版本逐像素一致
+// 单次遍历完成 letterbox + BGR2RGB + 归一化 + HWC2CHW, 运行时选择 AVX2/NEON, 按行使用 OpenCV 线程池并行
+// src_step 为源图像一行的字节数 (cv::Mat::step), 0 表示紧密排列 (src_w * src_c)
+void ConverHWC2CHWAlpahNormResizeKeepRatio(const unsigned char* src, int src_h, int src_w, int src_c, int dst_h,
+                                           int dst_w, int dst_c, float alpha, float beta, float fill_value, float* dst,
+                                           std::size_t src_step = 0);
+// yolov5/v7 输出解码, 每个 anchor 一行 [cx, cy, w, h, obj, cls...], 共 anchor_len 个 float
+// 1. 向量化比较 obj, 只对 obj >= conf_threshold 的 anchor 计算类别 argmax, 耗时主要与检测数相关
+// 2. 检测追加到 boxes 末尾, 每个 6 个 float: x1, y1, x2, y2, obj, label, 坐标还原到原图 ((v - pad) / scale)
+// 返回追加的检测数
+int DecodeYoloRows(const float* data, int anchor_num, int anchor_len, float conf_threshold, float scale, float pad_x,
+                   float pad_y, std::vector<float>& boxes);
+// yolov8/v9 输出解码, 输出是转置的 [4 + class_num, anchor_num]: 前 4 行 cx, cy, w, h, 之后每行一个类别, 没有 obj
+// 类别分数按行连续, AVX2 一次比较相邻 8 个 anchor 的同一类别, 最大类别分数 >= conf_threshold 的 anchor 追加到 boxes
+// 格式与 DecodeYoloRows 相同, 第 5 个 float 为类别分数, 返回追加的检测数
+int DecodeYoloColumns(const float* data, int anchor_num, int class_num, float conf_threshold, float scale, float pad_x,
+                      float pad_y, std::vector<float>& boxes);
+// 选出第 col 列 >= threshold 的行 (如 obj 过滤), 行号追加到 selected, 返回追加的行数
+// 每行 row_len 个 float, AVX2 一次 gather 8 行比较
+int SelectRows(const float* data, int rows, int row_len, int col, float threshold, std::vector<int>& selected);
+// dst[i] = exp(src[i]), AVX2/NEON 使用多项式近似 (相对误差约 2e-7), 其它平台使用 std::exp
+void ExpArray(const float* src, int n, float* dst);
+}  // namespace cv_infer
@@ -0,0 +1,154 @@
+#include "engine/mock_infer.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "engine/onnx_io.h"
+
+namespace cv_infer::mock
+{
+namespace
+{
+std::size_t GetTensorLen(const TensorDesc& desc)
+{
+    std::size_t len = 1;
+    // batch 维度不计入, 动态维度按 1 处理
+    for (std::size_t i = 1; i < desc.dims.size(); ++i)
+    {
+        len *= static_cast<std::size_t>(std::max<std::int64_t>(desc.dims[i], 1));
+    }
+    return len;
+}
+}  // namespace
+
+bool MockEngine::LoadModel(const std::string& model, bool device_preprocess)
+{
+    if (device_preprocess)
+    {
+        LOGW("MockEngine not support device preprocess, ignore it");
+    }
+    if (InputDescs.empty() or OutputDescs.empty())
+    {
+        if (not ReadOnnxIO(model, InputDescs, OutputDescs))
+        {
+            LOGE("no inputs / outputs set and read from model [%s] failed", model.c_str());
+            return false;
+        }
+    }
+
+    InputsLen.clear();
+    for (const auto& input : InputDescs)
+    {
+        InputsLen.push_back(GetTensorLen(input));
+    }
+
+    Random.seed(Seed);
+    std::uniform_real_distribution<float> dist(OutputLow, OutputHigh);
+    OutputsVal.clear();
+    for (int i = 0; i < OutputDescs.size(); ++i)
+    {
+        auto& values = OutputsVal.emplace_back(GetTensorLen(OutputDescs[i]));
+        if (FixedOutputs.empty())
+        {
+            std::generate(values.begin(), values.end(), [&]() { return dist(Random); });
+            continue;
+        }
+        if (i >= FixedOutputs.size() or FixedOutputs[i].size() != values.size())
+        {
+            LOGE("output values of [%s] not match, expect [%d] floats", OutputDescs[i].name.c_str(), values.size());
+            return false;
+        }
+        values = FixedOutputs[i];
+    }
+
+    Slots.assign(MaxConcurrency, Slot{});
+    FreeSlots.clear();
+    for (int i = 0; i < MaxConcurrency; ++i)
+    {
+        FreeSlots.push_back(i);
+    }
+    LOGI("MockEngine loaded, inputs = [%d], outputs = [%d], latency = [%lld + %lld * n ± %lld] us, concurrency = [%d]",
+         InputDescs.size(), OutputDescs.size(), (long long)FixedLatency.count(), (long long)PerItemLatency.count(),
+         (long long)Jitter.count(), MaxConcurrency);
+    return true;
+}
+
+int MockEngine::AcquireSlot()
+{
+    std::unique_lock<std::mutex> lock(Mutex);
+    SlotCond.wait(lock, [this]() { return not FreeSlots.empty(); });
+    auto slot = FreeSlots.back();
+    FreeSlots.pop_back();
+    PeakConcurrency = std::max(PeakConcurrency.load(), static_cast<int>(Slots.size() - FreeSlots.size()));
+    return slot;
+}
+
+void MockEngine::ReleaseSlot(int slot)
+{
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        FreeSlots.push_back(slot);
+    }
+    SlotCond.notify_one();
+}
+
+std::chrono::microseconds MockEngine::GetLatency(int batch_size)
+{
+    auto latency = FixedLatency + PerItemLatency * batch_size;
+    if (Jitter.count() > 0)
+    {
+        std::lock_guard<std::mutex>                  lock(Mutex);
+        std::uniform_int_distribution<std::int64_t> dist(-Jitter.count(), Jitter.count());
+        latency += std::chrono::microseconds(dist(Random));
+    }
+    return std::max(latency, std::chrono::microseconds(0));
+}
+
+Detections MockEngine::Forwards(const std::vector<cv::Mat>& input_signals)
+{
+    const auto num_inputs = InputDescs.size();
+    if (input_signals.empty() or input_signals.size() % num_inputs != 0)
+    {
+        LOGE("Input signals size not match, expect n * [%d], but got [%d]", num_inputs, input_signals.size());
+        return {};
+    }
+    const int batch_size = input_signals.size() / num_inputs;
+
+    // 与真实引擎一样, 先拿复用的输出 buffer, 同时执行的请求数不超过 MaxInFlight
+    auto outputs = AcquireOutputs();
+
+    auto  slot_index = AcquireSlot();
+    auto& slot       = Slots[slot_index];
+
+    // 预处理按真实的输入长度准备 buffer, 保证预处理的开销与真实引擎一致
+    slot.InputValues.resize(num_inputs);
+    slot.InputBuffers.resize(num_inputs);
+    for (int i = 0; i < num_inputs; ++i)
+    {
+        slot.InputValues[i].resize(InputsLen[i] * batch_size);
+        slot.InputBuffers[i] = slot.InputValues[i].data();
+    }
+    if (not PreProcessFunc(input_signals, slot.InputBuffers))
+    {
+        LOGE("PreProcess failed");
+        ReleaseSlot(slot_index);
+        return {};
+    }
+
+    std::this_thread::sleep_for(GetLatency(batch_size));
+    ReleaseSlot(slot_index);
+
+    outputs->resize(OutputsVal.size());
+    for (int i = 0; i < OutputsVal.size(); ++i)
+    {
+        auto& output = (*outputs)[i];
+        output.resize(OutputsVal[i].size() * batch_size);
+        for (int b = 0; b < batch_size; ++b)
+        {
+            std::copy(OutputsVal[i].begin(), OutputsVal[i].end(), output.begin() + b * OutputsVal[i].size());
+        }
+    }
+    ++ForwardNum;
+    return PostProcessFunc(input_signals, *outputs);
+}
+}  // namespace cv_infer::mock
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "engine/engine_base.h"
+#include "tools/logger.h"
+
+namespace cv_infer::mock
+{
+// 模拟推理耗时的引擎, 不需要模型和加速卡, 用于在 CI 机器上测试 pipeline 的排队/调度行为
+// 1. 接口与 trt::TrtEngine 一致, 预处理和后处理照常执行, 只有推理部分换成 sleep
+// 2. 耗时 = fixed + per_item * batch ± jitter, batch = 输入图片数 / 模型输入数
+// 3. 最多 MaxConcurrency 个 Forwards 同时"推理", 其余的排队等待, 类似多个 execution context
+//    (MaxInFlight 是调用方同时提交的请求数, MaxConcurrency 是"设备"同时执行的请求数)
+// 4. 输出形状来自 SetOutputs 或 onnx 文件, 内容是固定种子的随机数或 SetOutputValues 指定的值, 后处理可以原样运行
+class MockEngine : public EngineBase
+{
+public:
+    ~MockEngine() override { StopSubmit(); }
+
+    virtual bool       LoadModel(const std::string& model, bool device_preprocess = false) override;
+    virtual Detections Forwards(const std::vector<cv::Mat>& input_signals) override;
+
+    // 以下接口需要在 LoadModel 之前调用
+    // 手动指定输入输出形状, 设置后 LoadModel 不再读取模型文件, -1 的维度按 1 处理
+    void SetInputs(const std::vector<TensorDesc>& inputs) { InputDescs = inputs; }
+    void SetOutputs(const std::vector<TensorDesc>& outputs) { OutputDescs = outputs; }
+    void SetLatency(std::chrono::microseconds fixed, std::chrono::microseconds per_item = {},
+                    std::chrono::microseconds jitter = {})
+    {
+        FixedLatency   = fixed;
+        PerItemLatency = per_item;
+        Jitter         = jitter;
+    }
+    void SetMaxConcurrency(int num) { MaxConcurrency = std::max(1, num); }
+    // 输出值在 [low, high) 内均匀分布
+    void SetOutputRange(float low, float high)
+    {
+        OutputLow  = low;
+        OutputHigh = high;
+    }
+    void SetSeed(std::uint32_t seed) { Seed = seed; }
+    // 指定单张图片的输出内容, 每个输出一个 vector, 长度与输出形状一致 (不含 batch), 设置后不再生成随机数
+    void SetOutputValues(const std::vector<std::vector<float>>& values) { FixedOutputs = values; }
+
+    std::uint64_t GetForwardNum() const { return ForwardNum.load(); }
+
+    // 同时"推理"的请求数的最大值, 不会超过 MaxConcurrency, 也不会超过 MaxInFlight
+    int GetPeakConcurrency() const { return PeakConcurrency.load(); }
+
+private:
+    // 每个 slot 相当于一个 execution context, 持有自己的输入 buffer
+    struct Slot
+    {
+        std::vector<std::vector<float>> InputValues;
+        std::vector<float*>             InputBuffers;
+    };
+
+    int  AcquireSlot();
+    void ReleaseSlot(int slot);
+
+    std::chrono::microseconds GetLatency(int batch_size);
+
+    std::vector<std::size_t>        InputsLen;   // 单张图片的输入长度
+    std::vector<std::vector<float>> OutputsVal;    // 单张图片的输出内容, LoadModel 时生成
+    std::vector<std::vector<float>> FixedOutputs;  // SetOutputValues 指定的输出内容
+
+    std::chrono::microseconds FixedLatency{0};
+    std::chrono::microseconds PerItemLatency{0};
+    std::chrono::microseconds Jitter{0};
+    int                       MaxConcurrency{1};
+    float                     OutputLow{0.0f};
+    float                     OutputHigh{1.0f};
+    std::uint32_t             Seed{0};
+
+    std::mutex                 Mutex;
+    std::condition_variable    SlotCond;
+    std::vector<Slot>          Slots;
+    std::vector<int>           FreeSlots;
+    std::mt19937               Random;
+    std::atomic<std::uint64_t> ForwardNum{0};
+    std::atomic<int>           PeakConcurrency{0};
+};
+}  // namespace cv_infer::mock
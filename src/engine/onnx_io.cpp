@@ -0,0 +1,393 @@
+#include "engine/onnx_io.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string_view>
+#include <unordered_set>
+
+#include "tools/logger.h"
+
+namespace cv_infer
+{
+namespace
+{
+// minimal protobuf wire format reader, only what the onnx ModelProto needs
+class PbReader
+{
+public:
+    explicit PbReader(std::string_view data) : Data(data) {}
+
+    bool Done() const { return Pos >= Data.size(); }
+
+    bool ReadVarint(std::uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 and Pos < Data.size(); shift += 7)
+        {
+            auto byte = static_cast<std::uint8_t>(Data[Pos++]);
+            value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // field number and wire type of the next field
+    bool ReadTag(std::uint32_t& field, std::uint32_t& wire)
+    {
+        std::uint64_t key = 0;
+        if (not ReadVarint(key))
+        {
+            return false;
+        }
+        field = static_cast<std::uint32_t>(key >> 3);
+        wire  = static_cast<std::uint32_t>(key & 0x7);
+        return true;
+    }
+
+    bool ReadBytes(std::string_view& bytes)
+    {
+        std::uint64_t len = 0;
+        if (not ReadVarint(len) or len > Data.size() - Pos)
+        {
+            return false;
+        }
+        bytes = Data.substr(Pos, len);
+        Pos += len;
+        return true;
+    }
+
+    bool Skip(std::uint32_t wire)
+    {
+        std::uint64_t    value = 0;
+        std::string_view bytes;
+        switch (wire)
+        {
+            case 0:
+                return ReadVarint(value);
+            case 1:
+                return Advance(8);
+            case 2:
+                return ReadBytes(bytes);
+            case 5:
+                return Advance(4);
+            default:
+                return false;  // groups are not used by onnx
+        }
+    }
+
+private:
+    bool Advance(std::size_t n)
+    {
+        if (n > Data.size() - Pos)
+        {
+            return false;
+        }
+        Pos += n;
+        return true;
+    }
+
+    std::string_view Data;
+    std::size_t      Pos = 0;
+};
+
+DataType ToDataType(std::uint64_t elem_type)
+{
+    // onnx TensorProto.DataType
+    switch (elem_type)
+    {
+        case 1:
+            return DataType::FLOAT32;
+        case 2:
+            return DataType::UINT8;
+        case 3:
+            return DataType::INT8;
+        case 6:
+            return DataType::INT32;
+        case 7:
+            return DataType::INT64;
+        case 10:
+            return DataType::FLOAT16;
+        default:
+            return DataType::UNKNOWN;
+    }
+}
+
+// TensorShapeProto.Dimension: dim_value = 1, dim_param = 2
+bool ParseDim(std::string_view data, std::int64_t& dim)
+{
+    PbReader      reader(data);
+    std::uint32_t field = 0, wire = 0;
+    dim = -1;
+    while (not reader.Done())
+    {
+        if (not reader.ReadTag(field, wire))
+        {
+            return false;
+        }
+        std::uint64_t value = 0;
+        if (field == 1 and wire == 0)
+        {
+            if (not reader.ReadVarint(value))
+            {
+                return false;
+            }
+            dim = static_cast<std::int64_t>(value);
+        }
+        else if (not reader.Skip(wire))
+        {
+            return false;
+        }
+    }
+    // 0 is how some exporters write an unknown dimension
+    if (dim == 0)
+    {
+        dim = -1;
+    }
+    return true;
+}
+
+// TypeProto.tensor_type = 1 -> TypeProto.Tensor: elem_type = 1, shape = 2 -> TensorShapeProto: dim = 1
+bool ParseTensorType(std::string_view data, TensorDesc& desc)
+{
+    PbReader      reader(data);
+    std::uint32_t field = 0, wire = 0;
+    while (not reader.Done())
+    {
+        if (not reader.ReadTag(field, wire))
+        {
+            return false;
+        }
+        std::uint64_t    value = 0;
+        std::string_view bytes;
+        if (field == 1 and wire == 0)
+        {
+            if (not reader.ReadVarint(value))
+            {
+                return false;
+            }
+            desc.dtype = ToDataType(value);
+        }
+        else if (field == 2 and wire == 2)
+        {
+            if (not reader.ReadBytes(bytes))
+            {
+                return false;
+            }
+            PbReader shape(bytes);
+            while (not shape.Done())
+            {
+                std::string_view dim_bytes;
+                if (not shape.ReadTag(field, wire))
+                {
+                    return false;
+                }
+                if (field != 1 or wire != 2)
+                {
+                    if (not shape.Skip(wire)) return false;
+                    continue;
+                }
+                std::int64_t dim = -1;
+                if (not shape.ReadBytes(dim_bytes) or not ParseDim(dim_bytes, dim))
+                {
+                    return false;
+                }
+                desc.dims.push_back(dim);
+            }
+        }
+        else if (not reader.Skip(wire))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ValueInfoProto: name = 1, type = 2 -> TypeProto
+bool ParseValueInfo(std::string_view data, TensorDesc& desc)
+{
+    PbReader      reader(data);
+    std::uint32_t field = 0, wire = 0;
+    while (not reader.Done())
+    {
+        if (not reader.ReadTag(field, wire))
+        {
+            return false;
+        }
+        std::string_view bytes;
+        if (wire == 2 and (field == 1 or field == 2))
+        {
+            if (not reader.ReadBytes(bytes))
+            {
+                return false;
+            }
+            if (field == 1)
+            {
+                desc.name = std::string(bytes);
+                continue;
+            }
+            PbReader      type(bytes);
+            std::uint32_t type_field = 0, type_wire = 0;
+            while (not type.Done())
+            {
+                std::string_view tensor;
+                if (not type.ReadTag(type_field, type_wire))
+                {
+                    return false;
+                }
+                if (type_field == 1 and type_wire == 2)
+                {
+                    if (not type.ReadBytes(tensor) or not ParseTensorType(tensor, desc))
+                    {
+                        return false;
+                    }
+                }
+                else if (not type.Skip(type_wire))
+                {
+                    return false;
+                }
+            }
+        }
+        else if (not reader.Skip(wire))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// TensorProto.name = 8
+bool ParseInitializerName(std::string_view data, std::string& name)
+{
+    PbReader      reader(data);
+    std::uint32_t field = 0, wire = 0;
+    while (not reader.Done())
+    {
+        if (not reader.ReadTag(field, wire))
+        {
+            return false;
+        }
+        std::string_view bytes;
+        if (field == 8 and wire == 2)
+        {
+            if (not reader.ReadBytes(bytes))
+            {
+                return false;
+            }
+            name = std::string(bytes);
+            return true;
+        }
+        if (not reader.Skip(wire))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+}  // namespace
+
+bool ParseOnnxIO(const std::string& bytes, std::vector<TensorDesc>& inputs, std::vector<TensorDesc>& outputs)
+{
+    inputs.clear();
+    outputs.clear();
+    // ModelProto.graph = 7
+    PbReader         model(bytes);
+    std::string_view graph_bytes;
+    std::uint32_t    field = 0, wire = 0;
+    while (not model.Done())
+    {
+        if (not model.ReadTag(field, wire))
+        {
+            return false;
+        }
+        if (field == 7 and wire == 2)
+        {
+            if (not model.ReadBytes(graph_bytes))
+            {
+                return false;
+            }
+        }
+        else if (not model.Skip(wire))
+        {
+            return false;
+        }
+    }
+    if (graph_bytes.empty())
+    {
+        return false;
+    }
+
+    // GraphProto: initializer = 5, input = 11, output = 12
+    std::unordered_set<std::string> initializers;
+    PbReader                        graph(graph_bytes);
+    while (not graph.Done())
+    {
+        if (not graph.ReadTag(field, wire))
+        {
+            return false;
+        }
+        std::string_view item;
+        if (wire != 2 or (field != 5 and field != 11 and field != 12))
+        {
+            if (not graph.Skip(wire)) return false;
+            continue;
+        }
+        if (not graph.ReadBytes(item))
+        {
+            return false;
+        }
+        if (field == 5)
+        {
+            std::string name;
+            if (not ParseInitializerName(item, name))
+            {
+                return false;
+            }
+            initializers.insert(name);
+            continue;
+        }
+        TensorDesc desc;
+        if (not ParseValueInfo(item, desc))
+        {
+            return false;
+        }
+        (field == 11 ? inputs : outputs).push_back(std::move(desc));
+    }
+    std::erase_if(inputs, [&](const TensorDesc& desc) { return initializers.count(desc.name) > 0; });
+    // onnx 没有记录 layout, 视觉模型的 4 维输入按 NCHW 处理
+    for (auto& input : inputs)
+    {
+        if (input.dims.size() == 4)
+        {
+            input.layout = TensorLayout::NCHW;
+        }
+    }
+    return not inputs.empty() and not outputs.empty();
+}
+
+bool ReadOnnxIO(const std::string& path, std::vector<TensorDesc>& inputs, std::vector<TensorDesc>& outputs)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (not file)
+    {
+        LOGE("can't open onnx [%s]", path.c_str());
+        return false;
+    }
+    std::string bytes(static_cast<std::size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    if (not file.read(bytes.data(), static_cast<std::streamsize>(bytes.size())))
+    {
+        LOGE("read onnx [%s] failed", path.c_str());
+        return false;
+    }
+    if (not ParseOnnxIO(bytes, inputs, outputs))
+    {
+        LOGE("parse inputs / outputs of onnx [%s] failed", path.c_str());
+        return false;
+    }
+    return true;
+}
+}  // namespace cv_infer
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "engine/engine_base.h"
+
+namespace cv_infer
+{
+// 只解析 onnx 文件中 graph 的 input/output 描述, 不依赖 protobuf 库
+// 1. 旧版本导出的模型会把权重也列在 input 中, 这些 initializer 会被去掉
+// 2. 符号维度 (dim_param) 和未知维度记为 -1
+bool ReadOnnxIO(const std::string& path, std::vector<TensorDesc>& inputs, std::vector<TensorDesc>& outputs);
+bool ParseOnnxIO(const std::string& bytes, std::vector<TensorDesc>& inputs, std::vector<TensorDesc>& outputs);
+}  // namespace cv_infer
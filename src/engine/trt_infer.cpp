@@ -14,6 +14,38 @@
 
 namespace cv_infer::trt
 {
+namespace
+{
+TensorDesc ToTensorDesc(const char* name, const nvinfer1::Dims& dims, nvinfer1::DataType type)
+{
+    TensorDesc desc;
+    desc.name = name;
+    desc.dims.assign(dims.d, dims.d + dims.nbDims);
+    switch (type)
+    {
+        case nvinfer1::DataType::kFLOAT:
+            desc.dtype = DataType::FLOAT32;
+            break;
+        case nvinfer1::DataType::kHALF:
+            desc.dtype = DataType::FLOAT16;
+            break;
+        case nvinfer1::DataType::kINT8:
+            desc.dtype = DataType::INT8;
+            break;
+        case nvinfer1::DataType::kUINT8:
+            desc.dtype = DataType::UINT8;
+            break;
+        case nvinfer1::DataType::kINT32:
+            desc.dtype = DataType::INT32;
+            break;
+        default:
+            desc.dtype = DataType::UNKNOWN;
+            break;
+    }
+    return desc;
+}
+}  // namespace
+
 bool TrtEngine::LoadModel(const std::string& model, bool device_preprocess)
 {
     if (device_preprocess)
@@ -219,6 +251,8 @@ bool TrtEngine::LoadEngine(const std::string& engine, bool device_preprocess)
             CheckCudaErrorCode(cudaMallocAsync(&Buffers[i], input_size, stream));
             InputDims.emplace_back(dims);
             InputNames.push_back(tensor_name);
+            InputDescs.push_back(ToTensorDesc(tensor_name, dims, TrtEngine->getTensorDataType(tensor_name)));
+            InputDescs.back().layout = dims.nbDims == 4 ? TensorLayout::NCHW : TensorLayout::UNKNOWN;
             if (device_preprocess)
             {
                 PreProcessBuffers.push_back((float*)(Buffers[i]));
@@ -242,6 +276,7 @@ bool TrtEngine::LoadEngine(const std::string& engine, bool device_preprocess)
             OutputsLen.push_back(output_float);
             CheckCudaErrorCode(cudaMallocAsync(&Buffers[i], output_float * MaxBatchSize * sizeof(float), stream));
             OutputNames.push_back(tensor_name);
+            OutputDescs.push_back(ToTensorDesc(tensor_name, dims, TrtEngine->getTensorDataType(tensor_name)));
         }
         else
         {
@@ -249,8 +284,6 @@ bool TrtEngine::LoadEngine(const std::string& engine, bool device_preprocess)
         }
     }
 
-    Outputs.resize(OutputsLen.size());
-
     CheckCudaErrorCode(cudaStreamSynchronize(stream));
     CheckCudaErrorCode(cudaStreamDestroy(stream));
 
@@ -281,7 +314,7 @@ std::string TrtEngine::GetEngineName(const std::string& onnx_file, std::uint8_t
     return prefix + "." + batch + "." + preci + suffix;
 }
 
-std::vector<std::vector<float>> TrtEngine::Forwards(const std::vector<cv::Mat>& input_signals)
+Detections TrtEngine::Forwards(const std::vector<cv::Mat>& input_signals)
 {
     const auto num_inputs = InputDims.size();
     if (input_signals.size() != num_inputs)
@@ -290,7 +323,11 @@ std::vector<std::vector<float>> TrtEngine::Forwards(const std::vector<cv::Mat>&
         return {};
     }
 
+    // 输出直接从 gpu 拷贝到复用的输出 buffer 中, 后处理期间不会被下一个请求覆盖
+    auto outputs = AcquireOutputs();
+
     // auto batch_size = static_cast<std::int32_t>()
+    std::unique_lock<std::mutex> lock(ForwardMutex);
     CostTimerPre.StartTimer();
     if (not PreProcessFunc(input_signals, PreProcessBuffers))
     {
@@ -360,24 +397,24 @@ std::vector<std::vector<float>> TrtEngine::Forwards(const std::vector<cv::Mat>&
     }
 
     // copy output from gpu memory to cpu memory
-    for (int i = 0; i < Outputs.size(); ++i)
+    outputs->resize(OutputsLen.size());
+    for (int i = 0; i < OutputsLen.size(); ++i)
     {
         auto batch_size = 1;  // TODO: dynamic batch size
 
-        auto size = OutputsLen[i] * batch_size * sizeof(float);
-        Outputs[i].resize(size);
-        CheckCudaErrorCode(
-            cudaMemcpyAsync(Outputs[i].data(), Buffers[num_inputs + i], size, cudaMemcpyDeviceToHost, stream));
+        auto& output = (*outputs)[i];
+        output.resize(OutputsLen[i] * batch_size);
+        CheckCudaErrorCode(cudaMemcpyAsync(output.data(), Buffers[num_inputs + i], output.size() * sizeof(float),
+                                           cudaMemcpyDeviceToHost, stream));
     }
 
     // Synchronize the cuda stream
     CheckCudaErrorCode(cudaStreamSynchronize(stream));
     CheckCudaErrorCode(cudaStreamDestroy(stream));
 
-    CostTimerPost.StartTimer();
-    auto ret = PostProcessFunc(Outputs);
-    CostTimerPost.EndTimer("Postprocess");
-    return ret;
+    // 后处理不需要持有锁, 可以与下一个请求的推理重叠
+    lock.unlock();
+    return PostProcessFunc(input_signals, *outputs);
 }
 
 void TrtEngine::CheckCudaErrorCode(cudaError_t code)
@@ -4,6 +4,7 @@
 #include <NvInferRuntimeBase.h>
 #include <NvOnnxParser.h>
 
+#include <mutex>
 #include <vector>
 
 #include "engine/engine_base.h"
@@ -51,26 +52,13 @@ class NvInferLoggerC : public nvinfer1::ILogger
 class TrtEngine : public EngineBase
 {
 public:
-    virtual bool LoadModel(const std::string& model, bool device_preprocess = false) override;
+    ~TrtEngine() override { StopSubmit(); }
 
-    std::vector<std::vector<float>> Forwards(const std::vector<cv::Mat>& input_signals);
+    virtual bool       LoadModel(const std::string& model, bool device_preprocess = false) override;
+    virtual Detections Forwards(const std::vector<cv::Mat>& input_signals) override;
 
-    bool RegisterPreProcessFunc(
-        std::function<bool(const std::vector<cv::Mat>& inputs_batch, std::vector<float*>& oupputs)> func)
-    {
-        PreProcessFunc = func;
-        return true;
-    }
-
-    bool RegisterPostProcessFunc(
-        std::function<std::vector<std::vector<float>>(std::vector<std::vector<float>>& oupputs)> func)
-    {
-        PostProcessFunc = func;
-        return true;
-    }
-
-    void EnableDevicePreProcess() { DevicePreProcess = true; }
-    bool IsDevicePreProcess() const { return DevicePreProcess; }
+    virtual void EnableDevicePreProcess() override { DevicePreProcess = true; }
+    virtual bool IsDevicePreProcess() const override { return DevicePreProcess; }
 
 protected:
     bool        LoadEngine(const std::string& engine, bool device_preprocess = false);
@@ -94,18 +82,15 @@ private:
     std::vector<std::uint32_t>                   OutputsLen;         // hold the output size
     std::vector<float*>                          PreProcessBuffers;  // hold the pre-process buffer [cpu]
 
-    std::vector<nvinfer1::Dims>     InputDims;
-    std::vector<std::vector<float>> Outputs;
-    std::vector<std::string>        InputNames;
-    std::vector<std::string>        OutputNames;
+    std::vector<nvinfer1::Dims> InputDims;
+    std::vector<std::string>    InputNames;
+    std::vector<std::string>    OutputNames;
 
-    std::function<bool(const std::vector<cv::Mat>& inputs_batch, std::vector<float*>& oupputs)> PreProcessFunc;
-    std::function<std::vector<std::vector<float>>(std::vector<std::vector<float>>& oupputs)>    PostProcessFunc;
+    std::mutex ForwardMutex;  // 只有一个 execution context, 推理部分串行执行
 
     bool DynamicBatch{false};
     bool DevicePreProcess{false};
 
     Timer CostTimerPre{"TrtEnginePreProcess"};
-    Timer CostTimerPost{"TrtEnginePostProcess"};
 };
 }  // namespace cv_infer::trt
\ No newline at end of file
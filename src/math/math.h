@@ -1,7 +0,0 @@
-#pragma once
-
-namespace cv_infer
-{
-void ConverHWC2CHWMeanStd(const unsigned char* src, int h, int w, int c, const float* mean, const float* scale,
-                          float* dst);
-}  // namespace cv_infer
\ No newline at end of file
@@ -0,0 +1,458 @@
+#include "nms.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CVINFER_NMS_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CVINFER_NMS_NEON
+#endif
+
+namespace cv_infer
+{
+namespace
+{
+// SoA 的框, 长度补齐到 8 的倍数
+// 补齐的框坐标和面积都是 0, 和任何框的交集为 0, 不会被判定为重叠
+struct BoxArray
+{
+    std::vector<int>   index;  // 补齐的框为 -1
+    std::vector<float> x1;
+    std::vector<float> y1;
+    std::vector<float> x2;
+    std::vector<float> y2;
+    std::vector<float> area;
+
+    void Resize(int n)
+    {
+        n = (n + 7) / 8 * 8;
+        index.assign(n, -1);
+        x1.assign(n, 0.0f);
+        y1.assign(n, 0.0f);
+        x2.assign(n, 0.0f);
+        y2.assign(n, 0.0f);
+        area.assign(n, 0.0f);
+    }
+
+    void Set(int i, int k, const BoxArray& src, int j)
+    {
+        index[i] = k;
+        x1[i]    = src.x1[j];
+        y1[i]    = src.y1[j];
+        x2[i]    = src.x2[j];
+        y2[i]    = src.y2[j];
+        area[i]  = src.area[j];
+    }
+
+    int Size() const { return static_cast<int>(area.size()); }
+};
+
+// 按分数从高到低排序, index 记录在输入中的下标, 返回有效的框数
+int SortBoxes(const NmsBoxes& boxes, const NmsParam& param, std::vector<std::uint64_t>& keys, BoxArray& sorted)
+{
+    // 分数映射成保序的无符号整数, 和下标拼成 64 位 key, 升序排序即分数从高到低, 分数相同时按下标, 结果确定
+    keys.resize(boxes.Size());
+    for (int i = 0; i < boxes.Size(); i++)
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &boxes.score[i], sizeof(bits));
+        bits    = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+        keys[i] = (static_cast<std::uint64_t>(~bits) << 32) | static_cast<std::uint32_t>(i);
+    }
+    if (param.max_candidates > 0 and param.max_candidates < (int)keys.size())
+    {
+        std::partial_sort(keys.begin(), keys.begin() + param.max_candidates, keys.end());
+        keys.resize(param.max_candidates);
+    }
+    else
+    {
+        std::sort(keys.begin(), keys.end());
+    }
+
+    // 不同类别的框在 x 方向平移到互不相交的区间, 跨类别的交集恒为 0
+    float span = 0.0f;
+    if (param.class_aware)
+    {
+        auto [min_x1, max_x1] = std::minmax_element(boxes.x1.begin(), boxes.x1.end());
+        auto [min_x2, max_x2] = std::minmax_element(boxes.x2.begin(), boxes.x2.end());
+        span = std::max(*max_x1, *max_x2) - std::min(*min_x1, *min_x2) + 1.0f;
+    }
+
+    const int n = static_cast<int>(keys.size());
+    sorted.Resize(n);
+    for (int i = 0; i < n; i++)
+    {
+        const int   k      = static_cast<std::uint32_t>(keys[i]);
+        const float offset = span * boxes.label[k];
+        sorted.index[i]    = k;
+        sorted.x1[i]       = boxes.x1[k] + offset;
+        sorted.y1[i]       = boxes.y1[k];
+        sorted.x2[i]       = boxes.x2[k] + offset;
+        sorted.y2[i]       = boxes.y2[k];
+        // 面积用平移前的坐标计算, 避免大偏移带来的舍入误差
+        sorted.area[i] = (boxes.x2[k] - boxes.x1[k]) * (boxes.y2[k] - boxes.y1[k]);
+    }
+    return n;
+}
+
+// target = {x1, y1, x2, y2, area}, 和 boxes 的 [begin, end) 比较 (8 的倍数)
+// IoU > threshold 的位或到 mask[(j - begin) / 8], 已经是 0xFF 的字节跳过
+// IoU > threshold 等价于 inter > threshold * (area_a + area_b - inter), 不需要除法
+using OverlapFunc = void (*)(const float* target, const BoxArray& boxes, int begin, int end, float iou_threshold,
+                             std::uint8_t* mask);
+
+void OverlapScalar(const float* target, const BoxArray& boxes, int begin, int end, float iou_threshold,
+                   std::uint8_t* mask)
+{
+    // 先存到局部变量, 避免 uint8_t* 的别名阻止编译器向量化
+    const float tx1 = target[0], ty1 = target[1], tx2 = target[2], ty2 = target[3], tarea = target[4];
+    const float *x1 = boxes.x1.data(), *y1 = boxes.y1.data(), *x2 = boxes.x2.data(), *y2 = boxes.y2.data();
+    const float *area = boxes.area.data();
+    for (int j = begin; j < end; j += 8, mask++)
+    {
+        if (*mask == 0xFF)
+        {
+            continue;
+        }
+        unsigned bits = 0;
+        for (int k = j; k < j + 8; k++)
+        {
+            float w     = std::min(tx2, x2[k]) - std::max(tx1, x1[k]);
+            float h     = std::min(ty2, y2[k]) - std::max(ty1, y1[k]);
+            float inter = std::max(w, 0.0f) * std::max(h, 0.0f);
+            bits |= (unsigned)(inter > iou_threshold * (tarea + area[k] - inter)) << (k - j);
+        }
+        *mask |= static_cast<std::uint8_t>(bits);
+    }
+}
+
+#if defined(CVINFER_NMS_X86)
+__attribute__((target("avx2,fma"))) void OverlapAvx2(const float* target, const BoxArray& boxes, int begin, int end,
+                                                      float iou_threshold, std::uint8_t* mask)
+{
+    const __m256 zero  = _mm256_setzero_ps();
+    const __m256 thr   = _mm256_set1_ps(iou_threshold);
+    const __m256 tx1   = _mm256_set1_ps(target[0]);
+    const __m256 ty1   = _mm256_set1_ps(target[1]);
+    const __m256 tx2   = _mm256_set1_ps(target[2]);
+    const __m256 ty2   = _mm256_set1_ps(target[3]);
+    const __m256 tarea = _mm256_set1_ps(target[4]);
+    for (int j = begin; j < end; j += 8, mask++)
+    {
+        if (*mask == 0xFF)
+        {
+            continue;
+        }
+        __m256 w     = _mm256_sub_ps(_mm256_min_ps(tx2, _mm256_loadu_ps(boxes.x2.data() + j)),
+                                     _mm256_max_ps(tx1, _mm256_loadu_ps(boxes.x1.data() + j)));
+        __m256 h     = _mm256_sub_ps(_mm256_min_ps(ty2, _mm256_loadu_ps(boxes.y2.data() + j)),
+                                     _mm256_max_ps(ty1, _mm256_loadu_ps(boxes.y1.data() + j)));
+        __m256 inter = _mm256_mul_ps(_mm256_max_ps(w, zero), _mm256_max_ps(h, zero));
+        __m256 uni   = _mm256_sub_ps(_mm256_add_ps(tarea, _mm256_loadu_ps(boxes.area.data() + j)), inter);
+        __m256 cmp   = _mm256_cmp_ps(inter, _mm256_mul_ps(thr, uni), _CMP_GT_OQ);
+        *mask |= static_cast<std::uint8_t>(_mm256_movemask_ps(cmp));
+    }
+}
+#endif
+
+#if defined(CVINFER_NMS_NEON)
+void OverlapNeon(const float* target, const BoxArray& boxes, int begin, int end, float iou_threshold,
+                 std::uint8_t* mask)
+{
+    const float32x4_t zero  = vdupq_n_f32(0.0f);
+    const float32x4_t thr   = vdupq_n_f32(iou_threshold);
+    const float32x4_t tx1   = vdupq_n_f32(target[0]);
+    const float32x4_t ty1   = vdupq_n_f32(target[1]);
+    const float32x4_t tx2   = vdupq_n_f32(target[2]);
+    const float32x4_t ty2   = vdupq_n_f32(target[3]);
+    const float32x4_t tarea = vdupq_n_f32(target[4]);
+    const uint32_t    bits[4]{1, 2, 4, 8};
+    const uint32x4_t  weight = vld1q_u32(bits);
+
+    auto mask4 = [&](int j)
+    {
+        float32x4_t w     = vsubq_f32(vminq_f32(tx2, vld1q_f32(boxes.x2.data() + j)),
+                                      vmaxq_f32(tx1, vld1q_f32(boxes.x1.data() + j)));
+        float32x4_t h     = vsubq_f32(vminq_f32(ty2, vld1q_f32(boxes.y2.data() + j)),
+                                      vmaxq_f32(ty1, vld1q_f32(boxes.y1.data() + j)));
+        float32x4_t inter = vmulq_f32(vmaxq_f32(w, zero), vmaxq_f32(h, zero));
+        float32x4_t uni   = vsubq_f32(vaddq_f32(tarea, vld1q_f32(boxes.area.data() + j)), inter);
+        uint32x4_t  cmp   = vandq_u32(vcgtq_f32(inter, vmulq_f32(thr, uni)), weight);
+        uint32x2_t  sum   = vpadd_u32(vget_low_u32(cmp), vget_high_u32(cmp));
+        return vget_lane_u32(vpadd_u32(sum, sum), 0);
+    };
+    for (int j = begin; j < end; j += 8, mask++)
+    {
+        if (*mask == 0xFF)
+        {
+            continue;
+        }
+        *mask |= static_cast<std::uint8_t>(mask4(j) | (mask4(j + 4) << 4));
+    }
+}
+#endif
+
+OverlapFunc GetOverlapFunc()
+{
+    static const OverlapFunc func = []() -> OverlapFunc
+    {
+#if defined(CVINFER_NMS_X86)
+        if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma"))
+        {
+            return OverlapAvx2;
+        }
+#elif defined(CVINFER_NMS_NEON)
+        return OverlapNeon;
+#endif
+        return OverlapScalar;
+    }();
+    return func;
+}
+
+// 均匀网格, 每个框复制到它覆盖的所有格子中, 格子内按分数从高到低, 每个格子补齐到 8 的倍数
+// 两个框相交时交集内的点同时落在两个框覆盖的格子里, 所以只需要和同格子的框比较
+// 覆盖格子过多的大框不登记到格子中, 单独存放, 和所有框比较
+// 成员 buffer 在多次 Build 之间复用
+class NmsGrid
+{
+public:
+    static constexpr int MaxCellsPerBox = 16;
+
+    void Build(const BoxArray& boxes, int n)
+    {
+        Boxes = &boxes;
+        MinX        = *std::min_element(boxes.x1.begin(), boxes.x1.begin() + n);
+        MinY        = *std::min_element(boxes.y1.begin(), boxes.y1.begin() + n);
+        float max_x = *std::max_element(boxes.x2.begin(), boxes.x2.begin() + n);
+        float max_y = *std::max_element(boxes.y2.begin(), boxes.y2.begin() + n);
+
+        // 格子边长取平均框大小, 格子总数不超过 n
+        double sum_w = 0;
+        double sum_h = 0;
+        for (int i = 0; i < n; i++)
+        {
+            sum_w += std::max(boxes.x2[i] - boxes.x1[i], 0.0f);
+            sum_h += std::max(boxes.y2[i] - boxes.y1[i], 0.0f);
+        }
+        CellW           = std::max((float)(sum_w / n), 1e-3f);
+        CellH           = std::max((float)(sum_h / n), 1e-3f);
+        double extent_w = std::max(max_x - MinX, 0.0f) / CellW + 1;
+        double extent_h = std::max(max_y - MinY, 0.0f) / CellH + 1;
+        if (extent_w * extent_h > n)
+        {
+            float factor = (float)std::sqrt(extent_w * extent_h / n);
+            CellW *= factor;
+            CellH *= factor;
+        }
+        CellsX = std::max((int)std::ceil((max_x - MinX) / CellW), 1);
+        CellsY = std::max((int)std::ceil((max_y - MinY) / CellH), 1);
+
+        // 1. 统计每个格子的框数, 覆盖格子过多的是大框
+        Ranges.resize(n);
+        LargeIndex.clear();
+        CellStart.assign(CellsX * CellsY + 1, 0);
+        CellCount.assign(CellsX * CellsY, 0);
+        for (int i = 0; i < n; i++)
+        {
+            Ranges[i] = CellRange(i);
+            if (not ForEachCell(i, [&](int cell) { CellCount[cell]++; }))
+            {
+                LargeIndex.push_back(i);
+            }
+        }
+        for (int c = 0; c < CellsX * CellsY; c++)
+        {
+            CellStart[c + 1] = CellStart[c] + (CellCount[c] + 7) / 8 * 8;
+        }
+        // 2. 按分数顺序填充
+        Cells.Resize(CellStart.back());
+        Fill.assign(CellStart.begin(), CellStart.end() - 1);
+        for (int i = 0; i < n; i++)
+        {
+            ForEachCell(i, [&](int cell) { Cells.Set(Fill[cell]++, i, boxes, i); });
+        }
+        Large.Resize(LargeIndex.size());
+        LargeCount = static_cast<int>(LargeIndex.size());
+        for (int k = 0; k < LargeCount; k++)
+        {
+            Large.Set(k, LargeIndex[k], boxes, LargeIndex[k]);
+        }
+        Mask.resize(std::max(Cells.Size(), Large.Size()) / 8);
+    }
+
+    bool IsLarge(int i) const { return Ranges[i].Count() > MaxCellsPerBox; }
+
+    // 第 i 个框 (非大框) 和它之后的框比较
+    void Suppress(OverlapFunc overlap, int i, float iou_threshold, std::vector<std::uint8_t>& removed)
+    {
+        const float target[5]{Boxes->x1[i], Boxes->y1[i], Boxes->x2[i], Boxes->y2[i], Boxes->area[i]};
+        ForEachCell(i,
+                    [&](int cell)
+                    {
+                        Suppress(overlap, target, i, Cells, CellStart[cell], CellStart[cell] + CellCount[cell],
+                                 CellStart[cell + 1], iou_threshold, removed);
+                    });
+        Suppress(overlap, target, i, Large, 0, LargeCount, Large.Size(), iou_threshold, removed);
+    }
+
+private:
+    // boxes 的 [begin, count) 按分数顺序排列, 只比较 i 之后的框, 从 8 对齐的位置开始
+    void Suppress(OverlapFunc overlap, const float* target, int i, const BoxArray& boxes, int begin, int count,
+                  int end, float iou_threshold, std::vector<std::uint8_t>& removed)
+    {
+        const int first = std::upper_bound(boxes.index.begin() + begin, boxes.index.begin() + count, i) -
+                          boxes.index.begin();
+        if (first == count)
+        {
+            return;
+        }
+        const int start = first / 8 * 8;
+        std::fill(Mask.begin(), Mask.begin() + (end - start) / 8, 0);
+        overlap(target, boxes, start, end, iou_threshold, Mask.data());
+        for (int b = 0; b < (end - start) / 8; b++)
+        {
+            for (unsigned bits = Mask[b]; bits != 0; bits &= bits - 1)
+            {
+                const int j = boxes.index[start + b * 8 + __builtin_ctz(bits)];
+                if (j > i)
+                {
+                    removed[j / 8] |= 1 << (j % 8);
+                }
+            }
+        }
+    }
+
+    // 框覆盖的格子范围 [x0, x1] x [y0, y1]
+    struct Range
+    {
+        int x0, y0, x1, y1;
+
+        int Count() const { return (x1 - x0 + 1) * (y1 - y0 + 1); }
+    };
+
+    Range CellRange(int i) const
+    {
+        auto  clamp = [](int v, int hi) { return std::min(std::max(v, 0), hi - 1); };
+        Range range;
+        range.x0 = clamp((int)std::floor((Boxes->x1[i] - MinX) / CellW), CellsX);
+        range.y0 = clamp((int)std::floor((Boxes->y1[i] - MinY) / CellH), CellsY);
+        range.x1 = std::max(clamp((int)std::floor((Boxes->x2[i] - MinX) / CellW), CellsX), range.x0);
+        range.y1 = std::max(clamp((int)std::floor((Boxes->y2[i] - MinY) / CellH), CellsY), range.y0);
+        return range;
+    }
+
+    // 大框返回 false
+    template <typename Func>
+    bool ForEachCell(int i, Func&& func) const
+    {
+        const Range& range = Ranges[i];
+        if (range.Count() > MaxCellsPerBox)
+        {
+            return false;
+        }
+        for (int cy = range.y0; cy <= range.y1; cy++)
+        {
+            for (int cx = range.x0; cx <= range.x1; cx++)
+            {
+                func(cy * CellsX + cx);
+            }
+        }
+        return true;
+    }
+
+    const BoxArray*           Boxes{nullptr};
+    float                     MinX{0.0f};
+    float                     MinY{0.0f};
+    float                     CellW{1.0f};
+    float                     CellH{1.0f};
+    int                       CellsX{1};
+    int                       CellsY{1};
+    std::vector<Range>        Ranges;
+    std::vector<int>          CellStart;
+    std::vector<int>          CellCount;
+    std::vector<int>          Fill;
+    std::vector<int>          LargeIndex;
+    BoxArray                  Cells;
+    BoxArray                  Large;
+    int                       LargeCount{0};
+    std::vector<std::uint8_t> Mask;
+};
+}  // namespace
+
+struct NmsWorkspace::Impl
+{
+    std::vector<std::uint64_t> keys;
+    BoxArray                   sorted;
+    std::vector<std::uint8_t>  removed;
+    NmsGrid                    grid;
+};
+
+NmsWorkspace::NmsWorkspace() : Data(std::make_unique<Impl>()) {}
+
+NmsWorkspace::~NmsWorkspace() = default;
+
+NmsWorkspace::NmsWorkspace(NmsWorkspace&&) noexcept = default;
+
+NmsWorkspace& NmsWorkspace::operator=(NmsWorkspace&&) noexcept = default;
+
+std::vector<int> Nms(const NmsBoxes& boxes, const NmsParam& param)
+{
+    NmsWorkspace     workspace;
+    std::vector<int> keep;
+    Nms(boxes, param, workspace, keep);
+    return keep;
+}
+
+void Nms(const NmsBoxes& boxes, const NmsParam& param, NmsWorkspace& workspace, std::vector<int>& keep)
+{
+    keep.clear();
+    if (boxes.Size() == 0)
+    {
+        return;
+    }
+
+    auto&     sorted  = workspace.Data->sorted;
+    auto&     removed = workspace.Data->removed;
+    const int n       = SortBoxes(boxes, param, workspace.Data->keys, sorted);
+    const int top_k   = param.top_k > 0 ? std::min(param.top_k, n) : n;
+    removed.assign(sorted.Size() / 8, 0);
+
+    // 网格只处理有交集的框, iou_threshold < 0 时不相交的框也会被抑制, 不能使用
+    NmsGrid* grid = nullptr;
+    if (param.grid_min_boxes > 0 and n >= param.grid_min_boxes and param.iou_threshold >= 0.0f)
+    {
+        grid = &workspace.Data->grid;
+        grid->Build(sorted, n);
+    }
+
+    const OverlapFunc overlap = GetOverlapFunc();
+    keep.reserve(top_k);
+    for (int i = 0; i < n and (int)keep.size() < top_k; i++)
+    {
+        if ((removed[i / 8] >> (i % 8)) & 1)
+        {
+            continue;
+        }
+        keep.push_back(sorted.index[i]);
+        if (grid and not grid->IsLarge(i))
+        {
+            grid->Suppress(overlap, i, param.iou_threshold, removed);
+        }
+        else
+        {
+            // 从 i 所在的 8 对齐块开始比较, i 及之前的位会被顺带置上, 这些框已经处理过, 不影响结果
+            const float target[5]{sorted.x1[i], sorted.y1[i], sorted.x2[i], sorted.y2[i], sorted.area[i]};
+            const int   start = i / 8 * 8;
+            overlap(target, sorted, start, sorted.Size(), param.iou_threshold, removed.data() + start / 8);
+        }
+    }
+}
+}  // namespace cv_infer
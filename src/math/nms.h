@@ -1,113 +1,81 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 namespace cv_infer
 {
-void bigmeshgrid(int height, int width, float* xg, float* yg)
+// nms 的输入, 扁平的 SoA 布局, 坐标为 x1, y1, x2, y2
+struct NmsBoxes
 {
-    for (int y_i = 0; y_i < height; ++y_i)
-    {
-        for (int x_i = 0; x_i < width; ++x_i)
-        {
-            xg[y_i * width + x_i] = x_i;
-            yg[y_i * width + x_i] = y_i;
-        }
-    }
-}
+    std::vector<float> x1;
+    std::vector<float> y1;
+    std::vector<float> x2;
+    std::vector<float> y2;
+    std::vector<float> score;
+    std::vector<int>   label;
 
-template <class T>
-struct BigSortElement
-{
-    BigSortElement(){};
-    BigSortElement(T v, unsigned int i) : value(v), index(i){};
-    T            value;
-    unsigned int index;
-};
+    int Size() const { return static_cast<int>(score.size()); }
 
-template <typename T>
-struct BigDescendingSort
-{
-    typedef T ElementType;
-    bool      operator()(const BigSortElement<T>& a, const BigSortElement<T>& b) { return a.value > b.value; }
-};
-
-std::vector<unsigned int> bigsort(std::vector<std::vector<float>>& data)
-{
-    // num*5
-    std::vector<BigSortElement<float>> temp_vector(data.size());
-    unsigned int                       index = 0;
-    for (unsigned int i = 0; i < data.size(); ++i)
+    void Reserve(int n)
     {
-        temp_vector[i] = BigSortElement<float>(data[i][4], i);
+        x1.reserve(n);
+        y1.reserve(n);
+        x2.reserve(n);
+        y2.reserve(n);
+        score.reserve(n);
+        label.reserve(n);
     }
 
-    // sort
-    BigDescendingSort<float> compare_op;
-    std::sort(temp_vector.begin(), temp_vector.end(), compare_op);
-
-    std::vector<unsigned int> result_index(data.size());
-    index = 0;
-    typename std::vector<BigSortElement<float>>::iterator iter, iend(temp_vector.end());
-    for (iter = temp_vector.begin(); iter != iend; ++iter)
+    void Clear()
     {
-        result_index[index] = ((*iter).index);
-        index++;
+        x1.clear();
+        y1.clear();
+        x2.clear();
+        y2.clear();
+        score.clear();
+        label.clear();
     }
 
-    return result_index;
-}
-
-std::vector<float> bigget_ious(std::vector<std::vector<float>>& all_bbox, std::vector<float>& target_bbox,
-                               std::vector<unsigned int> order, unsigned int offset)
-{
-    std::vector<float> iou_list;
-    for (unsigned int i = offset; i < order.size(); ++i)
+    void Push(float bx1, float by1, float bx2, float by2, float bscore, int blabel = 0)
     {
-        int   index    = order[i];
-        float inter_x1 = std::max(all_bbox[index][0], target_bbox[0]);
-        float inter_y1 = std::max(all_bbox[index][1], target_bbox[1]);
-
-        float inter_x2 = std::min(all_bbox[index][2], target_bbox[2]);
-        float inter_y2 = std::min(all_bbox[index][3], target_bbox[3]);
-
-        float inter_w = std::max(inter_x2 - inter_x1, 0.0f);
-        float inter_h = std::max(inter_y2 - inter_y1, 0.0f);
-
-        float inter_area = inter_w * inter_h;
-        float a_area     = (all_bbox[index][2] - all_bbox[index][0]) * (all_bbox[index][3] - all_bbox[index][1]);
-        float b_area     = (target_bbox[2] - target_bbox[0]) * (target_bbox[3] - target_bbox[1]);
-        float iou        = inter_area / (a_area + b_area - inter_area);
-        iou_list.push_back(iou);
+        x1.push_back(bx1);
+        y1.push_back(by1);
+        x2.push_back(bx2);
+        y2.push_back(by2);
+        score.push_back(bscore);
+        label.push_back(blabel);
     }
+};
 
-    return iou_list;
-}
+struct NmsParam
+{
+    float iou_threshold  = 0.45f;  // IoU 大于阈值的框被抑制
+    bool  class_aware    = false;  // true: 只在同类别的框之间抑制, 按类别平移坐标后一次完成
+    int   top_k          = 0;      // 最多保留的框数, <= 0 不限制
+    int   max_candidates = 0;      // 只有分数最高的 max_candidates 个框参与 nms, <= 0 不限制
+    int   grid_min_boxes = 4096;   // 框数不少于此值时使用空间网格, 只和相同格子中的框计算 IoU, <= 0 不使用
+};
 
-std::vector<unsigned int> bignms(std::vector<std::vector<float>>& dets, float thresh)
+// nms 的中间 buffer (排序 key, 排序后的框, 抑制位图, 网格), 跨帧复用时稳定后不再分配内存
+// 同一时间只能被一个 Nms 调用使用, 并发调用时每个线程一份
+class NmsWorkspace
 {
-    std::vector<unsigned int> order = bigsort(dets);
-    std::vector<unsigned int> keep;
+public:
+    NmsWorkspace();
+    ~NmsWorkspace();
+    NmsWorkspace(NmsWorkspace&&) noexcept;
+    NmsWorkspace& operator=(NmsWorkspace&&) noexcept;
 
-    while (order.size() > 0)
-    {
-        unsigned int index = order[0];
-        keep.push_back(index);
-        if (order.size() == 1)
-        {
-            break;
-        }
+private:
+    friend void Nms(const NmsBoxes& boxes, const NmsParam& param, NmsWorkspace& workspace, std::vector<int>& keep);
 
-        std::vector<float>        check_ious = bigget_ious(dets, dets[index], order, 1);
-        std::vector<unsigned int> remained_order;
-        for (int i = 0; i < check_ious.size(); ++i)
-        {
-            if (check_ious[i] < thresh)
-            {
-                remained_order.push_back(order[i + 1]);
-            }
-        }
-        order = remained_order;
-    }
-    return keep;
-}
-}  // namespace cv_infer
\ No newline at end of file
+    struct Impl;
+    std::unique_ptr<Impl> Data;
+};
+
+// 贪心 nms, 返回保留的框在 boxes 中的下标, 按分数从高到低排列
+// 按分数排序后预先计算面积, 每次用 AVX2/NEON 和后续 8 个框比较, 被抑制的框记录在位图中
+std::vector<int> Nms(const NmsBoxes& boxes, const NmsParam& param);
+// 复用 workspace 和 keep 的版本, 结果与上面相同, 写到 keep 中 (先清空)
+void Nms(const NmsBoxes& boxes, const NmsParam& param, NmsWorkspace& workspace, std::vector<int>& keep);
+}  // namespace cv_infer
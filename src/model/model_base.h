@@ -3,6 +3,8 @@
 #include <opencv2/opencv.hpp>
 #include <string>
 
+#include "engine/engine_base.h"
+
 namespace cv_infer
 {
 template <typename EngineType>
@@ -14,7 +16,7 @@ public:
         return Engine.LoadModel(model_file, device_preprocess);
     };
     //  virtual bool PreProcess(const std::vector<cv::Mat>& inputs, void* dst) = 0;
-    //  virtual std::vector<std::vector<float>> PostProcess(const std::vector<std::vector<float>>& model_outputs) = 0;
+    //  virtual Detections PostProcess(const std::vector<cv::Mat>& inputs_batch, const EngineOutputs& model_outputs) = 0;
 
 public:
     std::string Model;
@@ -1,10 +1,15 @@
 #pragma once
 
 #include <algorithm>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <optional>
 
+#ifdef CVINFER_WITH_TENSORRT
 #include "engine/preprocess_kernal.cuh"
-#include "math/math.h"
+#endif
+#include "engine/math.h"
 #include "math/nms.h"
 #include "model/model_base.h"
 #include "signal/signal.h"
@@ -24,6 +29,13 @@ public:
             LOGE("ModelBase<EngineType>::Init failed");
             return false;
         }
+        // 引擎不支持 device 预处理时 (如 cpu 引擎) 退回到 host 预处理
+        DevicePreProcess = (this->Engine).IsDevicePreProcess();
+        if (not LoadShapes())
+        {
+            LOGE("LoadShapes failed");
+            return false;
+        }
         if (not(this->Engine)
                    .RegisterPreProcessFunc(
                        std::bind(&PersonBall::PreProcess, this, std::placeholders::_1, std::placeholders::_2)))
@@ -31,7 +43,9 @@ public:
             LOGE("Engine.RegisterPreProcessFunc failed");
             return false;
         }
-        if (not(this->Engine).RegisterPostProcessFunc(std::bind(&PersonBall::PostProcess, this, std::placeholders::_1)))
+        if (not(this->Engine)
+                   .RegisterPostProcessFunc(
+                       std::bind(&PersonBall::PostProcess, this, std::placeholders::_1, std::placeholders::_2)))
         {
             LOGE("Engine.RegisterPostProcessFunc failed");
             return false;
@@ -40,158 +54,246 @@ public:
     }
     bool PreProcess(const std::vector<cv::Mat>& inputs_batch, std::vector<float*>& preprocessed)
     {
-        const auto num_inputs = inputs_batch.size();
-        if (inputs_batch.size() != num_inputs)
+        if (DevicePreProcess)
         {
-            LOGE("Input signals size not match, expect [%d], but got [%d]", num_inputs, inputs_batch.size());
-            return false;
-        }
-
-        int input_index = 0;
-        for (const auto& image : inputs_batch)
-        {
-            auto width   = image.cols;
-            auto height  = image.rows;
-            auto channel = image.channels();
-
-            if (DevicePreProcess)
+            // device 预处理要求输入已经缩放到推理尺寸, 见 GetImages
+            int input_index = 0;
+            for (const auto& image : inputs_batch)
             {
-                CUDAKernal::ConverHWC2CHWMeanStd(image.data, height, width, channel, Mean.data(), Scale.data(),
-                                                 preprocessed[input_index]);
-            }
-            else
-            {
-                ConverHWC2CHWMeanStd(image.data, height, width, channel, Mean.data(), Scale.data(),
-                                     preprocessed[input_index]);
+#ifdef CVINFER_WITH_TENSORRT
+                CUDAKernal::ConverHWC2CHWMeanStd(image.data, image.rows, image.cols, image.channels(), Mean.data(),
+                                                 Scale.data(), preprocessed[input_index]);
+#endif
+                input_index++;
             }
+            return true;
         }
 
+        // 每张图直接写到自己在输入 buffer 中的位置: 一张图对应一个输入, 或者整个 batch 写到同一个输入中
+        const auto          image_len = 3 * InferHeight.value() * InferWidth.value();
+        const bool          per_input = preprocessed.size() == inputs_batch.size();
+        std::vector<float*> dst;
+        for (int i = 0; i < inputs_batch.size(); ++i)
+        {
+            dst.push_back(per_input ? preprocessed[i] : preprocessed[0] + i * image_len);
+        }
+        ConverHWC2CHWResizeMeanStd(inputs_batch, InferHeight.value(), InferWidth.value(), Mean.data(), Scale.data(),
+                                   dst);
         return true;
     }
 
-    std::vector<std::vector<float>> PostProcess(std::vector<std::vector<float>> model_outputs)
+    Detections PostProcess(const std::vector<cv::Mat>& inputs_batch, const EngineOutputs& model_outputs)
     {
-        int offset = 0;
+        // outputs.shape = [batch, OutputSize, 7], anchor: dx, dy, log(w), log(h), obj, cls_0 (person), cls_1 (ball)
+        constexpr int anchor_len = 7;
+        const auto    image_len  = static_cast<std::size_t>(OutputSize) * anchor_len;
+        const int     batch_size = model_outputs.empty() ? 0 : static_cast<int>(model_outputs[0].size() / image_len);
+        if (batch_size == 0)
+        {
+            LOGE("Output size not match, expect n * [%d x %d]", OutputSize, anchor_len);
+            return {};
+        }
 
+        // batch 中所有图片共用第一次推理时记录的原图尺寸
         float x_scale = InputWidth.value() / static_cast<float>(InferWidth.value());
         float y_scale = InputHeight.value() / static_cast<float>(InferHeight.value());
 
-        auto               data = model_outputs[0];
-        std::vector<float> temp_data(data.size());
+        // person 和 ball 的 iou 阈值不同, 分开 nms
+        NmsParam person_param;
+        person_param.iou_threshold = 0.2f;
+        NmsParam ball_param;
+        ball_param.iou_threshold = 0.01f;
 
-        // std::copy((temp_data, data.data(), sizeof(float) * data.size());
-        std::copy(data.begin(), data.end(), temp_data.begin());
-        for (int level_i = 0; level_i < LevelNum; ++level_i)
+        // 并发执行的后处理各自取一份中间 buffer, 跨帧复用
+        auto       buffer = AcquireDecodeBuffer();
+        Detections detections;
+        for (int b = 0; b < batch_size; ++b)
         {
-            int h      = LevelHW[level_i * 2 + 0];
-            int w      = LevelHW[level_i * 2 + 1];
-            int stride = LevelStrides[level_i];
+            Decode(model_outputs[0].data() + b * image_len, *buffer);
+            Nms(buffer->PersonBoxes, person_param, buffer->Workspace, buffer->PersonKeep);
+            Nms(buffer->BallBoxes, ball_param, buffer->Workspace, buffer->BallKeep);
 
-            std::vector<float> xg(h * w);
-            std::vector<float> yg(h * w);
+            // 返回的 Detections 交给调用方, 是每帧唯一的分配
+            detections.Reserve(detections.Size() + buffer->PersonKeep.size() + buffer->BallKeep.size());
+            auto merge = [&](const NmsBoxes& boxes, const std::vector<int>& keep, int class_id)
+            {
+                for (int index : keep)
+                {
+                    detections.boxes.push_back({boxes.x1[index] * x_scale, boxes.y1[index] * y_scale,
+                                                boxes.x2[index] * x_scale, boxes.y2[index] * y_scale,
+                                                boxes.score[index], class_id, b});
+                }
+            };
+            merge(buffer->PersonBoxes, buffer->PersonKeep, 0);
+            merge(buffer->BallBoxes, buffer->BallKeep, 1);
+        }
+        ReleaseDecodeBuffer(std::move(buffer));
+        return detections;
+    }
 
-            bigmeshgrid(h, w, xg.data(), yg.data());
+    Detections Forwards(const std::vector<std::shared_ptr<SignalImageBGR>>& inputs)
+    {
+        auto images = GetImages(inputs);
+        if (images.empty())
+        {
+            return {};
+        }
+        return (this->Engine).Forwards(images);
+    }
 
-            for (int start_i = offset; start_i < offset + h * w; ++start_i)
-            {
-                temp_data[start_i * 7 + 0] = (data[start_i * 7 + 0] + xg[start_i - offset]) * stride;
-                temp_data[start_i * 7 + 1] = (data[start_i * 7 + 1] + yg[start_i - offset]) * stride;
+    // 异步推理, 后处理在引擎的线程中完成
+    std::future<Detections> Submit(const std::vector<std::shared_ptr<SignalImageBGR>>& inputs)
+    {
+        auto images = GetImages(inputs);
+        if (images.empty())
+        {
+            std::promise<Detections> empty;
+            empty.set_value({});
+            return empty.get_future();
+        }
+        return (this->Engine).Submit(std::move(images));
+    }
 
-                temp_data[start_i * 7 + 2] = exp(data[start_i * 7 + 2]) * stride;
-                temp_data[start_i * 7 + 3] = exp(data[start_i * 7 + 3]) * stride;
-            }
+protected:
+    // 后处理的中间结果, 跨帧复用
+    struct DecodeBuffer
+    {
+        std::vector<int>   Candidates;
+        std::vector<float> WH;
+        NmsBoxes           PersonBoxes;
+        NmsBoxes           BallBoxes;
+        NmsWorkspace       Workspace;
+        std::vector<int>   PersonKeep;
+        std::vector<int>   BallKeep;
+    };
 
-            offset += h * w;
+    // 每个并发执行的后处理取一份, 用完归还, 份数等于同时执行的后处理数 (不超过引擎的 MaxInFlight), 随模型释放
+    std::unique_ptr<DecodeBuffer> AcquireDecodeBuffer()
+    {
+        std::lock_guard<std::mutex> lock(DecodeBufferMutex);
+        if (DecodeBuffers.empty())
+        {
+            return std::make_unique<DecodeBuffer>();
         }
+        auto buffer = std::move(DecodeBuffers.back());
+        DecodeBuffers.pop_back();
+        return buffer;
+    }
 
-        std::vector<std::vector<float>> person_bboxes;
-        std::vector<std::vector<float>> ball_bboxes;
-        for (int i = 0; i < OutputSize; ++i)  // 8064 is output size, this value is fixed by model
+    void ReleaseDecodeBuffer(std::unique_ptr<DecodeBuffer> buffer)
+    {
+        std::lock_guard<std::mutex> lock(DecodeBufferMutex);
+        DecodeBuffers.push_back(std::move(buffer));
+    }
+
+    // 解码一张图的输出, person 和 ball 的框分别写到 buffer.PersonBoxes / buffer.BallBoxes, 坐标为推理尺寸
+    void Decode(const float* data, DecodeBuffer& buffer) const
+    {
+        constexpr int anchor_len    = 7;
+        auto&         candidates    = buffer.Candidates;
+        auto&         wh            = buffer.WH;
+        auto&         person_bboxes = buffer.PersonBoxes;
+        auto&         ball_bboxes   = buffer.BallBoxes;
+
+        // 1. 先过滤 obj_pred, 只有候选 anchor 需要解码 (obj_pred 0.2 best)
+        candidates.clear();
+        SelectRows(data, OutputSize, anchor_len, 4, 0.1f, candidates);
+
+        // 2. 候选 anchor 的 w, h 一起做 exp
+        const int candidate_num = static_cast<int>(candidates.size());
+        wh.resize(candidate_num * 2);
+        for (int k = 0; k < candidate_num; ++k)
+        {
+            wh[k * 2 + 0] = data[candidates[k] * anchor_len + 2];
+            wh[k * 2 + 1] = data[candidates[k] * anchor_len + 3];
+        }
+        ExpArray(wh.data(), candidate_num * 2, wh.data());
+
+        // 3. 使用初始化时计算好的网格坐标和步长还原框
+        person_bboxes.Clear();
+        ball_bboxes.Clear();
+        for (int k = 0; k < candidate_num; ++k)
         {
-            float* ptr        = temp_data.data() + i * 7;
-            float  cx         = ptr[0];
-            float  cy         = ptr[1];
-            float  w          = ptr[2];
-            float  h          = ptr[3];
-            float  obj_pred   = ptr[4];
-            float  cls_0_pred = ptr[5];
-            float  cls_1_pred = ptr[6];
+            const int    i          = candidates[k];
+            const float* ptr        = data + i * anchor_len;
+            float        cls_0_pred = ptr[5];
+            float        cls_1_pred = ptr[6];
 
-            // obj_pred 0.2 best
-            if (obj_pred > 0.1)
+            bool is_person = cls_0_pred > cls_1_pred && cls_0_pred > 0.5;
+            bool is_ball   = cls_0_pred < cls_1_pred && cls_1_pred > 0.3;
+            if (not is_person and not is_ball)
             {
-                if (cls_0_pred > cls_1_pred && cls_0_pred > 0.5)
-                {
-                    person_bboxes.push_back({cx - w / 2, cy - h / 2, cx + w / 2, cy + h / 2, cls_0_pred});
-                }
-                else if (cls_0_pred < cls_1_pred && cls_1_pred > 0.3)
-                {
-                    ball_bboxes.push_back({cx - w / 2, cy - h / 2, cx + w / 2, cy + h / 2, cls_1_pred});
-                }
+                continue;
             }
+            float stride = AnchorStride[i];
+            float cx     = (ptr[0] + AnchorX[i]) * stride;
+            float cy     = (ptr[1] + AnchorY[i]) * stride;
+            float w      = wh[k * 2 + 0] * stride;
+            float h      = wh[k * 2 + 1] * stride;
+            (is_person ? person_bboxes : ball_bboxes)
+                .Push(cx - w / 2, cy - h / 2, cx + w / 2, cy + h / 2, is_person ? cls_0_pred : cls_1_pred);
         }
+    }
 
-        if (person_bboxes.size() > 0)
+    // 从引擎的输入输出形状推导推理尺寸和各层特征图大小, 引擎拿不到形状时 (动态维度) 使用默认值
+    bool LoadShapes()
+    {
+        const auto& inputs  = (this->Engine).GetInputs();
+        const auto& outputs = (this->Engine).GetOutputs();
+        if (not inputs.empty() and inputs[0].dims.size() == 4 and inputs[0].dims[2] > 0 and inputs[0].dims[3] > 0)
         {
-            // preson
-            std::vector<unsigned int> filter_person_index;
-            filter_person_index = bignms(person_bboxes, 0.2);
-            std::vector<std::vector<float>> filter_person_bboxes;
-            for (int i = 0; i < filter_person_index.size(); ++i)
+            InferHeight = static_cast<int>(inputs[0].dims[2]);
+            InferWidth  = static_cast<int>(inputs[0].dims[3]);
+            LevelHW.clear();
+            for (auto stride : LevelStrides)
             {
-                filter_person_bboxes.push_back(person_bboxes[filter_person_index[i]]);
+                LevelHW.push_back(InferHeight.value() / stride);
+                LevelHW.push_back(InferWidth.value() / stride);
             }
-            person_bboxes = filter_person_bboxes;
         }
-        if (ball_bboxes.size() > 0)
+        if (not outputs.empty() and outputs[0].dims.size() == 3 and outputs[0].dims[1] > 0)
         {
-            // ball
-            std::vector<unsigned int> filter_ball_index;
-            filter_ball_index = bignms(ball_bboxes, 0.01);
-            std::vector<std::vector<float>> filter_ball_bboxes;
-            for (int i = 0; i < filter_ball_index.size(); ++i)
+            if (outputs[0].dims[2] != 7)
             {
-                filter_ball_bboxes.push_back(ball_bboxes[filter_ball_index[i]]);
+                LOGE("output shape not match, expect [n, 7], but got [n, %lld]", (long long)outputs[0].dims[2]);
+                return false;
             }
-            ball_bboxes = filter_ball_bboxes;
+            OutputSize = static_cast<int>(outputs[0].dims[1]);
         }
-        // 合并结果
-        int person_num          = person_bboxes.size();
-        int ball_num            = ball_bboxes.size();
-        int person_and_ball_num = person_num + ball_num;
-
-        std::vector<std::vector<float>> bboxes(person_and_ball_num, std::vector<float>(5, 0.0));
 
-        float labels[person_and_ball_num];
-
-        for (int i = 0; i < person_and_ball_num; ++i)
+        int anchor_num = 0;
+        for (int level_i = 0; level_i < LevelNum; ++level_i)
         {
-            if (i < person_bboxes.size())
-            {
-                bboxes[i][0] = person_bboxes[i][0] * x_scale;
-                bboxes[i][1] = person_bboxes[i][1] * y_scale;
-                bboxes[i][2] = person_bboxes[i][2] * x_scale;
-                bboxes[i][3] = person_bboxes[i][3] * y_scale;
-                bboxes[i][4] = person_bboxes[i][4];
+            anchor_num += LevelHW[level_i * 2 + 0] * LevelHW[level_i * 2 + 1];
+        }
+        if (anchor_num != OutputSize)
+        {
+            LOGE("anchor num [%d] not match output size [%d]", anchor_num, OutputSize);
+            return false;
+        }
 
-                labels[i] = 0;
-            }
-            else
+        // 每个 anchor 的网格坐标和步长, 只在初始化时计算一次
+        AnchorX.clear();
+        AnchorY.clear();
+        AnchorStride.clear();
+        for (int level_i = 0; level_i < LevelNum; ++level_i)
+        {
+            for (int y = 0; y < LevelHW[level_i * 2 + 0]; ++y)
             {
-                bboxes[i][0] = ball_bboxes[i - person_num][0] * x_scale;
-                bboxes[i][1] = ball_bboxes[i - person_num][1] * y_scale;
-                bboxes[i][2] = ball_bboxes[i - person_num][2] * x_scale;
-                bboxes[i][3] = ball_bboxes[i - person_num][3] * y_scale;
-                bboxes[i][4] = ball_bboxes[i - person_num][4];
-
-                labels[i] = 1;
+                for (int x = 0; x < LevelHW[level_i * 2 + 1]; ++x)
+                {
+                    AnchorX.push_back(x);
+                    AnchorY.push_back(y);
+                    AnchorStride.push_back(LevelStrides[level_i]);
+                }
             }
         }
-        return bboxes;
+        LOGI("PersonBall infer size = [%d x %d], output size = [%d]", InferWidth.value(), InferHeight.value(),
+             OutputSize);
+        return true;
     }
 
-    // TODO: get return type from PostProcess
-    std::vector<std::vector<float>> Forwards(const std::vector<std::shared_ptr<SignalImageBGR>>& inputs)
+    std::vector<cv::Mat> GetImages(const std::vector<std::shared_ptr<SignalImageBGR>>& inputs)
     {
         std::vector<cv::Mat> images;
         for (const auto& input : inputs)
@@ -209,17 +311,21 @@ public:
             {
                 InputHeight = input->Val.rows;
             }
+            // host 预处理时缩放和归一化在 PreProcess 中一次完成
+            if (not DevicePreProcess)
+            {
+                images.push_back(input->Val);
+                continue;
+            }
             cv::Mat resized;
             CostTimer.StartTimer();
             cv::resize(input->Val, resized, cv::Size(InferWidth.value(), InferHeight.value()));
             CostTimer.EndTimer("resize");
             images.push_back(resized);
         }
-        auto ret = (this->Engine).Forwards(images);
-        return ret;
+        return images;
     }
 
-protected:
     Timer CostTimer{"resize"};
     bool  DevicePreProcess{true};
 
@@ -236,6 +342,13 @@ protected:
     int              LevelNum{3};
 
     int OutputSize{8064};
+
+    std::vector<float> AnchorX;
+    std::vector<float> AnchorY;
+    std::vector<float> AnchorStride;
+
+    std::mutex                                 DecodeBufferMutex;
+    std::vector<std::unique_ptr<DecodeBuffer>> DecodeBuffers;  // 空闲的后处理 buffer
 };
 
 }  // namespace cv_infer
\ No newline at end of file
@@ -1,13 +1,19 @@
 #pragma once
 
+#include <future>
 #include <memory>
+#include <mutex>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/opencv.hpp>
 #include <optional>
 #include <string>
 #include <vector>
 
+#include "engine/math.h"
+#include "math/nms.h"
+#ifdef CVINFER_WITH_TENSORRT
 #include "engine/preprocess_kernal.cuh"
+#endif
 #include "model/model_base.h"
 #include "signal/signal.h"
 #include "tools/logger.h"
@@ -23,9 +29,51 @@ enum YoloType : int
     YOLOV9,
     YOLOV10,
 };
+
+// 各版本 yolo 的输出布局, 编译期根据 yolo_type 选择解码方式, 默认值对应 640x640 的 coco 模型
+// vx/v5/v7: [anchor_num, 4 + 1 + class_num], 每个 anchor 一行 cx, cy, w, h, obj, cls...
+template <YoloType yolo_type>
+struct YoloLayout
+{
+    static constexpr bool Transposed = false;  // true: 输出为 [anchor_len, anchor_num], 每个分量一行
+    static constexpr bool NmsFree    = false;  // true: 模型内已完成 nms, 不再做 nms
+    static constexpr int  HeadLen    = 5;      // 每个 anchor 中类别分数之前的分量数
+    static constexpr int  AnchorNum  = 25200;
+    static constexpr int  AnchorLen  = 85;
+};
+
+// v8/v9: [4 + class_num, anchor_num], 没有 obj, 直接使用类别分数
+template <>
+struct YoloLayout<YOLOV8>
+{
+    static constexpr bool Transposed = true;
+    static constexpr bool NmsFree    = false;
+    static constexpr int  HeadLen    = 4;
+    static constexpr int  AnchorNum  = 8400;
+    static constexpr int  AnchorLen  = 84;
+};
+
+template <>
+struct YoloLayout<YOLOV9> : YoloLayout<YOLOV8>
+{
+};
+
+// v10: [max_det, 6], 每行 x1, y1, x2, y2, score, class, 按分数从高到低排列
+template <>
+struct YoloLayout<YOLOV10>
+{
+    static constexpr bool Transposed = false;
+    static constexpr bool NmsFree    = true;
+    static constexpr int  HeadLen    = 6;
+    static constexpr int  AnchorNum  = 300;
+    static constexpr int  AnchorLen  = 6;
+};
+
 template <typename EngineType, YoloType yolo_type>
 class Yolo : public ModelBase<EngineType>
 {
+    using Layout = YoloLayout<yolo_type>;
+
 public:
     virtual bool Init(const std::string &model)
     {
@@ -34,6 +82,13 @@ public:
             LOGE("ModelBase<EngineType>::Init failed");
             return false;
         }
+        // 引擎不支持 device 预处理时 (如 cpu 引擎) 退回到 host 预处理
+        DevicePreProcess = (this->Engine).IsDevicePreProcess();
+        if (not LoadShapes())
+        {
+            LOGE("LoadShapes failed");
+            return false;
+        }
         if (not(this->Engine)
                    .RegisterPreProcessFunc(
                        std::bind(&Yolo::PreProcess, this, std::placeholders::_1, std::placeholders::_2)))
@@ -41,145 +96,266 @@ public:
             LOGE("Engine.RegisterPreProcessFunc failed");
             return false;
         }
-        if (not(this->Engine).RegisterPostProcessFunc(std::bind(&Yolo::PostProcess, this, std::placeholders::_1)))
+        if (not(this->Engine)
+                   .RegisterPostProcessFunc(
+                       std::bind(&Yolo::PostProcess, this, std::placeholders::_1, std::placeholders::_2)))
         {
             LOGE("Engine.RegisterPostProcessFunc failed");
             return false;
         }
         return true;
     }
-    bool PreProcess(const std::vector<cv::Mat> &inputs_batch, std::vector<float *> preprocessed)
+    bool PreProcess(const std::vector<cv::Mat> &inputs_batch, std::vector<float *> &preprocessed)
     {
-        const auto num_inputs = inputs_batch.size();
-        if (inputs_batch.size() != num_inputs)
+        // 每张图直接写到自己在输入 buffer 中的位置: 一张图对应一个输入, 或者整个 batch 写到同一个输入中
+        const auto image_len = 3 * InferHeight.value() * InferWidth.value();
+        const bool per_input = preprocessed.size() == inputs_batch.size();
+        for (int i = 0; i < inputs_batch.size(); ++i)
         {
-            LOGE("Input signals size not match, expect [%d], but got [%d]", num_inputs, inputs_batch.size());
-            return false;
-        }
-
-        int input_index = 0;
-        for (const auto &image : inputs_batch)
-        {
-            auto width   = image.cols;
-            auto height  = image.rows;
-            auto channel = image.channels();
+            const auto &image   = inputs_batch[i];
+            auto        width   = image.cols;
+            auto        height  = image.rows;
+            auto        channel = image.channels();
+            float      *dst     = per_input ? preprocessed[i] : preprocessed[0] + i * image_len;
 
             if (DevicePreProcess)
             {
-                CUDAKernal::ConverHWC2CHWAlpahNormResizeKeepRatio(image.data, height, width, channel,
+#ifdef CVINFER_WITH_TENSORRT
+                // kernel 按紧密排列拷贝源图像, ROI 等不连续的 Mat 先拷贝成连续的
+                const cv::Mat packed = image.isContinuous() ? image : image.clone();
+                CUDAKernal::ConverHWC2CHWAlpahNormResizeKeepRatio(packed.data, height, width, channel,
                                                                   InferHeight.value(), InferWidth.value(), channel,
-                                                                  1 / 255.0f, 0.0f, 114, 32, preprocessed[input_index]);
+                                                                  1 / 255.0f, 0.0f, 114, 32, dst);
+#endif
             }
             else
             {
-                LOGE("ConverHWC2CHWMeanStd not implemented");
-                return false;
+                ConverHWC2CHWAlpahNormResizeKeepRatio(image.data, height, width, channel, InferHeight.value(),
+                                                      InferWidth.value(), channel, 1 / 255.0f, 0.0f, 114, dst,
+                                                      image.step[0]);
             }
         }
         return true;
     };
-    std::vector<std::vector<float>> PostProcess(const std::vector<std::vector<float>> &outputs)
+    Detections PostProcess(const std::vector<cv::Mat> &inputs_batch, const EngineOutputs &outputs)
     {
-        std::vector<std::vector<float>> person_bboxes;
-
-        auto src_w = InputWidth.value();
-        auto src_h = InputHeight.value();
-        auto dst_w = InferWidth.value();
-        auto dst_h = InferWidth.value();
-
-        float scale = std::min((float)dst_w / src_w, (float)dst_h / src_h);
-        int   new_w = (int)(src_w * scale);
-        int   new_h = (int)(src_h * scale);
-        int   pad_x = (dst_w - new_w) / 2;
-        int   pad_y = (dst_h - new_h) / 2;
-
         constexpr auto confidence_threshold = 0.25f;
         constexpr auto nms_threshold        = 0.45f;
+        constexpr auto max_detections       = 300;
 
-        auto anchor_num = 25200;
-        auto class_num  = 85;
-
-        // 1. 转换
-        // outputs.shape = [1 * 214200] (214200 = 25200 * 85)
-        for (int anchor_index = 0; anchor_index < anchor_num; anchor_index++)
+        // outputs.shape = [batch * anchor_num * anchor_len], 每张图的布局见 YoloLayout
+        const auto image_len  = static_cast<std::size_t>(AnchorNum) * AnchorLen;
+        const int  batch_size = outputs.empty() ? 0 : static_cast<int>(outputs[0].size() / image_len);
+        if (batch_size == 0)
         {
-            std::vector<float> person_bbox;
+            LOGE("Output size not match, expect n * [%d x %d]", AnchorNum, AnchorLen);
+            return {};
+        }
+        if (static_cast<int>(inputs_batch.size()) != batch_size)
+        {
+            LOGE("Input images size not match, expect [%d], but got [%d]", batch_size, inputs_batch.size());
+            return {};
+        }
 
-            float cx     = outputs[0][anchor_index * class_num + 0];
-            float cy     = outputs[0][anchor_index * class_num + 1];
-            float w      = outputs[0][anchor_index * class_num + 2];
-            float h      = outputs[0][anchor_index * class_num + 3];
-            float left   = cx - w * 0.5f;
-            float top    = cy - h * 0.5f;
-            float right  = cx + w * 0.5f;
-            float bottom = cy + h * 0.5f;
+        // 并发执行的后处理各自取一份中间 buffer, 跨帧复用
+        auto buffer = AcquireDecodeBuffer();
+        if (static_cast<int>(buffer->Boxes.size()) < batch_size)
+        {
+            buffer->Boxes.resize(batch_size);
+        }
 
-            if (outputs[0][anchor_index * class_num + 4] < confidence_threshold)
+        // 1. 解码, 只有分数通过阈值的 anchor 会被展开, 结果写到每张图的连续 buffer 中 (每个检测 6 个 float)
+        //    每张图按自己的原图尺寸还原 letterbox, 同一个 batch 中可以混合不同分辨率的图片
+        auto decode = [&](const cv::Range &range)
+        {
+            for (int b = range.start; b < range.end; b++)
             {
-                continue;
-            }
+                auto src_w = inputs_batch[b].cols;
+                auto src_h = inputs_batch[b].rows;
+                auto dst_w = InferWidth.value();
+                auto dst_h = InferHeight.value();
 
-            person_bbox.push_back((left - pad_x) / scale);
-            person_bbox.push_back((top - pad_y) / scale);
-            person_bbox.push_back((right - pad_x) / scale);
-            person_bbox.push_back((bottom - pad_y) / scale);
-            person_bbox.push_back(outputs[0][anchor_index * class_num + 4]);
-            auto max_confidence = 0.0f;
-            int  label          = -1;
-            for (int j = 0; j < 80; j++)
-            {
-                if (outputs[0][anchor_index * class_num + 5 + j] > max_confidence)
+                float scale = std::min((float)dst_w / src_w, (float)dst_h / src_h);
+                int   new_w = (int)(src_w * scale);
+                int   new_h = (int)(src_h * scale);
+                int   pad_x = (dst_w - new_w) / 2;
+                int   pad_y = (dst_h - new_h) / 2;
+
+                const float *data  = outputs[0].data() + b * image_len;
+                auto        &boxes = buffer->Boxes[b];
+                boxes.clear();
+                if constexpr (Layout::NmsFree)
+                {
+                    DecodeNmsFreeRows(data, confidence_threshold, scale, pad_x, pad_y, boxes);
+                }
+                else if constexpr (Layout::Transposed)
+                {
+                    DecodeYoloColumns(data, AnchorNum, AnchorLen - Layout::HeadLen, confidence_threshold, scale, pad_x,
+                                      pad_y, boxes);
+                }
+                else
                 {
-                    max_confidence = outputs[0][anchor_index * class_num + 5 + j];
-                    label          = j;
+                    DecodeYoloRows(data, AnchorNum, AnchorLen, confidence_threshold, scale, pad_x, pad_y, boxes);
                 }
             }
-            person_bbox.push_back(label);
-            person_bboxes.push_back(person_bbox);
-        }
-
-        // 2. nms
-        auto IoU = [](const std::vector<float> &a, const std::vector<float> &b)
-        {
-            float x1    = std::max(a[0], b[0]);
-            float y1    = std::max(a[1], b[1]);
-            float x2    = std::min(a[2], b[2]);
-            float y2    = std::min(a[3], b[3]);
-            float w     = std::max(0.0f, x2 - x1);
-            float h     = std::max(0.0f, y2 - y1);
-            float inter = w * h;
-            float area1 = (a[2] - a[0]) * (a[3] - a[1]);
-            float area2 = (b[2] - b[0]) * (b[3] - b[1]);
-            return inter / (area1 + area2 - inter);
         };
-        std::vector<std::vector<float>> filtered_person_bboxes;
-        std::sort(person_bboxes.begin(), person_bboxes.end(),
-                  [](const std::vector<float> &a, const std::vector<float> &b) { return a[4] > b[4]; });
+        if (batch_size == 1)
+        {
+            decode(cv::Range(0, 1));
+        }
+        else
+        {
+            cv::parallel_for_(cv::Range(0, batch_size), decode);
+        }
+
+        // 2. 按类别 nms, v10 的输出已经是 nms 之后的结果, 直接输出
+        NmsParam param;
+        param.iou_threshold = nms_threshold;
+        param.class_aware   = true;
+        param.top_k         = max_detections;
 
-        std::vector<bool> skip(person_bboxes.size(), false);
-        for (int i = 0; i < person_bboxes.size(); ++i)
+        // 返回的 Detections 交给调用方, 是每帧唯一的分配
+        Detections detections;
+        for (int b = 0; b < batch_size; b++)
         {
-            if (skip[i])
+            const auto &boxes = buffer->Boxes[b];
+            if constexpr (Layout::NmsFree)
             {
+                for (std::size_t i = 0; i < boxes.size(); i += 6)
+                {
+                    const float *box = boxes.data() + i;
+                    detections.boxes.push_back({box[0], box[1], box[2], box[3], box[4], static_cast<int>(box[5]), b});
+                }
                 continue;
             }
-            for (int j = i + 1; j < person_bboxes.size(); ++j)
+            auto &nms_boxes = buffer->NmsInput;
+            nms_boxes.Clear();
+            nms_boxes.Reserve(boxes.size() / 6);
+            for (std::size_t i = 0; i < boxes.size(); i += 6)
             {
-                if (skip[j] || person_bboxes[i][5] != person_bboxes[j][5])
-                {
-                    continue;
-                }
-                if (IoU(person_bboxes[i], person_bboxes[j]) > nms_threshold)
-                {
-                    skip[j] = true;
-                }
+                nms_boxes.Push(boxes[i + 0], boxes[i + 1], boxes[i + 2], boxes[i + 3], boxes[i + 4], (int)boxes[i + 5]);
+            }
+            Nms(nms_boxes, param, buffer->Workspace, buffer->Keep);
+            for (int index : buffer->Keep)
+            {
+                const float *box = boxes.data() + index * 6;
+                detections.boxes.push_back({box[0], box[1], box[2], box[3], box[4], static_cast<int>(box[5]), b});
             }
-            filtered_person_bboxes.push_back(person_bboxes[i]);
         }
+        ReleaseDecodeBuffer(std::move(buffer));
+        return detections;
+    }
+
+    Detections Forwards(const std::vector<std::shared_ptr<SignalImageBGR>> &inputs)
+    {
+        auto images = GetImages(inputs);
+        if (images.empty())
+        {
+            return {};
+        }
+        return (this->Engine).Forwards(images);
+    }
 
-        return filtered_person_bboxes;
+    // 异步推理, 后处理在引擎的线程中完成
+    std::future<Detections> Submit(const std::vector<std::shared_ptr<SignalImageBGR>> &inputs)
+    {
+        auto images = GetImages(inputs);
+        if (images.empty())
+        {
+            std::promise<Detections> empty;
+            empty.set_value({});
+            return empty.get_future();
+        }
+        return (this->Engine).Submit(std::move(images));
     }
-    std::vector<std::vector<float>> Forwards(const std::vector<std::shared_ptr<SignalImageBGR>> &inputs)
+
+protected:
+    // 后处理的中间结果, 跨帧复用
+    struct DecodeBuffer
+    {
+        std::vector<std::vector<float>> Boxes;  // 每张图解码出的检测, 每个 6 个 float, 只 clear 不释放
+        NmsBoxes                        NmsInput;
+        NmsWorkspace                    Workspace;
+        std::vector<int>                Keep;
+    };
+
+    // 每个并发执行的后处理取一份, 用完归还, 份数等于同时执行的后处理数 (不超过引擎的 MaxInFlight), 随模型释放
+    std::unique_ptr<DecodeBuffer> AcquireDecodeBuffer()
+    {
+        std::lock_guard<std::mutex> lock(DecodeBufferMutex);
+        if (DecodeBuffers.empty())
+        {
+            return std::make_unique<DecodeBuffer>();
+        }
+        auto buffer = std::move(DecodeBuffers.back());
+        DecodeBuffers.pop_back();
+        return buffer;
+    }
+
+    void ReleaseDecodeBuffer(std::unique_ptr<DecodeBuffer> buffer)
+    {
+        std::lock_guard<std::mutex> lock(DecodeBufferMutex);
+        DecodeBuffers.push_back(std::move(buffer));
+    }
+
+    // 从引擎的输入输出形状推导推理尺寸和 anchor 数量, 引擎拿不到形状时 (动态维度) 使用默认值
+    bool LoadShapes()
+    {
+        const auto &inputs  = (this->Engine).GetInputs();
+        const auto &outputs = (this->Engine).GetOutputs();
+        if (not inputs.empty() and inputs[0].dims.size() == 4 and inputs[0].dims[2] > 0 and inputs[0].dims[3] > 0)
+        {
+            InferHeight = static_cast<int>(inputs[0].dims[2]);
+            InferWidth  = static_cast<int>(inputs[0].dims[3]);
+        }
+        if (not outputs.empty() and outputs[0].dims.size() == 3 and outputs[0].dims[1] > 0 and outputs[0].dims[2] > 0)
+        {
+            AnchorNum = static_cast<int>(outputs[0].dims[Layout::Transposed ? 2 : 1]);
+            AnchorLen = static_cast<int>(outputs[0].dims[Layout::Transposed ? 1 : 2]);
+        }
+        if constexpr (Layout::NmsFree)
+        {
+            if (AnchorLen < Layout::HeadLen)
+            {
+                LOGE("output shape not match, expect [n, %d], but got [n, %d]", Layout::HeadLen, AnchorLen);
+                return false;
+            }
+            LOGI("Yolo infer size = [%d x %d], max detections = [%d]", InferWidth.value(), InferHeight.value(),
+                 AnchorNum);
+            return true;
+        }
+        if (AnchorLen <= Layout::HeadLen)
+        {
+            LOGE("output shape not match, expect %d + class_num values per anchor, but got [%d]", Layout::HeadLen,
+                 AnchorLen);
+            return false;
+        }
+        LOGI("Yolo infer size = [%d x %d], anchor num = [%d], class num = [%d]", InferWidth.value(),
+             InferHeight.value(), AnchorNum, AnchorLen - Layout::HeadLen);
+        return true;
+    }
+
+    // v10 的一行 [x1, y1, x2, y2, score, class] 还原到原图, 格式与 DecodeYoloRows 相同
+    // 输出按分数从高到低排列, 遇到第一个低于阈值的行即可结束
+    int DecodeNmsFreeRows(const float *data, float conf_threshold, float scale, float pad_x, float pad_y,
+                          std::vector<float> &boxes) const
+    {
+        int count = 0;
+        for (int a = 0; a < AnchorNum; a++)
+        {
+            const float *row = data + (std::size_t)a * AnchorLen;
+            if (row[4] < conf_threshold)
+            {
+                break;
+            }
+            boxes.insert(boxes.end(), {(row[0] - pad_x) / scale, (row[1] - pad_y) / scale, (row[2] - pad_x) / scale,
+                                       (row[3] - pad_y) / scale, row[4], row[5]});
+            count++;
+        }
+        return count;
+    }
+
+    std::vector<cv::Mat> GetImages(const std::vector<std::shared_ptr<SignalImageBGR>> &inputs)
     {
         std::vector<cv::Mat> images;
         for (const auto &input : inputs)
@@ -189,26 +365,20 @@ public:
                 LOGE("The input image is empty");
                 return {};
             }
-            if (not InputWidth.has_value())
-            {
-                InputWidth = input->Val.cols;
-            }
-            if (not InputHeight.has_value())
-            {
-                InputHeight = input->Val.rows;
-            }
             images.push_back(input->Val);
         }
-        auto ret = (this->Engine).Forwards(images);
-        return ret;
+        return images;
     }
 
-protected:
     bool DevicePreProcess{true};
 
-    std::optional<int> InputWidth;
-    std::optional<int> InputHeight;
     std::optional<int> InferWidth{640};
     std::optional<int> InferHeight{640};
+
+    int AnchorNum{Layout::AnchorNum};
+    int AnchorLen{Layout::AnchorLen};
+
+    std::mutex                                 DecodeBufferMutex;
+    std::vector<std::unique_ptr<DecodeBuffer>> DecodeBuffers;  // 空闲的后处理 buffer
 };
 }  // namespace cv_infer
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+namespace cv_infer
+{
+// unique_ptr deleters for the ffmpeg objects owned by nodes
+
+struct AVPacketFree
+{
+    void operator()(AVPacket* pkt) const { av_packet_free(&pkt); }
+};
+using AVPacketPtr = std::unique_ptr<AVPacket, AVPacketFree>;
+
+struct AVFrameFree
+{
+    void operator()(AVFrame* frame) const { av_frame_free(&frame); }
+};
+using AVFramePtr = std::unique_ptr<AVFrame, AVFrameFree>;
+
+struct AVCodecContextFree
+{
+    void operator()(AVCodecContext* cctx) const { avcodec_free_context(&cctx); }
+};
+using AVCodecContextPtr = std::unique_ptr<AVCodecContext, AVCodecContextFree>;
+
+struct AVFormatInputClose
+{
+    void operator()(AVFormatContext* ctx) const { avformat_close_input(&ctx); }
+};
+using AVFormatInputPtr = std::unique_ptr<AVFormatContext, AVFormatInputClose>;
+
+struct SwsContextFree
+{
+    void operator()(SwsContext* sws) const { sws_freeContext(sws); }
+};
+using SwsContextPtr = std::unique_ptr<SwsContext, SwsContextFree>;
+}  // namespace cv_infer
@@ -1,6 +1,10 @@
 #include "decoder_node.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <future>
 #include <opencv2/opencv.hpp>
 
 #include "signal/signal.h"
@@ -32,9 +36,34 @@ bool DecoderNode::Init(const std::string &name)
         return false;
     }
     LOGI("Open [%s] success", name.c_str());
+
+    if (not IndexFile.has_value())
+    {
+        IndexFile = std::filesystem::is_regular_file(URI) ? URI + ".kfi" : "";
+    }
+    if (not IndexFile->empty() and MappedIndex.Open(*IndexFile, URI))
+    {
+        IndexRecording = false;
+        LOGI("use key frame index [%s], key frames = [%zu]", IndexFile->c_str(), MappedIndex.Entries().size());
+    }
     return true;
 }
 
+bool DecoderNode::Init(std::shared_ptr<StreamSource> source, const std::string &name)
+{
+    if (source == nullptr)
+    {
+        LOGE("DecoderNode source is nullptr");
+        return false;
+    }
+    Source = std::move(source);
+    if (not IndexFile.has_value())
+    {
+        IndexFile = "";  // nothing on disk to attach a sidecar to
+    }
+    return Init(name);
+}
+
 bool DecoderNode::Open()
 {
     Ctx = avformat_alloc_context();
@@ -54,7 +83,18 @@ bool DecoderNode::Open()
     av_dict_set(&format_opts, "probesize", "2048", 0);
     auto                                                      start_time = std::chrono::system_clock::now();
     std::unique_ptr<AVDictionary *, decltype(av_dict_free) *> free_guard{&format_opts, av_dict_free};
-    if (auto ret = avformat_open_input(&Ctx, URI.c_str(), nullptr, &format_opts); ret != 0)
+    if (Source != nullptr)
+    {
+        if (IOCtx = Source->CreateAVIOContext(); IOCtx == nullptr)
+        {
+            LOGE("create AVIOContext failed, source = [%s]", URI.c_str());
+            return false;
+        }
+        Ctx->pb = IOCtx;
+        Ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+    auto *url = Source != nullptr ? "" : URI.c_str();
+    if (auto ret = avformat_open_input(&Ctx, url, nullptr, &format_opts); ret != 0)
     {
         LOGE("call avformat_open_input return [%d], source = [%s]", ret, URI.c_str());
         return false;
@@ -74,29 +114,19 @@ bool DecoderNode::Open()
     }
     CCtx->thread_count = ThreadNum;
     CCtx->thread_type  = FF_THREAD_FRAME;
-    Pkt                = av_packet_alloc();
-    if (Pkt == nullptr)
-    {
-        LOGE("call av_packet_alloc return nullptr");
-        return false;
-    }
-    Frame = av_frame_alloc();
+    Frame              = av_frame_alloc();
     if (Frame == nullptr)
     {
         LOGE("call av_frame_alloc return nullptr");
         return false;
     }
 
-    Width  = CCtx->width;
-    Height = CCtx->height;
-    LOGD("Source [%s] Width = [%d], Height = [%d]", URI.c_str(), Width, Height);
-
-    Sws = sws_alloc_context();
-    if (Sws == nullptr)
-    {
-        LOGE("call sws_alloc_context return nullptr");
-        return false;
-    }
+    Width     = CCtx->width;
+    Height    = CCtx->height;
+    TimeBase  = Ctx->streams[StreamIdx]->time_base;
+    StreamFps = av_q2d(av_guess_frame_rate(Ctx, Ctx->streams[StreamIdx], nullptr));
+    LOGD("Source [%s] Width = [%d], Height = [%d], FPS = [%f]", URI.c_str(), Width, Height, StreamFps);
+    ApplySampleCfg();
 
     return true;
 }
@@ -169,11 +199,6 @@ bool DecoderNode::Close()
         av_frame_free(&Frame);
         Frame = nullptr;
     }
-    if (Pkt != nullptr)
-    {
-        av_packet_free(&Pkt);
-        Pkt = nullptr;
-    }
     if (CCtx != nullptr)
     {
         avcodec_free_context(&CCtx);
@@ -184,95 +209,412 @@ bool DecoderNode::Close()
         avformat_close_input(&Ctx);
         Ctx = nullptr;
     }
+    // custom io is not freed by avformat_close_input
+    StreamSource::FreeAVIOContext(&IOCtx);
+    Converter.Reset();
     return true;
 }
 
-cv::Mat DecoderNode::GetOneFrame()
+bool DecoderNode::ReadPackets()
 {
-    while (av_read_frame(Ctx, Pkt) == 0)
+    while (Running)
     {
-        std::unique_ptr<AVPacket, decltype(av_packet_unref) *> unref_guard{Pkt, av_packet_unref};
-        if (Pkt->stream_index != StreamIdx)
+        AVPacketPtr pkt{av_packet_alloc()};
+        if (pkt == nullptr)
         {
-            continue;
+            LOGE("call av_packet_alloc return nullptr");
+            break;
         }
-        if (auto err_code = avcodec_send_packet(CCtx, Pkt); err_code != 0)
+        if (auto ret = av_read_frame(Ctx, pkt.get()); ret != 0)
+        {
+            if (ret != AVERROR_EOF)
+            {
+                LOGW("av_read_frame return [%d], treat as end of stream", ret);
+            }
+            else if (IndexRecording and not IndexFile->empty())
+            {
+                SaveKeyFrameIndex(*IndexFile, URI, Index, ReadCount);
+            }
+            IndexRecording = false;
+            break;
+        }
+        if (pkt->stream_index != StreamIdx)
         {
-            LOGT("can't send packet to decoder, return [%d]", err_code);
             continue;
         }
-        if (auto err_code = avcodec_receive_frame(CCtx, Frame); err_code != 0)
+        if (SeekPos >= 0)
         {
-            if (err_code == AVERROR(EAGAIN))
+            // the demuxer may land before the key frame we asked for, those packets are not counted
+            if (pkt->pos >= 0 and pkt->pos < SeekPos)
             {
                 continue;
             }
+            SeekPos = -1;
+        }
+        RecordKeyFrame(pkt.get());
+        ++ReadCount;
+        if (ForwardPackets)
+        {
+            PushPacket(pkt.get());  // every packet, sampling only applies to the decoded frames
+        }
+        if (SampleCfg.mode == DecodeSampleMode::KEY_FRAME and not(pkt->flags & AV_PKT_FLAG_KEY))
+        {
+            continue;
+        }
+        // block while the queue is full, re-check Running every SleepTime
+        while (Running and not PacketQue.Push(std::move(pkt), SleepTime))
+        {
+            if (PacketQue.IsClosed())
+            {
+                return true;
+            }
+        }
+    }
+    // null packet tells the decode loop to flush the codec
+    AVPacketPtr eof;
+    while (Running and not PacketQue.Push(std::move(eof), SleepTime))
+    {
+        if (PacketQue.IsClosed())
+        {
+            break;
+        }
+    }
+    return true;
+}
+
+bool DecoderNode::DecodePacket(const AVPacket *pkt)
+{
+    auto err_code = avcodec_send_packet(CCtx, pkt);
+    if (err_code == AVERROR(EAGAIN))
+    {
+        // decoder output is full, drain it and send again
+        ReceiveFrames();
+        err_code = avcodec_send_packet(CCtx, pkt);
+    }
+    if (err_code != 0 and err_code != AVERROR_EOF)
+    {
+        LOGT("can't send packet to decoder, return [%d]", err_code);
+        return false;
+    }
+    return ReceiveFrames();
+}
+
+bool DecoderNode::ReceiveFrames()
+{
+    // one packet may produce zero or several frames (B-frames, flushing), take all of them
+    while (true)
+    {
+        auto err_code = avcodec_receive_frame(CCtx, Frame);
+        if (err_code == AVERROR(EAGAIN))
+        {
+            return true;
+        }
+        if (err_code == AVERROR_EOF)
+        {
+            VideoEOF = true;
+            return true;
+        }
+        if (err_code != 0)
+        {
             LOGT("can't recevie farme from decoder, return [%d]", err_code);
+            return false;
+        }
+        auto frame_number = GetFrameNumber(Frame);
+        ++DecodedCount;
+        if (frame_number >= RangeEnd)
+        {
+            av_frame_unref(Frame);
+            VideoEOF = true;
+            return true;
+        }
+        if (frame_number < SeekTarget or not NeedSample(Frame, frame_number))
+        {
+            av_frame_unref(Frame);
+            continue;
         }
-        if (auto frame = DecodeToFrame(Frame); not frame.empty())
+        auto image = DecodeToFrame(Frame);
+        av_frame_unref(Frame);
+        if (not image.empty())
         {
-            return frame;
+            PushFrame(image, frame_number);
         }
     }
-    return TryFlushing();
 }
 
-cv::Mat DecoderNode::DecodeToFrame(AVFrame *frame)
+bool DecoderNode::SetSampleCfg(const DecodeSampleCfg &cfg)
 {
-    // sws to convert
-    Sws =
-        sws_getCachedContext(Sws, Frame->width, Frame->height, static_cast<AVPixelFormat>(Frame->format), Frame->width,
-                             Frame->height, AVPixelFormat::AV_PIX_FMT_BGR24, OutFlags, nullptr, nullptr, nullptr);
-    cv::Mat image(Frame->height, Frame->width, CV_8UC3);
-    int     linesizes[1]{};
-    linesizes[0] = image.step1();
-    sws_scale(Sws, Frame->data, Frame->linesize, 0, Frame->height, &image.data, linesizes);
+    if (cfg.mode == DecodeSampleMode::STRIDE and cfg.stride < 1)
+    {
+        LOGE("invalid sample stride [%d]", cfg.stride);
+        return false;
+    }
+    if (cfg.mode == DecodeSampleMode::FPS and cfg.fps <= 0.0)
+    {
+        LOGE("invalid sample fps [%f]", cfg.fps);
+        return false;
+    }
+    SampleCfg      = cfg;
+    NextSampleTime = std::numeric_limits<double>::lowest();
+    ApplySampleCfg();
+    return true;
+}
 
-    return image;
+void DecoderNode::ApplySampleCfg()
+{
+    if (CCtx == nullptr)
+    {
+        return;  // applied again in Open()
+    }
+    switch (SampleCfg.mode)
+    {
+        case DecodeSampleMode::KEY_FRAME:
+            CCtx->skip_frame = AVDISCARD_NONKEY;
+            break;
+        case DecodeSampleMode::FPS:
+            // nobody references a non-reference frame, so when we keep at most every other frame the codec may
+            // drop them without decoding; the timestamp sampler then picks among the remaining frames
+            CCtx->skip_frame = (StreamFps > 0.0 and SampleCfg.fps * 2 <= StreamFps) ? AVDISCARD_NONREF
+                                                                                     : AVDISCARD_DEFAULT;
+            break;
+        default:
+            // STRIDE counts frames, every frame must come out of the codec to keep the numbering exact
+            CCtx->skip_frame = AVDISCARD_DEFAULT;
+            break;
+    }
 }
 
-cv::Mat DecoderNode::TryFlushing()
+std::uint64_t DecoderNode::GetFrameNumber(const AVFrame *frame) const
 {
-    if (not NeedFlushing)
+    // when the codec skips frames or the decoding started after a seek, the decoded count no longer matches the
+    // source, use the timestamp instead
+    auto number = GetPtsNumber(frame->best_effort_timestamp);
+    if ((CCtx->skip_frame == AVDISCARD_DEFAULT and not TimestampNumbering) or number < 0)
     {
-        return cv::Mat();
+        return DecodedCount;
+    }
+    return static_cast<std::uint64_t>(number);
+}
+
+std::int64_t DecoderNode::GetPtsNumber(std::int64_t pts) const
+{
+    if (pts == AV_NOPTS_VALUE or StreamFps <= 0.0)
+    {
+        return -1;
     }
-    avcodec_send_packet(CCtx, NULL);
-    auto ret = avcodec_receive_frame(CCtx, Frame);
-    if (ret == AVERROR_EOF)
+    auto start = Ctx->streams[StreamIdx]->start_time;
+    pts -= start == AV_NOPTS_VALUE ? 0 : start;
+    return std::max<std::int64_t>(0, std::llround(pts * av_q2d(TimeBase) * StreamFps));
+}
+
+bool DecoderNode::NeedSample(const AVFrame *frame, std::uint64_t frame_number)
+{
+    switch (SampleCfg.mode)
     {
-        NeedFlushing = false;
-        VideoEOF     = true;
-        return cv::Mat();
+        case DecodeSampleMode::KEY_FRAME:
+            return frame->flags & AV_FRAME_FLAG_KEY;
+        case DecodeSampleMode::STRIDE:
+            return frame_number % SampleCfg.stride == 0;
+        case DecodeSampleMode::FPS:
+        {
+            double seconds  = frame->best_effort_timestamp != AV_NOPTS_VALUE
+                                  ? frame->best_effort_timestamp * av_q2d(TimeBase)
+                                  : (StreamFps > 0.0 ? frame_number / StreamFps : 0.0);
+            double interval = 1.0 / SampleCfg.fps;
+            // half a source frame of tolerance, or 30 -> 15 fps would drift by rounding
+            double tolerance = StreamFps > 0.0 ? 0.5 / StreamFps : 0.0;
+            if (seconds + tolerance < NextSampleTime)
+            {
+                return false;
+            }
+            // after a gap restart from the current frame instead of emitting a burst
+            NextSampleTime = std::max(NextSampleTime + interval, seconds + interval - tolerance);
+            return true;
+        }
+        default:
+            return true;
+    }
+}
+
+void DecoderNode::RecordKeyFrame(const AVPacket *pkt)
+{
+    if (not IndexRecording or not(pkt->flags & AV_PKT_FLAG_KEY))
+    {
+        return;
+    }
+    Index.push_back({pkt->pts, pkt->dts, pkt->pos, ReadCount});
+}
+
+std::span<const KeyFrameEntry> DecoderNode::GetKeyFrameIndex() const
+{
+    if (MappedIndex.IsOpen())
+    {
+        return MappedIndex.Entries();
+    }
+    return Index;
+}
+
+bool DecoderNode::Seek(std::uint64_t frame)
+{
+    if (Running)
+    {
+        LOGE("Seek must be called before Start()");
+        return false;
     }
-    if (ret == 0)
+    if (Ctx == nullptr or CCtx == nullptr)
     {
-        if (auto frame = DecodeToFrame(Frame); not frame.empty())
+        LOGE("DecoderNode is not opened");
+        return false;
+    }
+
+    std::int64_t  seek_ts  = AV_NOPTS_VALUE;
+    std::uint64_t base     = 0;
+    auto          index    = GetKeyFrameIndex();
+    const auto   *keyframe = FindKeyFrame(index, frame);
+    if (keyframe != nullptr and keyframe != index.data())
+    {
+        // frame_idx counts packets in decode order. in an open GOP the leading frames of a key frame come after it
+        // in decode order but are shown before it, and they can't be decoded from it: when frame is one of them, or
+        // the key frame pts is unknown and it may be, start one GOP earlier
+        auto number = GetPtsNumber(keyframe->pts);
+        if (number < 0 or static_cast<std::uint64_t>(number) > frame)
         {
-            return frame;
+            --keyframe;
         }
     }
-    return cv::Mat();
+    if (keyframe != nullptr)
+    {
+        seek_ts = keyframe->dts != AV_NOPTS_VALUE ? keyframe->dts : keyframe->pts;
+        base    = keyframe->frame_idx;
+        SeekPos = keyframe->pos;
+        // frames are numbered by pts, the packet count of the key frame is only the fallback without a frame rate
+        TimestampNumbering = StreamFps > 0.0;
+    }
+    else if (StreamFps > 0.0)
+    {
+        // no index covers the frame yet, seek by time and number frames by timestamp
+        auto start         = Ctx->streams[StreamIdx]->start_time;
+        seek_ts            = (start == AV_NOPTS_VALUE ? 0 : start) + std::llround(frame / StreamFps / av_q2d(TimeBase));
+        SeekPos            = -1;
+        TimestampNumbering = true;
+    }
+    else
+    {
+        LOGE("no key frame index and unknown frame rate, can't seek to frame [%lu]", frame);
+        return false;
+    }
+
+    if (auto ret = av_seek_frame(Ctx, StreamIdx, seek_ts, AVSEEK_FLAG_BACKWARD); ret < 0)
+    {
+        LOGE("av_seek_frame to [%ld] return [%d]", seek_ts, ret);
+        return false;
+    }
+    avcodec_flush_buffers(CCtx);
+    // the pass no longer starts at frame 0, the index built so far stays usable but is not saved
+    IndexRecording = false;
+    ReadCount      = base;
+    DecodedCount   = base;
+    SeekTarget     = frame;
+    RangeEnd       = std::numeric_limits<std::uint64_t>::max();
+    NextSampleTime = std::numeric_limits<double>::lowest();
+    VideoEOF       = false;
+    LOGD("seek to frame [%lu], start decoding at key frame [%lu]", frame, base);
+    return true;
+}
+
+bool DecoderNode::DecodeRange(std::uint64_t start, std::uint64_t end)
+{
+    if (start >= end)
+    {
+        LOGE("invalid range [%lu, %lu)", start, end);
+        return false;
+    }
+    if (not Seek(start))
+    {
+        return false;
+    }
+    RangeEnd = end;
+    return true;
+}
+
+void DecoderNode::PushPacket(const AVPacket *pkt)
+{
+    if (OutputList.size() < 2)
+    {
+        return;
+    }
+    // a new reference to the same buffer, no copy of the payload
+    std::shared_ptr<AVPacket> clone{av_packet_clone(pkt), [](AVPacket *p) { av_packet_free(&p); }};
+    if (clone == nullptr)
+    {
+        LOGW("av_packet_clone return nullptr");
+        return;
+    }
+    auto signal      = std::make_shared<SignalPacket>(std::move(clone), TimeBase.num, TimeBase.den);
+    signal->FrameIdx = ReadCount - 1;  // decode order
+    signal->TimeStamps.push_back(std::chrono::steady_clock::now());
+
+    OutputList[1]->Push(signal);
+}
+
+void DecoderNode::PushFrame(const cv::Mat &image, std::uint64_t frame_idx)
+{
+    auto signal      = std::make_shared<SignalImageBGR>(image);
+    signal->FrameIdx = frame_idx;
+    signal->TimeStamps.push_back(std::chrono::steady_clock::now());
+
+    OutputList[0]->Push(signal);
+}
+
+cv::Mat DecoderNode::DecodeToFrame(AVFrame *frame)
+{
+    cv::Mat image;
+    if (not Converter.ToBGR(frame, image))
+    {
+        return cv::Mat();
+    }
+    return image;
 }
 
 bool DecoderNode::Run()
 {
-    while (Running)
+    if (Source != nullptr)
     {
+        // a previous Stop() interrupted the reader, the demuxer saw that as an error and would stop at once
+        Source->Resume();
+        if (IOCtx != nullptr)
+        {
+            IOCtx->eof_reached = 0;
+            IOCtx->error       = 0;
+        }
+    }
+    PacketQue.Reset();
+    auto reader = std::async(std::launch::async, &DecoderNode::ReadPackets, this);
+    while (Running and not VideoEOF)
+    {
+        AVPacketPtr pkt;
+        if (not PacketQue.Pop(pkt, SleepTime))
+        {
+            continue;
+        }
         CostTimer.StartTimer();
-        auto frame = GetOneFrame();
+        DecodePacket(pkt.get());
         CostTimer.EndTimer();
-        if (frame.empty())
+        if (pkt == nullptr)
         {
-            LOGW("GetOneFrame return empty frame, exit !!");
-            break;
+            // flushed, whatever the decoder returned there is nothing left
+            VideoEOF = true;
         }
-        auto signal      = std::make_shared<SignalImageBGR>(frame);
-        signal->FrameIdx = FrameIndex++;
-        signal->TimeStamps.push_back(std::chrono::steady_clock::now());
-
-        OutputList[0]->Push(signal);
     }
+    if (VideoEOF)
+    {
+        LOGW("decoder reach end of stream, exit !!");
+    }
+    PacketQue.Close();
+    if (Source != nullptr)
+    {
+        Source->Interrupt();  // the reader may be waiting for bytes that never come, Run() resumes it
+    }
+    reader.wait();
     return true;
 }
 
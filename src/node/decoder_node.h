@@ -1,9 +1,17 @@
 #pragma once
 
+#include <limits>
+#include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
 
+#include "node/av_helper.h"
+#include "node/keyframe_index.h"
 #include "node/node_base.h"
+#include "node/stream_source.h"
+#include "node/sws_converter.h"
+#include "tools/queue.h"
 #include "tools/timer.h"
 
 extern "C"
@@ -17,6 +25,21 @@ extern "C"
 
 namespace cv_infer
 {
+enum class DecodeSampleMode
+{
+    ALL,        // output every frame
+    KEY_FRAME,  // key frames only, non-key packets never reach the codec
+    STRIDE,     // every Nth frame
+    FPS,        // resample to a target frame rate by timestamp
+};
+
+struct DecodeSampleCfg
+{
+    DecodeSampleMode mode   = DecodeSampleMode::ALL;
+    int              stride = 1;    // for STRIDE
+    double           fps    = 0.0;  // for FPS
+};
+
 class DecoderNode : public NodeBase
 {
 public:
@@ -26,39 +49,103 @@ public:
           URI(source){
 
           };
-    virtual ~DecoderNode() = default;
+    virtual ~DecoderNode()
+    {
+        Stop();
+        Close();
+    }
     bool         Init(const std::string& source);
+    // read encoded bytes from memory or a callback instead of a URI, name is only used in logs
+    bool         Init(std::shared_ptr<StreamSource> source, const std::string& name = "stream");
     virtual bool Run() override;
     virtual bool Worker() override { return true; };
 
+    // max packets buffered between the reader thread and the decode loop, set before Start()
+    void SetReadAheadSize(std::size_t size) { PacketQue.SetMaxSize(size); }
+    // frames not sampled are dropped right after decoding, they are never converted to BGR
+    bool SetSampleCfg(const DecodeSampleCfg& cfg);
+    // threads used by the YUV -> BGR conversion of each frame
+    void SetConvertThreads(int threads) { Converter.SetThreads(threads); }
+    // stream rate, valid after Init(), 0 when unknown
+    double GetFps() const { return StreamFps; }
+    // stream parameters for a remuxer, valid after Init()
+    const AVCodecParameters* GetCodecParameters() const
+    {
+        return Ctx == nullptr ? nullptr : Ctx->streams[StreamIdx]->codecpar;
+    }
+    AVRational GetTimeBase() const { return TimeBase; }
+    // also send every compressed packet of the stream, untouched, on a second output. set before binding
+    void SetForwardPackets(bool forward)
+    {
+        ForwardPackets = forward;
+        OutputCount    = forward ? 2 : 1;
+    }
+
+    // sidecar holding the key frame index, default is "<source>.kfi" for local files, empty disables it.
+    // an existing up-to-date sidecar is mapped in Init(), otherwise the index is written after the first full pass
+    void SetKeyFrameIndexFile(const std::string& path) { IndexFile = path; }
+    std::span<const KeyFrameEntry> GetKeyFrameIndex() const;
+
+    // jump to the key frame at or before frame and start the output at frame, call before Start()
+    bool Seek(std::uint64_t frame);
+    // output frames in [start, end) only, then stop
+    bool DecodeRange(std::uint64_t start, std::uint64_t end);
+
 private:
     bool                     Open();
     bool                     Close();
-    cv::Mat                  GetOneFrame();
+    bool                     ReadPackets();  // reader thread: av_read_frame -> PacketQue
+    bool                     DecodePacket(const AVPacket* pkt);
+    bool                     ReceiveFrames();
+    void                     PushFrame(const cv::Mat& image, std::uint64_t frame_idx);
+    void                     PushPacket(const AVPacket* pkt);
+    void                     RecordKeyFrame(const AVPacket* pkt);
+    void                     ApplySampleCfg();
+    bool                     NeedSample(const AVFrame* frame, std::uint64_t frame_number);
+    std::uint64_t            GetFrameNumber(const AVFrame* frame) const;
+    std::int64_t             GetPtsNumber(std::int64_t pts) const;  // -1 when the pts or the frame rate is unknown
     AVCodecContext*          GetAVCodecContext(int idx) const;
     int                      GetFirstStreamByType(enum AVMediaType type) const;
     std::vector<std::string> GetDecoderNameByCodecId(const AVCodecID codec_id) const;
     cv::Mat                  DecodeToFrame(AVFrame* frame);
-    cv::Mat                  TryFlushing();
 
 private:
     std::string URI;
 
+    std::shared_ptr<StreamSource> Source;
+    AVIOContext*                  IOCtx = nullptr;
+
     AVFormatContext* Ctx   = nullptr;
     AVCodecContext*  CCtx  = nullptr;
-    AVPacket*        Pkt   = nullptr;
     AVFrame*         Frame = nullptr;
-    SwsContext*      Sws   = nullptr;
+    SwsConverter     Converter;
+
+    int           StreamIdx    = 0;
+    int           Width        = 0;
+    int           Height       = 0;
+    int           ThreadNum    = 1;
+    std::uint64_t DecodedCount = 0;  // frames that came out of the codec, sampled or not
+    double        StreamFps    = 0.0;
+    AVRational    TimeBase{0, 1};
+
+    DecodeSampleCfg SampleCfg;
+    double          NextSampleTime = std::numeric_limits<double>::lowest();
+
+    std::optional<std::string> IndexFile;
+    MappedKeyFrameIndex        MappedIndex;
+    KeyFrameIndex              Index;                       // built by the reader thread on the first pass
+    bool                       IndexRecording     = true;   // only a full pass from the start is saved
+    std::uint64_t              ReadCount          = 0;      // video packets read, in decode order
+    std::int64_t               SeekPos            = -1;     // drop packets before this byte offset after a seek
+    bool                       TimestampNumbering = false;  // frame numbers from timestamps after a seek
+    std::uint64_t              SeekTarget         = 0;
+    std::uint64_t              RangeEnd           = std::numeric_limits<std::uint64_t>::max();
 
-    int           OutFlags   = SWS_BILINEAR;
-    int           StreamIdx  = 0;
-    int           Width      = 0;
-    int           Height     = 0;
-    int           ThreadNum  = 1;
-    std::uint64_t FrameIndex = 0;
+    bool VideoEOF       = false;
+    bool ForwardPackets = false;
 
-    bool NeedFlushing = false;
-    bool VideoEOF     = false;
+    // a null packet marks the end of the demuxer, the decode loop flushes the codec on it
+    BoundedQueue<AVPacketPtr> PacketQue{64};
 
     std::unordered_map<AVCodecID, std::vector<std::string>> DecodersPriority = {{AV_CODEC_ID_H264, {"h264"}}};
 
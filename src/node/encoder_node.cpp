@@ -1,6 +1,8 @@
 #include "encoder_node.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <thread>
 
 #include "signal/signal.h"
@@ -11,171 +13,257 @@ EncoderNode ::~EncoderNode()
 {
     if (not Close()) LOGE("Close failed");
 }
-bool EncoderNode::Init(const std::string &file_name)
+bool EncoderNode::Init(const std::string &file_name, double source_fps)
 {
     OutCfg cfg;
     cfg.out_url = file_name;
-    StartTime   = std::chrono::steady_clock::now();
-    return Open(cfg);
+    cfg.fps     = source_fps;
+    return Init(cfg);
 }
-bool EncoderNode::Open(const OutCfg &cfg)
+
+bool EncoderNode::Init(const OutCfg &cfg)
 {
-    if (auto ret = avformat_alloc_output_context2(&Ctx, nullptr, nullptr, cfg.out_url.c_str()); ret < 0)
+    if (cfg.out_url.empty())
     {
-        LOGE("avformat_alloc_output_context2 return [%d]", ret);
+        LOGE("out_url is empty");
         return false;
     }
-
-    auto codec = avcodec_find_encoder_by_name(cfg.codec.c_str());
-    if (codec == nullptr)
+    // only the segment muxer writes an index, fmp4 / hls would silently ignore it
+    if (cfg.format != OutFormat::SEGMENT and not cfg.segment_index.empty())
     {
-        LOGE("avcodec_find_encoder error");
+        LOGE("segment_index [%s] needs OutFormat::SEGMENT", cfg.segment_index.c_str());
         return false;
     }
+    Cfg       = cfg;
+    OutFile   = cfg.out_url;
+    StartTime = std::chrono::steady_clock::now();
+    if (Cfg.width > 0 and Cfg.height > 0)
+    {
+        return Open(Cfg);
+    }
+    LOGI("[%s] follows the geometry of the first frame, open it then", OutFile.c_str());
+    return true;
+}
 
-    if (St = avformat_new_stream(Ctx, nullptr); St == nullptr)
+bool EncoderNode::OpenEncoder(const OutCfg &cfg, const std::string &name)
+{
+    auto codec = avcodec_find_encoder_by_name(name.c_str());
+    if (codec == nullptr)
     {
-        LOGE("avformat_new_stream return nullptr");
+        LOGT("encoder [%s] not found", name.c_str());
         return false;
     }
-    St->id = Ctx->nb_streams - 1;
-    if (CCtx = avcodec_alloc_context3(codec); CCtx == nullptr)
+    auto *cctx = avcodec_alloc_context3(codec);
+    if (cctx == nullptr)
     {
         LOGE("avcodec_alloc_context3 return nullptr");
         return false;
     }
-    if (Pkt = av_packet_alloc(); Pkt == nullptr)
+
+    if (cfg.fps <= 0.0)
     {
-        LOGE("av_packet_alloc return nullptr");
-        return false;
+        LOGW("source fps is unknown, use 30");
     }
-    if (Frame = av_frame_alloc(); Frame == nullptr)
+    auto rate          = av_d2q(cfg.fps > 0.0 ? cfg.fps : 30.0, 100000);
+    cctx->codec_id     = codec->id;
+    cctx->bit_rate     = cfg.bit_rate;
+    cctx->width        = cfg.width;
+    cctx->height       = cfg.height;
+    cctx->time_base    = av_inv_q(rate);
+    cctx->framerate    = rate;
+    cctx->pix_fmt      = AV_PIX_FMT_YUV420P;
+    cctx->thread_count = cfg.threads;
+    if (Ctx->oformat->flags & AVFMT_GLOBALHEADER) cctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    AVDictionary *opt = nullptr;
+    for (auto &o : cfg.opt)
     {
-        LOGE("av_frame_alloc return nullptr");
-        return false;
+        av_dict_set(&opt, o.first.c_str(), o.second.c_str(), 0);
     }
+    if (not cfg.preset.empty()) av_dict_set(&opt, "preset", cfg.preset.c_str(), 0);
+    if (not cfg.tune.empty()) av_dict_set(&opt, "tune", cfg.tune.c_str(), 0);
+    // forced key frames must be IDR for a segment to decode on its own
+    if (cfg.format != OutFormat::FILE) av_dict_set(&opt, "forced-idr", "1", 0);
+    std::unique_ptr<AVDictionary *, decltype(av_dict_free) *> up_opt{&opt, av_dict_free};
 
-    Frame->width  = cfg.width;
-    Frame->height = cfg.height;
-    Frame->format = AVPixelFormat::AV_PIX_FMT_YUV420P;
-    Frame->pts    = 0;
-    if (auto r = av_frame_get_buffer(Frame, 0); r != 0)
+    // hardware encoders are found on every build but only open where the device exists
+    if (auto r = avcodec_open2(cctx, codec, &opt); r != 0)
     {
-        LOGE("av_frame_get_buffer return [%d]", r);
+        LOGW("open encoder [%s] return [%d]", name.c_str(), r);
+        avcodec_free_context(&cctx);
         return false;
     }
-    if (auto r = av_frame_make_writable(Frame); r != 0)
+    CCtx        = cctx;
+    EncoderName = name;
+    LOGI("use encoder [%s], [%dx%d] @ [%d/%d] fps, threads = [%d]", name.c_str(), cfg.width, cfg.height, rate.num,
+         rate.den, CCtx->thread_count);
+    return true;
+}
+
+bool EncoderNode::Open(const OutCfg &cfg)
+{
+    const char *format_name = nullptr;
+    if (cfg.format == OutFormat::HLS)
     {
-        LOGE("av_frame_make_writable return [%d]", r);
-        return false;
+        format_name = "hls";
     }
-
-    CCtx->codec_id  = codec->id;
-    CCtx->bit_rate  = cfg.bit_rate;
-    CCtx->width     = cfg.width;
-    CCtx->height    = cfg.height;
-    CCtx->time_base = AVRational{1, cfg.fps};
-    CCtx->pix_fmt   = AV_PIX_FMT_YUV420P;
-    if (Ctx->oformat->flags & AVFMT_GLOBALHEADER) CCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-
-    AVDictionary *opt = nullptr;
-    for (auto &o : cfg.opt)
+    else if (cfg.format == OutFormat::SEGMENT)
     {
-        av_dict_set(&opt, o.first.c_str(), o.second.c_str(), 0);
+        format_name = "segment";
     }
-    std::unique_ptr<AVDictionary *, decltype(av_dict_free) *> up_opt{&opt, av_dict_free};
-
-    if (auto r = avcodec_open2(CCtx, codec, &opt); r != 0)
+    else if (cfg.format == OutFormat::FMP4)
+    {
+        format_name = "mp4";
+    }
+    if (auto ret = avformat_alloc_output_context2(&Ctx, nullptr, format_name, cfg.out_url.c_str()); ret < 0)
     {
-        LOGE("avcodec_open2 return [%d]", r);
+        LOGE("avformat_alloc_output_context2 return [%d]", ret);
         return false;
     }
-    if (auto r = avcodec_parameters_from_context(St->codecpar, CCtx); r != 0)
+
+    if (St = avformat_new_stream(Ctx, nullptr); St == nullptr)
     {
-        LOGE("avcodec_parameters_from_context return [%d]", r);
+        LOGE("avformat_new_stream return nullptr");
         return false;
     }
+    St->id = Ctx->nb_streams - 1;
 
-    Sws = sws_alloc_context();
-    if (Sws == nullptr)
+    auto encoders = cfg.codec.empty() ? EncodersPriority : std::vector<std::string>{cfg.codec};
+    for (const auto &name : encoders)
+    {
+        if (OpenEncoder(cfg, name))
+        {
+            break;
+        }
+    }
+    if (CCtx == nullptr)
     {
-        LOGE("call sws_alloc_context return nullptr");
+        LOGE("no usable encoder for [%s]", cfg.out_url.c_str());
         return false;
     }
 
-    av_dump_format(Ctx, 0, Ctx->url, 1);
+    FramePool.clear();
+    for (std::size_t i = 0; i < FramePoolSize; ++i)
+    {
+        AVFramePtr frame{av_frame_alloc()};
+        if (frame == nullptr)
+        {
+            LOGE("av_frame_alloc return nullptr");
+            return false;
+        }
+        frame->width  = CCtx->width;
+        frame->height = CCtx->height;
+        frame->format = CCtx->pix_fmt;
+        if (auto r = av_frame_get_buffer(frame.get(), 0); r != 0)
+        {
+            LOGE("av_frame_get_buffer return [%d]", r);
+            return false;
+        }
+        FramePool.emplace_back(std::move(frame));
+    }
+    FrameSlot  = 0;
+    NextPts    = 0;
+    NextKeyPts = 0;
 
-    if (auto r = avio_open(&Ctx->pb, Ctx->url, AVIO_FLAG_WRITE); r != 0)
+    if (auto r = avcodec_parameters_from_context(St->codecpar, CCtx); r != 0)
     {
-        LOGE("avio_open return [%d]", r);
+        LOGE("avcodec_parameters_from_context return [%d]", r);
         return false;
     }
+    St->time_base = CCtx->time_base;
+
+    av_dump_format(Ctx, 0, Ctx->url, 1);
 
-    if (auto r = avformat_write_header(Ctx, &opt); r != 0)
+    if (not OpenMuxer(cfg))
     {
-        LOGE("avformat_write_header return [%d]", r);
         return false;
     }
 
     NeedTailer = true;
-    IsReady    = true;
+    PacketQue.Reset();
+    Muxer   = std::async(std::launch::async, &EncoderNode::MuxPackets, this);
+    IsReady = true;
     return true;
 }
-bool EncoderNode::FlushingEncodec()
+bool EncoderNode::OpenMuxer(const OutCfg &cfg)
 {
-    avcodec_send_frame(CCtx, NULL);
-    while (true)
+    AVDictionary *opt = nullptr;
+    std::unique_ptr<AVDictionary *, decltype(av_dict_free) *> up_opt{&opt, av_dict_free};
+
+    auto seconds = std::to_string(cfg.segment_seconds);
+    auto keep    = std::to_string(cfg.segment_keep);
+    switch (cfg.format)
     {
-        auto r = avcodec_receive_packet(CCtx, Pkt);
-        if (r == AVERROR_EOF)
-        {
+        case OutFormat::FMP4:
+            av_dict_set(&opt, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
             break;
-        }
-        else if (r == AVERROR(EAGAIN))
-        {
-            continue;
-        }
-        std::unique_ptr<AVPacket, decltype(av_packet_unref) *> unref_guard{Pkt, av_packet_unref};
-
-        av_packet_rescale_ts(Pkt, CCtx->time_base, St->time_base);
-        Pkt->stream_index = St->index;
-        if (r = av_write_frame(Ctx, Pkt); r < 0)
+        case OutFormat::HLS:
+            av_dict_set(&opt, "hls_time", seconds.c_str(), 0);
+            av_dict_set(&opt, "hls_segment_type", "fmp4", 0);
+            av_dict_set(&opt, "hls_list_size", keep.c_str(), 0);
+            // segments that fell out of the playlist are deleted from disk
+            av_dict_set(&opt, "hls_flags",
+                        cfg.segment_keep > 0 ? "delete_segments+independent_segments" : "independent_segments", 0);
+            if (cfg.segment_keep == 0) av_dict_set(&opt, "hls_playlist_type", "event", 0);
+            break;
+        case OutFormat::SEGMENT:
         {
-            LOGE("av_write_frame return [%d]", r);
+            auto index = cfg.segment_index.empty() ? cfg.out_url + ".csv" : cfg.segment_index;
+            av_dict_set(&opt, "segment_time", seconds.c_str(), 0);
+            av_dict_set(&opt, "segment_format", "mp4", 0);
+            av_dict_set(&opt, "segment_list", index.c_str(), 0);
+            av_dict_set(&opt, "segment_list_type", "csv", 0);
+            av_dict_set(&opt, "segment_list_size", keep.c_str(), 0);
+            // file names are reused in a ring, older segments are overwritten
+            if (cfg.segment_keep > 0) av_dict_set(&opt, "segment_wrap", keep.c_str(), 0);
             break;
         }
+        default:
+            break;
+    }
+    for (auto &o : cfg.mux_opt)
+    {
+        av_dict_set(&opt, o.first.c_str(), o.second.c_str(), 0);
     }
-    return true;
-}
 
-bool EncoderNode::PushOneFrame(const cv::Mat &image)
-{
-    if (not IsReady)
+    // hls / segment open their files themselves
+    if (not(Ctx->oformat->flags & AVFMT_NOFILE))
     {
-        LOGW("not ready!");
-        return false;
+        if (auto r = avio_open(&Ctx->pb, Ctx->url, AVIO_FLAG_WRITE); r != 0)
+        {
+            LOGE("avio_open return [%d]", r);
+            return false;
+        }
     }
-    Sws =
-        sws_getCachedContext(Sws, image.cols, image.rows, AVPixelFormat::AV_PIX_FMT_BGR24, Frame->width, Frame->height,
-                             static_cast<AVPixelFormat>(Frame->format), OutFlags, nullptr, nullptr, nullptr);
-    if (Sws == nullptr)
+    if (auto r = avformat_write_header(Ctx, &opt); r < 0)
     {
-        LOGW("sws is nullptr");
+        LOGE("avformat_write_header return [%d]", r);
         return false;
     }
+    return true;
+}
 
-    int linesizes[1]{};
-    linesizes[0] = image.step1();
-    sws_scale(Sws, &image.data, linesizes, 0, image.rows, Frame->data, Frame->linesize);
-    if (auto r = avcodec_send_frame(CCtx, Frame); r != 0)
+bool EncoderNode::FlushingEncodec()
+{
+    if (auto r = avcodec_send_frame(CCtx, nullptr); r != 0)
     {
-        LOGW("avcodec_send_frame return [%d]", r);
+        LOGW("avcodec_send_frame(nullptr) return [%d]", r);
         return false;
     }
-    ++Frame->pts;
+    return ReceivePackets();
+}
+
+bool EncoderNode::ReceivePackets()
+{
     while (true)
     {
-        auto r = avcodec_receive_packet(CCtx, Pkt);
+        AVPacketPtr pkt{av_packet_alloc()};
+        if (pkt == nullptr)
+        {
+            LOGE("av_packet_alloc return nullptr");
+            return false;
+        }
+        auto r = avcodec_receive_packet(CCtx, pkt.get());
         if (r == AVERROR(EAGAIN) || r == AVERROR_EOF)
         {
             break;
@@ -185,38 +273,112 @@ bool EncoderNode::PushOneFrame(const cv::Mat &image)
             LOGW("avcodec_receive_packet return [%d]", r);
             return false;
         }
-        std::unique_ptr<AVPacket, decltype(av_packet_unref) *> unref_guard{Pkt, av_packet_unref};
-
-        av_packet_rescale_ts(Pkt, CCtx->time_base, St->time_base);
-        Pkt->stream_index = St->index;
-        if (r = av_write_frame(Ctx, Pkt); r < 0)
+        av_packet_rescale_ts(pkt.get(), CCtx->time_base, St->time_base);
+        pkt->stream_index = St->index;
+        // block while the muxer is behind, the queue only closes once the muxer is gone
+        while (not PacketQue.Push(std::move(pkt), SleepTime))
         {
-            LOGW("av_write_frame return [%d]", r);
-            return false;
+            if (PacketQue.IsClosed())
+            {
+                return false;
+            }
         }
     }
-
     return true;
 }
 
-bool EncoderNode::Close()
+bool EncoderNode::MuxPackets()
 {
-    if (CCtx != nullptr) FlushingEncodec();
-    IsReady = false;
+    bool ok = true;
+    while (true)
+    {
+        AVPacketPtr pkt;
+        if (not PacketQue.Pop(pkt, SleepTime))
+        {
+            if (PacketQue.IsClosed())
+            {
+                break;  // closed and drained
+            }
+            continue;
+        }
+        if (not ok)
+        {
+            continue;  // keep draining so the encoder side never blocks
+        }
+        if (auto r = av_write_frame(Ctx, pkt.get()); r < 0)
+        {
+            LOGE("av_write_frame return [%d], drop the rest of [%s]", r, OutFile.c_str());
+            ok = false;
+        }
+    }
+    return ok;
+}
 
-    if (Sws != nullptr)
+bool EncoderNode::PushOneFrame(const cv::Mat &image)
+{
+    if (not IsReady)
     {
-        sws_freeContext(Sws);
-        Sws = nullptr;
+        if (Ctx != nullptr)
+        {
+            LOGW("not ready!");  // open failed before, don't retry on every frame
+            return false;
+        }
+        // yuv420p needs even sizes, an odd source loses its last row/column in the rescale
+        Cfg.width  = Cfg.width > 0 ? Cfg.width : image.cols & ~1;
+        Cfg.height = Cfg.height > 0 ? Cfg.height : image.rows & ~1;
+        if (not Open(Cfg))
+        {
+            LOGE("open [%s] failed", OutFile.c_str());
+            return false;
+        }
     }
-    if (Frame != nullptr)
+    // the encoder keeps a reference to frames it has not finished, round-robin over the pool lets it work on
+    // frame N while frame N+1 is converted. make_writable only copies when the whole pool is still in use
+    auto *frame = FramePool[FrameSlot++ % FramePool.size()].get();
+    if (not av_frame_is_writable(frame))
     {
-        av_frame_free(&Frame);
+        LOGD("frame pool of [%zu] exhausted, copy a frame", FramePool.size());
     }
-    if (Pkt != nullptr)
+    if (auto r = av_frame_make_writable(frame); r != 0)
+    {
+        LOGW("av_frame_make_writable return [%d]", r);
+        return false;
+    }
+    if (not Converter.FromBGR(image, frame))
+    {
+        LOGW("convert BGR frame failed");
+        return false;
+    }
+    frame->pts       = NextPts++;
+    frame->pict_type = AV_PICTURE_TYPE_NONE;  // pooled frames keep the value of their last use
+    if (Cfg.format != OutFormat::FILE and frame->pts >= NextKeyPts)
+    {
+        // every segment / fragment has to start with a key frame, don't wait for the codec's gop
+        frame->pict_type = AV_PICTURE_TYPE_I;
+        auto interval    = std::llround(Cfg.segment_seconds / av_q2d(CCtx->time_base));
+        NextKeyPts       = frame->pts + std::max<int64_t>(1, interval);
+    }
+    if (auto r = avcodec_send_frame(CCtx, frame); r != 0)
+    {
+        LOGW("avcodec_send_frame return [%d]", r);
+        return false;
+    }
+    return ReceivePackets();
+}
+
+bool EncoderNode::Close()
+{
+    if (IsReady) FlushingEncodec();
+    IsReady = false;
+
+    // the muxer writes what is left in the queue, then the trailer can go
+    PacketQue.Close();
+    if (Muxer.valid() and not Muxer.get())
     {
-        av_packet_free(&Pkt);
+        LOGW("muxer of [%s] stopped early", OutFile.c_str());
     }
+    Converter.Reset();
+    FramePool.clear();
     if (NeedTailer)
     {
         av_write_trailer(Ctx);
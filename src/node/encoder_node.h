@@ -1,8 +1,14 @@
 #pragma once
 
 #include <chrono>
+#include <future>
+#include <unordered_map>
+#include <vector>
 
+#include "node/av_helper.h"
 #include "node/node_base.h"
+#include "node/sws_converter.h"
+#include "tools/queue.h"
 #include "tools/timer.h"
 
 extern "C"
@@ -16,34 +22,70 @@ extern "C"
 
 namespace cv_infer
 {
+enum class OutFormat
+{
+    FILE,     // one file, guessed from out_url, the trailer is written in Close()
+    FMP4,     // one fragmented mp4, every fragment starts at a key frame and stays readable after a crash
+    HLS,      // out_url is the m3u8 playlist, fmp4 segments next to it
+    SEGMENT,  // out_url is a pattern like "rec_%05d.mp4", segment_index lists "file,start,end" per segment
+};
+
 struct OutCfg
 {
     std::string                                  out_url;
-    std::string                                  codec    = "h264_nvenc";
+    std::string                                  codec    = "";   // empty: first of EncodersPriority that opens
     int                                          bit_rate = 8000000;
-    int                                          width    = 1920;
-    int                                          height   = 1080;
-    int                                          fps      = 30;
-    std::unordered_map<std::string, std::string> opt      = {{"preset", "medium"}, {"profile", "main"}, {"crf", "18"}};
+    int                                          width    = 0;    // 0: follow the first frame, no rescaling
+    int                                          height   = 0;
+    double                                       fps      = 0.0;  // 0: unknown source rate, 30 is used
+    int                                          threads  = 0;    // encoder threads, 0: let the codec decide
+    std::string                                  preset   = "medium";
+    std::string                                  tune     = "";
+    std::unordered_map<std::string, std::string> opt      = {{"profile", "main"}, {"crf", "18"}};
+
+    // segmented output, a key frame is forced every segment_seconds so segments cut exactly there
+    OutFormat                                    format          = OutFormat::FILE;
+    double                                       segment_seconds = 6.0;
+    int                                          segment_keep    = 0;   // 0: keep all, N: rolling window of N segments
+    std::string                                  segment_index   = "";  // SEGMENT only, empty: "<out_url>.csv"
+    std::unordered_map<std::string, std::string> mux_opt;               // passed to avformat_write_header as is
 };
 class EncoderNode : public NodeBase
 {
 public:
-    EncoderNode() : NodeBase(1, 0) { SetName("Decoder"); }
+    EncoderNode() : NodeBase(1, 0) { SetName("Encoder"); }
     EncoderNode(const std::string &file_name)
         : NodeBase(1, 0),
           OutFile(file_name){
 
           };
     virtual ~EncoderNode();
-    bool         Init(const std::string &file_name);
+    // default OutCfg, geometry from the first frame, fps from the source (e.g. DecoderNode::GetFps())
+    bool         Init(const std::string &file_name, double source_fps = 0.0);
+    bool         Init(const OutCfg &cfg);
+    // flushes and closes the codec and the muxer, Init() opens them again
+    bool         Close();
     virtual bool Run() override;
     virtual bool Worker() override { return true; };
 
+    // threads used by the BGR -> YUV conversion of each frame
+    void SetConvertThreads(int threads) { Converter.SetThreads(threads); }
+    // frames converted round-robin, the encoder keeps a reference to the ones still being encoded. set before Init()
+    void SetFramePoolSize(std::size_t size) { FramePoolSize = size == 0 ? 1 : size; }
+    // max encoded packets waiting for the muxer thread
+    void SetMuxQueueSize(std::size_t size) { PacketQue.SetMaxSize(size); }
+    // h264 encoders tried in order when OutCfg::codec is empty. set before Init()
+    void SetEncodersPriority(const std::vector<std::string> &names) { EncodersPriority = names; }
+    // the encoder that opened, empty until the first frame when the geometry follows it
+    const std::string &GetEncoderName() const { return EncoderName; }
+
 private:
     bool Open(const OutCfg &cfg);
-    bool Close();
+    bool OpenEncoder(const OutCfg &cfg, const std::string &name);
+    bool OpenMuxer(const OutCfg &cfg);
     bool PushOneFrame(const cv::Mat &frame);
+    bool ReceivePackets();  // avcodec_receive_packet -> PacketQue
+    bool MuxPackets();      // muxer thread: PacketQue -> av_write_frame
 
     bool IsReady    = false;
     bool NeedTailer = false;
@@ -51,11 +93,21 @@ private:
     AVFormatContext *Ctx      = nullptr;
     AVStream        *St       = nullptr;
     AVCodecContext  *CCtx     = nullptr;
-    AVPacket        *Pkt      = nullptr;
-    AVFrame         *Frame    = nullptr;
-    SwsContext      *Sws      = nullptr;
-    int              OutFlags = SWS_BILINEAR;
+    SwsConverter     Converter;
     std::string      OutFile;
+    OutCfg           Cfg;
+
+    // h264 encoders tried in order when OutCfg::codec is empty, hardware first
+    std::vector<std::string> EncodersPriority = {"h264_nvenc", "libx264", "libopenh264"};
+    std::string              EncoderName;
+
+    std::vector<AVFramePtr>   FramePool;
+    std::size_t               FramePoolSize = 4;
+    std::size_t               FrameSlot     = 0;
+    int64_t                   NextPts       = 0;
+    int64_t                   NextKeyPts    = 0;  // forced key frame of the next segment, codec time base
+    BoundedQueue<AVPacketPtr> PacketQue{64};
+    std::future<bool>         Muxer;
 
     bool  FlushingEncodec();
     Timer CostTimer{"encoder", true};
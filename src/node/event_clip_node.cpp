@@ -0,0 +1,173 @@
+#include "event_clip_node.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "tools/logger.h"
+
+namespace cv_infer
+{
+void GopRing::SetLimits(double pre_seconds, std::size_t max_bytes)
+{
+    PreSeconds = pre_seconds;
+    MaxBytes   = max_bytes;
+    Trim();
+}
+
+void GopRing::Append(const PacketRef &packet, double time)
+{
+    const auto *pkt = packet->Val.get();
+    NewestTime      = std::max(NewestTime, time);
+    if (pkt->flags & AV_PKT_FLAG_KEY)
+    {
+        Gops.push_back(Gop{{}, time, 0});
+    }
+    else if (Gops.empty())
+    {
+        return;  // a clip can't start before the first key frame
+    }
+    Gops.back().packets.push_back(packet);
+    Gops.back().bytes += pkt->size;
+    Bytes += pkt->size;
+    Trim();
+}
+
+void GopRing::Trim()
+{
+    // the oldest GOP goes once the next one alone still covers pre_seconds, or the ring is over its cap
+    while (Gops.size() > 1 and (Gops[1].start <= NewestTime - PreSeconds or Bytes > MaxBytes))
+    {
+        Bytes -= Gops.front().bytes;
+        Gops.pop_front();
+    }
+}
+
+EventClipNode::~EventClipNode()
+{
+    Stop();
+    FinishClip();
+    avcodec_parameters_free(&Par);
+}
+
+bool EventClipNode::Init(const ClipCfg &cfg, const AVCodecParameters *par, AVRational time_base)
+{
+    if (cfg.out_prefix.empty() or par == nullptr)
+    {
+        LOGE("out_prefix is empty or codec parameters is nullptr");
+        return false;
+    }
+    if (cfg.pre_seconds < 0.0 or cfg.post_seconds < 0.0)
+    {
+        LOGE("invalid clip window, pre = [%f], post = [%f]", cfg.pre_seconds, cfg.post_seconds);
+        return false;
+    }
+    // the decoder may be closed before the last clip is written, keep our own copy
+    avcodec_parameters_free(&Par);
+    if (Par = avcodec_parameters_alloc(); Par == nullptr)
+    {
+        LOGE("avcodec_parameters_alloc return nullptr");
+        return false;
+    }
+    if (auto r = avcodec_parameters_copy(Par, par); r < 0)
+    {
+        LOGE("avcodec_parameters_copy return [%d]", r);
+        return false;
+    }
+    Cfg      = cfg;
+    TimeBase = time_base;
+    Ring.SetLimits(cfg.pre_seconds, cfg.max_buffer_bytes);
+    return true;
+}
+
+void EventClipNode::Trigger(const std::string &reason)
+{
+    LOGI("event [%s] triggered a clip", reason.c_str());
+    ++PendingTriggers;
+}
+
+EventCallbackFunc EventClipNode::GetTrigger()
+{
+    return [this](const char *msg) { Trigger(msg == nullptr ? "" : msg); };
+}
+
+double EventClipNode::PacketTime(const SignalPacket &packet) const
+{
+    const auto *pkt = packet.Val.get();
+    auto        ts  = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    if (ts == AV_NOPTS_VALUE or packet.TimeBaseDen == 0)
+    {
+        return Ring.GetNewestTime();
+    }
+    return ts * av_q2d(AVRational{packet.TimeBaseNum, packet.TimeBaseDen});
+}
+
+bool EventClipNode::StartClip()
+{
+    auto url = Cfg.out_prefix + "_" + std::to_string(ClipCount) + ".mp4";
+    if (not Clip.Open(url, Par, TimeBase, true))
+    {
+        LOGE("open clip [%s] failed", url.c_str());
+        return false;
+    }
+    ++ClipCount;
+    ClipEnd = Ring.GetNewestTime() + Cfg.post_seconds;
+    for (const auto &gop : Ring.GetGops())
+    {
+        for (const auto &packet : gop.packets)
+        {
+            Clip.Write(packet->Val.get(), AVRational{packet->TimeBaseNum, packet->TimeBaseDen});
+        }
+    }
+    LOGI("clip [%s] starts [%f] s before the event", url.c_str(),
+         Ring.Empty() ? 0.0 : Ring.GetNewestTime() - Ring.GetGops().front().start);
+    return true;
+}
+
+void EventClipNode::FinishClip() { Clip.Close(); }
+
+bool EventClipNode::Run()
+{
+    while (Running)
+    {
+        if (PendingTriggers.exchange(0) > 0)
+        {
+            if (Clip.IsOpen())
+            {
+                ClipEnd = Ring.GetNewestTime() + Cfg.post_seconds;  // extend the running clip
+            }
+            else if (Ring.Empty())
+            {
+                ++PendingTriggers;  // wait for the first key frame
+            }
+            else
+            {
+                StartClip();
+            }
+        }
+
+        SignalBasePtr signal;
+        if (not InputList[0]->Pop(signal))
+        {
+            std::this_thread::sleep_for(SleepTime);
+            continue;
+        }
+        if (signal->GetSignalType() != SignalType::SIGNAL_PACKET)
+        {
+            LOGE("EventClipNode::Run() input_signal->GetSignalType() != SignalType::SIGNAL_PACKET");
+            continue;
+        }
+        auto packet = std::static_pointer_cast<SignalPacket>(signal);
+        Ring.Append(packet, PacketTime(*packet));
+        if (Clip.IsOpen())
+        {
+            Clip.Write(packet->Val.get(), AVRational{packet->TimeBaseNum, packet->TimeBaseDen});
+            if (Ring.GetNewestTime() >= ClipEnd)
+            {
+                FinishClip();
+            }
+        }
+    }
+    return true;
+}
+}  // namespace cv_infer
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "node/node_base.h"
+#include "node/packet_writer.h"
+#include "signal/signal.h"
+#include "tools/defines.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+namespace cv_infer
+{
+struct ClipCfg
+{
+    std::string out_prefix;                            // clips are written to "<out_prefix>_<n>.mp4"
+    double      pre_seconds      = 10.0;               // kept before the event, rounded down to a key frame
+    double      post_seconds     = 5.0;                // written after the last event of a clip
+    std::size_t max_buffer_bytes = 32 * 1024 * 1024;  // hard cap of the ring, whole GOPs are dropped first
+};
+
+// 事件前的压缩包缓存, 按 GOP 存放, 总是从关键帧开始
+// 1. 下一个 GOP 单独已覆盖 pre_seconds 时丢弃最老的 GOP
+// 2. 超过 max_bytes 时整个丢弃最老的 GOP, 最新的 GOP 总是保留
+class GopRing
+{
+public:
+    using PacketRef = std::shared_ptr<SignalPacket>;
+    struct Gop
+    {
+        std::vector<PacketRef> packets;
+        double                 start = 0.0;  // seconds of the key frame
+        std::size_t            bytes = 0;
+    };
+
+    void SetLimits(double pre_seconds, std::size_t max_bytes);
+    // time: seconds of the packet, packets before the first key frame are dropped
+    void Append(const PacketRef &packet, double time);
+
+    const std::deque<Gop> &GetGops() const { return Gops; }
+    bool                   Empty() const { return Gops.empty(); }
+    double                 GetNewestTime() const { return NewestTime; }
+    std::size_t            GetBytes() const { return Bytes; }  // thread safe
+
+private:
+    void Trim();
+
+    double                   PreSeconds = 10.0;
+    std::size_t              MaxBytes   = 32 * 1024 * 1024;
+    std::deque<Gop>          Gops;
+    std::atomic<std::size_t> Bytes{0};
+    double                   NewestTime = 0.0;
+};
+
+// 事件片段: 缓存最近 pre_seconds 的压缩包 (从关键帧开始), 触发事件后不解码不编码, 直接封装成 clip
+// 1. input 0: SignalPacket, DecoderNode::SetForwardPackets(true), bind with PipelineBase::Bind(decoder, clip)
+// 2. 触发: pipeline->RegisterCallback(EventId::EventTriggered, clip->GetTrigger()), 与已有的回调共存, 再 Notify(...)
+// 3. clip 写出期间的新事件会延长 clip, 不会生成新文件
+class EventClipNode : public NodeBase
+{
+public:
+    EventClipNode() : NodeBase(1, 0) { SetName("EventClip"); }
+    virtual ~EventClipNode();
+
+    // par / time_base of the source, e.g. DecoderNode::GetCodecParameters() / GetTimeBase()
+    bool         Init(const ClipCfg &cfg, const AVCodecParameters *par, AVRational time_base);
+    virtual bool Run() override;
+    virtual bool Worker() override { return true; };
+
+    // thread safe, the clip starts on the node's thread with the next packet
+    void              Trigger(const std::string &reason);
+    EventCallbackFunc GetTrigger();
+
+    std::size_t GetBufferBytes() const { return Ring.GetBytes(); }
+
+private:
+    bool   StartClip();
+    void   FinishClip();
+    double PacketTime(const SignalPacket &packet) const;
+
+    ClipCfg            Cfg;
+    AVCodecParameters *Par = nullptr;
+    AVRational         TimeBase{0, 1};
+    GopRing            Ring;
+
+    std::atomic<int> PendingTriggers{0};
+    PacketWriter     Clip;
+    double           ClipEnd   = 0.0;
+    std::uint64_t    ClipCount = 0;
+};
+}  // namespace cv_infer
@@ -1,15 +1,25 @@
 #include "image_loader.h"
 
+#include <cstring>
+#include <deque>
 #include <filesystem>
+#include <fstream>
+#include <future>
+#include <thread>
 
 #include "signal/signal.h"
 #include "tools/logger.h"
+#include "tools/threadpool.h"
 
 namespace cv_infer
 {
-ImageLoader::ImageLoader() : NodeBase(0, 1) { SetName("ImageLoader"); }
+ImageLoader::ImageLoader() : NodeBase(0, 1)
+{
+    SetName("ImageLoader");
+    WorkerNum = std::clamp(static_cast<int>(std::thread::hardware_concurrency()), 1, 255);
+}
 
-ImageLoader::~ImageLoader() {}
+ImageLoader::~ImageLoader() { Stop(); }
 
 bool ImageLoader::Init(const std::string &src)
 {
@@ -18,40 +28,290 @@ bool ImageLoader::Init(const std::string &src)
         LOGE("src is empty");
         return false;
     }
-    if (std::filesystem::is_empty(src))
+    Src = src;
+    Files.clear();
+    Pack.Close();
+    if (std::filesystem::is_regular_file(src) and IsImagePack(src))
+    {
+        if (not Pack.Open(src))
+        {
+            return false;
+        }
+        LOGI("src is an image pack, [%zu] images", Pack.Size());
+        return Pack.Size() > 0;
+    }
+    if (not ListFiles(src, Files))
     {
-        LOGE("src is empty");
         return false;
     }
-    if (std::filesystem::is_directory(src))
+    if (Files.empty())
     {
-        IsDirectory = true;
-        LOGI("src is a directory");
+        LOGE("no image in [%s]", src.c_str());
+        return false;
     }
-    Src = src;
+    LOGI("[%s]: [%zu] files", src.c_str(), Files.size());
     return true;
 }
-bool ImageLoader::Run()
+
+bool ImageLoader::ListFiles(const std::string &src, std::vector<std::string> &files)
+{
+    std::error_code ec;
+    if (not std::filesystem::exists(src, ec))
+    {
+        LOGE("src [%s] not exists", src.c_str());
+        return false;
+    }
+    files.clear();
+    if (std::filesystem::is_directory(src, ec))
+    {
+        for (const auto &entry : std::filesystem::directory_iterator(src, ec))
+        {
+            if (entry.is_regular_file())
+            {
+                files.push_back(entry.path().string());
+            }
+        }
+        // directory_iterator has no order, sort so FrameIdx is the same on every run
+        std::sort(files.begin(), files.end());
+        return true;
+    }
+    auto ext = std::filesystem::path(src).extension().string();
+    if (ext == ".txt" or ext == ".lst")
+    {
+        return ReadFileList(src, files);
+    }
+    files.push_back(src);
+    return true;
+}
+
+bool ImageLoader::Init(const std::vector<std::string> &files)
+{
+    if (files.empty())
+    {
+        LOGE("files is empty");
+        return false;
+    }
+    Src   = files.front();
+    Files = files;
+    Pack.Close();
+    return true;
+}
+
+bool ImageLoader::ReadFileList(const std::string &list, std::vector<std::string> &files)
+{
+    std::ifstream file(list);
+    if (not file)
+    {
+        LOGE("can't open file list [%s]", list.c_str());
+        return false;
+    }
+    auto        base = std::filesystem::path(list).parent_path();
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line.erase(line.find_last_not_of(" \t\r\n") + 1);
+        if (line.empty() or line.front() == '#')
+        {
+            continue;
+        }
+        std::filesystem::path path(line);
+        files.push_back(path.is_absolute() ? line : (base / path).string());
+    }
+    return true;
+}
+
+// orientation tag (0x0112) of the EXIF APP1 payload, 1 when there is none
+static int ReadExifOrientation(std::span<const std::uint8_t> app1)
+{
+    // "Exif\0\0", then a TIFF header: byte order, 42, offset of IFD0
+    if (app1.size() < 14 or std::memcmp(app1.data(), "Exif\0\0", 6) != 0)
+    {
+        return 1;
+    }
+    auto tiff = app1.subspan(6);
+    bool le   = tiff[0] == 'I' and tiff[1] == 'I';
+    if (not le and not(tiff[0] == 'M' and tiff[1] == 'M'))
+    {
+        return 1;
+    }
+    auto read16 = [&](std::size_t at)
+    {
+        return le ? tiff[at] | (tiff[at + 1] << 8) : (tiff[at] << 8) | tiff[at + 1];
+    };
+    auto read32 = [&](std::size_t at)
+    {
+        return (static_cast<std::uint32_t>(read16(le ? at + 2 : at)) << 16) | read16(le ? at : at + 2);
+    };
+    std::size_t ifd = read32(4);
+    if (ifd + 2 > tiff.size())
+    {
+        return 1;
+    }
+    int count = read16(ifd);
+    for (int i = 0; i < count and ifd + 2 + (i + 1) * 12 <= tiff.size(); ++i)
+    {
+        std::size_t entry = ifd + 2 + i * 12;
+        if (read16(entry) == 0x0112)
+        {
+            return read16(entry + 8);  // SHORT, left-justified in the value field
+        }
+    }
+    return 1;
+}
+
+// size of the image as imdecode returns it: EXIF orientations 5..8 rotate by 90 degrees, width and height swap
+static bool ReadJpegSize(std::span<const std::uint8_t> bytes, int &width, int &height)
 {
-    if (not IsDirectory)
+    if (bytes.size() < 4 or bytes[0] != 0xFF or bytes[1] != 0xD8)
     {
-        LOGI("src is a file");
         return false;
     }
-    for (const auto &entry : std::filesystem::directory_iterator(Src))
+    // walk the marker segments up to the first SOFn, it holds the frame size. APP1 comes before it
+    int         orientation = 1;
+    std::size_t pos         = 2;
+    while (pos + 4 <= bytes.size())
     {
-        if (entry.is_regular_file())
+        if (bytes[pos] != 0xFF)
+        {
+            return false;
+        }
+        auto marker = bytes[pos + 1];
+        if (marker == 0xFF)
+        {
+            ++pos;  // fill byte
+            continue;
+        }
+        std::size_t len = (bytes[pos + 2] << 8) | bytes[pos + 3];
+        if (marker == 0xE1 and len >= 2 and pos + 2 + len <= bytes.size() and orientation == 1)
         {
-            auto image = cv::imread(entry.path().string());
-            if (image.empty())
+            orientation = ReadExifOrientation(bytes.subspan(pos + 4, len - 2));
+        }
+        // SOF0..SOF15 except DHT (C4), JPG (C8) and DAC (CC)
+        if (marker >= 0xC0 and marker <= 0xCF and marker != 0xC4 and marker != 0xC8 and marker != 0xCC)
+        {
+            if (pos + 9 > bytes.size())
+            {
+                return false;
+            }
+            height = (bytes[pos + 5] << 8) | bytes[pos + 6];
+            width  = (bytes[pos + 7] << 8) | bytes[pos + 8];
+            if (orientation >= 5 and orientation <= 8)
             {
-                LOGE("Read image failed: [%s]", entry.path().string().c_str());
-                continue;
+                std::swap(width, height);
             }
-            auto signal = std::make_shared<SignalImageBGR>(image);
-            OutputList[0]->Push(signal);
+            return width > 0 and height > 0;
         }
+        if (marker == 0xDA or len < 2)
+        {
+            return false;  // start of scan before any SOF
+        }
+        pos += 2 + len;
+    }
+    return false;
+}
+
+int ImageLoader::GetDecodeFlag(std::span<const std::uint8_t> bytes) const
+{
+    int width = 0, height = 0;
+    if (TargetSize.width <= 0 or TargetSize.height <= 0 or not ReadJpegSize(bytes, width, height))
+    {
+        return cv::IMREAD_COLOR;
+    }
+    // libjpeg scales in the DCT domain by 1/2, 1/4, 1/8, take the smallest that still covers the target
+    for (auto [scale, flag] : {std::pair{8, cv::IMREAD_REDUCED_COLOR_8}, std::pair{4, cv::IMREAD_REDUCED_COLOR_4},
+                               std::pair{2, cv::IMREAD_REDUCED_COLOR_2}})
+    {
+        if (width / scale >= TargetSize.width and height / scale >= TargetSize.height)
+        {
+            return flag;
+        }
+    }
+    return cv::IMREAD_COLOR;
+}
+
+cv::Mat ImageLoader::DecodeImage(std::span<const std::uint8_t> bytes) const
+{
+    cv::Mat data(1, static_cast<int>(bytes.size()), CV_8UC1, const_cast<std::uint8_t *>(bytes.data()));
+    return cv::imdecode(data, GetDecodeFlag(bytes));
+}
+
+cv::Mat ImageLoader::LoadImage(std::size_t idx) const
+{
+    if (Pack.IsOpen())
+    {
+        // decode straight from the mapping, no copy and no file open
+        auto image = DecodeImage(Pack.Get(idx));
+        if (image.empty())
+        {
+            LOGE("Decode image [%zu] of [%s] failed", idx, Src.c_str());
+        }
+        return image;
+    }
+    // read the whole file in one call and decode from memory, the read of one image overlaps the decode of others
+    const auto   &path = Files[idx];
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (not file)
+    {
+        LOGE("Read image failed: [%s]", path.c_str());
+        return cv::Mat();
+    }
+    std::vector<std::uint8_t> bytes(static_cast<std::size_t>(file.tellg()));
+    file.seekg(0);
+    if (not file.read(reinterpret_cast<char *>(bytes.data()), static_cast<std::streamsize>(bytes.size())))
+    {
+        LOGE("Read image failed: [%s]", path.c_str());
+        return cv::Mat();
+    }
+    auto image = DecodeImage(bytes);
+    if (image.empty())
+    {
+        LOGE("Decode image failed: [%s]", path.c_str());
+    }
+    return image;
+}
+
+bool ImageLoader::Run()
+{
+    auto end = std::min(RangeEnd, GetImageNum());
+    if (RangeBegin >= end)
+    {
+        LOGE("ImageLoader not initialized or empty range [%zu, %zu)", RangeBegin, end);
+        return false;
+    }
+    auto prefetch = PrefetchNum > 0 ? PrefetchNum : 2 * static_cast<std::size_t>(WorkerNum);
+
+    ThreadPool pool(static_cast<std::uint8_t>(WorkerNum));
+    pool.Start();
+    std::deque<std::future<cv::Mat>> in_flight;
+
+    std::size_t next_submit = RangeBegin;
+    for (std::size_t cur = RangeBegin; Running and cur < end; ++cur)
+    {
+        for (; next_submit < end and next_submit < cur + prefetch; ++next_submit)
+        {
+            in_flight.push_back(pool.Commit(&ImageLoader::LoadImage, this, next_submit));
+        }
+        auto image = in_flight.front().get();
+        in_flight.pop_front();
+        if (image.empty())
+        {
+            continue;
+        }
+        // the consumer is slower, stop decoding ahead instead of filling the output queue
+        while (Running and OutputList[0]->Size() >= prefetch)
+        {
+            std::this_thread::sleep_for(SleepTime);
+        }
+        auto signal      = std::make_shared<SignalImageBGR>(image);
+        signal->FrameIdx = cur;
+        signal->TimeStamps.push_back(std::chrono::steady_clock::now());
+        OutputList[0]->Push(signal);
+    }
+    for (auto &future : in_flight)
+    {
+        future.wait();
     }
+    LOGI("image loader done, images [%zu, %zu)", RangeBegin, end);
     return true;
 }
-}  // namespace cv_infer
\ No newline at end of file
+}  // namespace cv_infer
@@ -1,11 +1,20 @@
 #pragma once
+#include <algorithm>
+#include <limits>
 #include <opencv2/opencv.hpp>
+#include <span>
 #include <string>
+#include <vector>
 
+#include "node/image_pack.h"
 #include "node/node_base.h"
 namespace cv_infer
 {
-
+// 图片输入节点
+// 1. src 可以是目录 (按文件名排序), 单张图片, 文件列表 (.txt/.lst, 每行一个路径, 相对路径相对于列表所在目录),
+//    或者 PackImages 生成的 pack 文件 (mmap 后直接从内存解码)
+// 2. 读文件和解码都在线程池中完成, 最多 PrefetchNum 张在途, 按列表顺序输出
+// 3. FrameIdx 为图片在列表中的序号, 读取失败的图片被跳过, 不影响其他图片的序号
 class ImageLoader : public NodeBase
 {
 public:
@@ -13,12 +22,43 @@ public:
     virtual ~ImageLoader();
 
     virtual bool Init(const std::string &src);
+    bool         Init(const std::vector<std::string> &files);
     virtual bool Run() override;
     virtual bool Worker() override { return true; };
 
+    // set before Start(), prefetch defaults to 2 * worker num
+    void SetWorkerNum(int worker_num) { WorkerNum = std::clamp(worker_num, 1, 255); }
+    void SetPrefetchNum(std::size_t prefetch) { PrefetchNum = prefetch; }
+    // only output images [begin, end) of the input, e.g. one shard per worker. FrameIdx stays the global index
+    void SetRange(std::size_t begin, std::size_t end)
+    {
+        RangeBegin = begin;
+        RangeEnd   = end;
+    }
+
+    // input size of the model, jpegs at least 2x larger are decoded at 1/2, 1/4 or 1/8 scale in the DCT domain.
+    // the output image is then smaller than the file, never smaller than size. empty size decodes at full size
+    void SetTargetSize(const cv::Size &size) { TargetSize = size; }
+
+    std::size_t GetImageNum() const { return Pack.IsOpen() ? Pack.Size() : Files.size(); }
+
+    // the files a directory / list / single image src stands for, in output order
+    static bool ListFiles(const std::string &src, std::vector<std::string> &files);
+
 private:
-    std::string Src;
+    static bool ReadFileList(const std::string &list, std::vector<std::string> &files);
+    cv::Mat     LoadImage(std::size_t idx) const;
+    cv::Mat     DecodeImage(std::span<const std::uint8_t> bytes) const;
+    int         GetDecodeFlag(std::span<const std::uint8_t> bytes) const;
+
+    std::string              Src;
+    std::vector<std::string> Files;
+    MappedImagePack          Pack;
+    std::size_t              RangeBegin = 0;
+    std::size_t              RangeEnd   = std::numeric_limits<std::size_t>::max();
+    cv::Size                 TargetSize;
 
-    bool IsDirectory{false};  // directory or file
+    int         WorkerNum   = 4;
+    std::size_t PrefetchNum = 0;
 };
-}  // namespace cv_infer
\ No newline at end of file
+}  // namespace cv_infer
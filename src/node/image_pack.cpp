@@ -0,0 +1,160 @@
+#include "image_pack.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "tools/logger.h"
+
+namespace cv_infer
+{
+bool PackImages(const std::vector<std::string> &files, const std::string &path)
+{
+    auto tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (not out)
+        {
+            LOGE("can't create [%s]", tmp_path.c_str());
+            return false;
+        }
+        ImagePackHeader header;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        std::vector<ImagePackEntry> index;
+        index.reserve(files.size());
+        std::vector<char> bytes;
+        for (const auto &file : files)
+        {
+            std::ifstream in(file, std::ios::binary | std::ios::ate);
+            if (not in)
+            {
+                LOGE("can't open [%s]", file.c_str());
+                return false;
+            }
+            bytes.resize(static_cast<std::size_t>(in.tellg()));
+            in.seekg(0);
+            in.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            ImagePackEntry entry;
+            entry.offset = static_cast<std::uint64_t>(out.tellp());
+            entry.size   = bytes.size();
+            out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            if (not in or not out)
+            {
+                LOGE("pack [%s] failed", file.c_str());
+                return false;
+            }
+            index.push_back(entry);
+        }
+
+        // the index is used in place from the mapping, keep it aligned
+        while (static_cast<std::uint64_t>(out.tellp()) % alignof(ImagePackEntry) != 0)
+        {
+            out.put(0);
+        }
+        header.entry_num    = index.size();
+        header.index_offset = static_cast<std::uint64_t>(out.tellp());
+        out.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(ImagePackEntry));
+        out.seekp(0);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        if (not out)
+        {
+            LOGE("write image pack [%s] failed", tmp_path.c_str());
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec)
+    {
+        LOGE("rename [%s] -> [%s] failed: [%s]", tmp_path.c_str(), path.c_str(), ec.message().c_str());
+        return false;
+    }
+    LOGI("packed [%zu] images into [%s]", files.size(), path.c_str());
+    return true;
+}
+
+bool IsImagePack(const std::string &path)
+{
+    std::ifstream   in(path, std::ios::binary);
+    ImagePackHeader header;
+    return in.read(reinterpret_cast<char *>(&header), sizeof(header)) and std::memcmp(header.magic, "CVIP", 4) == 0;
+}
+
+bool MappedImagePack::Open(const std::string &path)
+{
+    Close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        LOGE("can't open image pack [%s]", path.c_str());
+        return false;
+    }
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 or static_cast<std::size_t>(st.st_size) < sizeof(ImagePackHeader))
+    {
+        ::close(fd);
+        LOGE("image pack [%s] is too small", path.c_str());
+        return false;
+    }
+    Len  = st.st_size;
+    Addr = ::mmap(nullptr, Len, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (Addr == MAP_FAILED)
+    {
+        Addr = nullptr;
+        Len  = 0;
+        LOGE("mmap image pack [%s] failed", path.c_str());
+        return false;
+    }
+    // images are mostly read in order, let the kernel read ahead
+    ::madvise(Addr, Len, MADV_SEQUENTIAL);
+
+    const auto *header = static_cast<const ImagePackHeader *>(Addr);
+    if (std::memcmp(header->magic, "CVIP", 4) != 0 or header->version != ImagePackHeader{}.version or
+        header->index_offset % alignof(ImagePackEntry) != 0 or
+        header->index_offset + header->entry_num * sizeof(ImagePackEntry) != Len)
+    {
+        LOGE("image pack [%s] is invalid", path.c_str());
+        Close();
+        return false;
+    }
+    Entries = {reinterpret_cast<const ImagePackEntry *>(static_cast<const std::uint8_t *>(Addr) + header->index_offset),
+               header->entry_num};
+    for (const auto &entry : Entries)
+    {
+        if (entry.offset + entry.size > header->index_offset)
+        {
+            LOGE("image pack [%s] has an entry out of range", path.c_str());
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void MappedImagePack::Close()
+{
+    if (Addr != nullptr)
+    {
+        ::munmap(Addr, Len);
+        Addr    = nullptr;
+        Len     = 0;
+        Entries = {};
+    }
+}
+
+std::span<const std::uint8_t> MappedImagePack::Get(std::size_t idx) const
+{
+    if (idx >= Entries.size())
+    {
+        return {};
+    }
+    return {static_cast<const std::uint8_t *>(Addr) + Entries[idx].offset, Entries[idx].size};
+}
+}  // namespace cv_infer
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace cv_infer
+{
+// 打包的图片数据集, 一个大文件代替大量小文件, 读取时 mmap, 没有逐文件的 open/stat
+// 文件格式: ImagePackHeader + 原始编码数据 (jpg/png, 不重新编码) + entry_num 个 ImagePackEntry
+// 索引放在文件末尾, 打包时可以边读边写, 不需要预先知道每个文件的大小
+struct ImagePackHeader
+{
+    char          magic[4]     = {'C', 'V', 'I', 'P'};
+    std::uint32_t version      = 1;
+    std::uint64_t entry_num    = 0;
+    std::uint64_t index_offset = 0;  // byte offset of the first ImagePackEntry
+};
+
+struct ImagePackEntry
+{
+    std::uint64_t offset = 0;  // byte offset of the encoded image in the pack
+    std::uint64_t size   = 0;
+};
+static_assert(sizeof(ImagePackEntry) == 16 and std::is_trivially_copyable_v<ImagePackEntry>,
+              "ImagePackEntry is stored as is in the pack file");
+
+// 按 files 的顺序打包, 序号即 ImageLoader 输出的 FrameIdx. 写入 path.tmp 后 rename
+bool PackImages(const std::vector<std::string>& files, const std::string& path);
+
+// header 不匹配时返回 false 且不打印错误, 可以用来判断一个文件是不是 pack
+bool IsImagePack(const std::string& path);
+
+class MappedImagePack
+{
+public:
+    MappedImagePack() = default;
+    ~MappedImagePack() { Close(); }
+    MappedImagePack(const MappedImagePack&)            = delete;
+    MappedImagePack& operator=(const MappedImagePack&) = delete;
+
+    bool Open(const std::string& path);
+    void Close();
+    bool IsOpen() const { return Addr != nullptr; }
+
+    std::size_t Size() const { return Entries.size(); }
+    // encoded bytes of image idx, valid until Close(). safe to call from several threads
+    std::span<const std::uint8_t> Get(std::size_t idx) const;
+
+private:
+    void*                           Addr = nullptr;
+    std::size_t                     Len  = 0;
+    std::span<const ImagePackEntry> Entries;
+};
+}  // namespace cv_infer
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <deque>
+#include <future>
 #include <opencv2/core/mat.hpp>
 #include <opencv2/opencv.hpp>
 
@@ -14,7 +16,7 @@ class InferNode : public NodeBase
 {
 public:
     InferNode() : NodeBase(1, 1) { SetName("InferNode"); };
-    virtual ~InferNode(){};
+    virtual ~InferNode() { Stop(); };
 
     bool Init(const std::string& model)
     {
@@ -32,26 +34,78 @@ public:
         return true;
     }
 
+    // false: boxes are not drawn, the node outputs SignalDetections instead of the image (e.g. for RemuxNode)
+    void SetOverlay(bool overlay) { Overlay = overlay; }
+
+    // 同时在推理中的帧数, 大于 1 时通过 Submit 异步推理, 节点在等待结果的同时继续取下一帧, 输出顺序不变
+    // 需要在 Start 之前调用
+    void SetMaxInFlight(int num)
+    {
+        MaxInFlight = std::max(1, num);
+        Model.Engine.SetMaxInFlight(MaxInFlight);
+    }
+
+    virtual bool Stop() override
+    {
+        NodeBase::Stop();
+        // 输出还在推理中的帧
+        while (not Pending.empty())
+        {
+            Output(Pending.front().first, Pending.front().second.get());
+            Pending.pop_front();
+        }
+        return true;
+    }
+
     virtual bool Worker() override
     {
         SignalBasePtr signal;
-        if (not InputList[0]->Pop(signal))
+        if (InputList[0]->Pop(signal))
+        {
+            if (signal->GetSignalType() != SignalType::SIGNAL_IMAGE_BGR)
+            {
+                LOGE("Input signal type not match, expect [%d], but got [%d]",
+                     static_cast<int>(SignalType::SIGNAL_IMAGE_BGR), static_cast<int>(signal->GetSignalType()));
+                return {};
+            }
+            auto signal_bgr = std::dynamic_pointer_cast<SignalImageBGR>(signal);
+
+            std::vector<std::shared_ptr<SignalImageBGR>> inputs{signal_bgr};
+            if (MaxInFlight == 1)
+            {
+                Output(signal_bgr, Model.Forwards(inputs));  // TODO: batch
+                return true;
+            }
+            Pending.emplace_back(signal_bgr, Model.Submit(inputs));
+        }
+        if (Pending.empty())
         {
             return false;
         }
-        if (signal->GetSignalType() != SignalType::SIGNAL_IMAGE_BGR)
+        // 未满时只输出已经完成的帧, 满了才阻塞等待最早的一帧
+        if (static_cast<int>(Pending.size()) < MaxInFlight and
+            Pending.front().second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
         {
-            LOGE("Input signal type not match, expect [%d], but got [%d]",
-                 static_cast<int>(SignalType::SIGNAL_IMAGE_BGR), static_cast<int>(signal->GetSignalType()));
-            return {};
+            return signal != nullptr;
         }
-        auto signal_bgr = std::dynamic_pointer_cast<SignalImageBGR>(signal);
-
-        std::vector<std::shared_ptr<SignalImageBGR>> inputs{signal_bgr};
+        Output(Pending.front().first, Pending.front().second.get());
+        Pending.pop_front();
+        return true;
+    }
 
-        auto               output_data  = Model.Forwards(inputs);  // TODO: batch
-        auto               image        = signal_bgr->Val;
-        auto               frame_index  = signal_bgr->FrameIdx;
+private:
+    void Output(const std::shared_ptr<SignalImageBGR>& signal_bgr, Detections output_data)
+    {
+        auto image       = signal_bgr->Val;
+        auto frame_index = signal_bgr->FrameIdx;
+        if (not Overlay)
+        {
+            auto detections        = std::make_shared<SignalDetections>(std::move(output_data));
+            detections->FrameIdx   = frame_index;
+            detections->TimeStamps = signal_bgr->TimeStamps;
+            OutputList[0]->Push(std::move(detections));
+            return;
+        }
         static const char* cocolabels[] = {"person",        "bicycle",      "car",
                                            "motorcycle",    "airplane",     "bus",
                                            "train",         "truck",        "boat",
@@ -79,26 +133,29 @@ public:
                                            "refrigerator",  "book",         "clock",
                                            "vase",          "scissors",     "teddy bear",
                                            "hair drier",    "toothbrush"};
+        constexpr int label_num = sizeof(cocolabels) / sizeof(cocolabels[0]);
         for (const auto& bbox : output_data)
         {
-            cv::Rect rect(cv::Point2f(bbox[0], bbox[1]), cv::Point2f(bbox[2], bbox[3]));
+            cv::Rect rect(cv::Point2f(bbox.x1, bbox.y1), cv::Point2f(bbox.x2, bbox.y2));
             cv::rectangle(image, rect, cv::Scalar(0, 255, 0), 2);
             // write label and confidence
-            std::string label = cocolabels[static_cast<int>(bbox[5])];
-            cv::putText(image, label, cv::Point2f(bbox[0], bbox[1]), cv::FONT_HERSHEY_SIMPLEX, 0.5,
+            std::string label = bbox.class_id >= 0 and bbox.class_id < label_num ? cocolabels[bbox.class_id]
+                                                                                  : std::to_string(bbox.class_id);
+            cv::putText(image, label, cv::Point2f(bbox.x1, bbox.y1), cv::FONT_HERSHEY_SIMPLEX, 0.5,
                         cv::Scalar(0, 0, 255), 2);
-            float confidence = bbox[4];
-            label            = std::to_string(confidence);
-            cv::putText(image, label, cv::Point2f(bbox[0], bbox[1] + 15), cv::FONT_HERSHEY_SIMPLEX, 0.5,
+            label = std::to_string(bbox.score);
+            cv::putText(image, label, cv::Point2f(bbox.x1, bbox.y1 + 15), cv::FONT_HERSHEY_SIMPLEX, 0.5,
                         cv::Scalar(0, 0, 255), 2);
         }
         // auto output_signal      = std::make_shared<SignalImageBGR>(image);
         // output_signal->FrameIdx = frame_index;
-        OutputList[0]->Push(std::move(signal));
-        return true;
+        OutputList[0]->Push(signal_bgr);
     }
 
-private:
     ModelType Model;
+    bool      Overlay     = true;
+    int       MaxInFlight = 1;
+
+    std::deque<std::pair<std::shared_ptr<SignalImageBGR>, std::future<Detections>>> Pending;
 };
 }  // namespace cv_infer
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "keyframe_index.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "node/av_helper.h"
+#include "tools/logger.h"
+
+namespace cv_infer
+{
+bool BuildKeyFrameIndex(AVFormatContext *ctx, int stream_idx, KeyFrameIndex &index, std::uint64_t &frame_count)
+{
+    index.clear();
+    frame_count = 0;
+    if (ctx == nullptr or stream_idx < 0 or stream_idx >= static_cast<int>(ctx->nb_streams))
+    {
+        LOGE("invalid stream index [%d]", stream_idx);
+        return false;
+    }
+
+    auto *st      = ctx->streams[stream_idx];
+    auto  entries = avformat_index_get_entries_count(st);
+    if (entries > 0 and st->nb_frames == entries)
+    {
+        for (int i = 0; i < entries; ++i)
+        {
+            const auto *entry = avformat_index_get_entry(st, i);
+            if (entry->flags & AVINDEX_KEYFRAME)
+            {
+                index.push_back({AV_NOPTS_VALUE, entry->timestamp, entry->pos, static_cast<std::uint64_t>(i)});
+            }
+        }
+        frame_count = entries;
+        LOGD("key frame index from demuxer, key frames = [%zu], frames = [%lu]", index.size(), frame_count);
+        return not index.empty();
+    }
+
+    AVPacketPtr pkt{av_packet_alloc()};
+    if (pkt == nullptr)
+    {
+        LOGE("call av_packet_alloc return nullptr");
+        return false;
+    }
+    while (av_read_frame(ctx, pkt.get()) == 0)
+    {
+        std::unique_ptr<AVPacket, decltype(av_packet_unref) *> unref_guard{pkt.get(), av_packet_unref};
+        if (pkt->stream_index != stream_idx)
+        {
+            continue;
+        }
+        if (pkt->flags & AV_PKT_FLAG_KEY)
+        {
+            index.push_back({pkt->pts, pkt->dts, pkt->pos, frame_count});
+        }
+        ++frame_count;
+    }
+    LOGD("key frame index from packets, key frames = [%zu], frames = [%lu]", index.size(), frame_count);
+    return not index.empty();
+}
+
+static bool GetSourceStamp(const std::string &source, std::int64_t &size, std::int64_t &mtime)
+{
+    std::error_code ec;
+    auto            file_size  = std::filesystem::file_size(source, ec);
+    auto            write_time = std::filesystem::last_write_time(source, ec);
+    if (ec)
+    {
+        return false;
+    }
+    size  = static_cast<std::int64_t>(file_size);
+    mtime = static_cast<std::int64_t>(write_time.time_since_epoch().count());
+    return true;
+}
+
+bool SaveKeyFrameIndex(const std::string &path, const std::string &source, const KeyFrameIndex &index,
+                       std::uint64_t frame_count)
+{
+    KeyFrameIndexHeader header;
+    header.entry_num   = index.size();
+    header.frame_count = frame_count;
+    if (not GetSourceStamp(source, header.source_size, header.source_mtime))
+    {
+        LOGW("can't stat source [%s], key frame index not saved", source.c_str());
+        return false;
+    }
+
+    auto tmp_path = path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(KeyFrameEntry));
+        if (not file)
+        {
+            LOGW("write key frame index [%s] failed", tmp_path.c_str());
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec)
+    {
+        LOGW("rename [%s] -> [%s] failed: [%s]", tmp_path.c_str(), path.c_str(), ec.message().c_str());
+        return false;
+    }
+    LOGI("key frame index saved to [%s], key frames = [%zu]", path.c_str(), index.size());
+    return true;
+}
+
+const KeyFrameEntry *FindKeyFrame(std::span<const KeyFrameEntry> index, std::uint64_t frame)
+{
+    auto it = std::upper_bound(index.begin(), index.end(), frame,
+                               [](std::uint64_t f, const KeyFrameEntry &entry) { return f < entry.frame_idx; });
+    return it == index.begin() ? nullptr : &*(it - 1);
+}
+
+bool MappedKeyFrameIndex::Open(const std::string &path, const std::string &source)
+{
+    Close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 or static_cast<std::size_t>(st.st_size) < sizeof(KeyFrameIndexHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+    Size = st.st_size;
+    Addr = ::mmap(nullptr, Size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (Addr == MAP_FAILED)
+    {
+        Addr = nullptr;
+        Size = 0;
+        return false;
+    }
+
+    const auto  *header = static_cast<const KeyFrameIndexHeader *>(Addr);
+    std::int64_t size = 0, mtime = 0;
+    if (std::memcmp(header->magic, "CVKI", 4) != 0 or header->version != KeyFrameIndexHeader{}.version or
+        Size != sizeof(KeyFrameIndexHeader) + header->entry_num * sizeof(KeyFrameEntry) or
+        not GetSourceStamp(source, size, mtime) or size != header->source_size or mtime != header->source_mtime)
+    {
+        LOGW("key frame index [%s] is invalid or stale, ignore it", path.c_str());
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void MappedKeyFrameIndex::Close()
+{
+    if (Addr != nullptr)
+    {
+        ::munmap(Addr, Size);
+        Addr = nullptr;
+        Size = 0;
+    }
+}
+
+std::span<const KeyFrameEntry> MappedKeyFrameIndex::Entries() const
+{
+    if (Addr == nullptr)
+    {
+        return {};
+    }
+    const auto *header = static_cast<const KeyFrameIndexHeader *>(Addr);
+    return {reinterpret_cast<const KeyFrameEntry *>(header + 1), header->entry_num};
+}
+
+std::uint64_t MappedKeyFrameIndex::FrameCount() const
+{
+    return Addr == nullptr ? 0 : static_cast<const KeyFrameIndexHeader *>(Addr)->frame_count;
+}
+}  // namespace cv_infer
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+namespace cv_infer
+{
+struct KeyFrameEntry
+{
+    std::int64_t  pts       = AV_NOPTS_VALUE;
+    std::int64_t  dts       = AV_NOPTS_VALUE;
+    std::int64_t  pos       = -1;  // byte offset in the file, -1 if unknown
+    std::uint64_t frame_idx = 0;   // packets of the stream before this key frame, in decode order
+};
+using KeyFrameIndex = std::vector<KeyFrameEntry>;
+static_assert(sizeof(KeyFrameEntry) == 32 and std::is_trivially_copyable_v<KeyFrameEntry>,
+              "KeyFrameEntry is stored as is in the sidecar file");
+
+// sidecar 文件格式: KeyFrameIndexHeader + entry_num 个 KeyFrameEntry, 可以直接 mmap 使用
+// source_size/source_mtime 用于判断 sidecar 是否与源文件匹配
+struct KeyFrameIndexHeader
+{
+    char          magic[4]     = {'C', 'V', 'K', 'I'};
+    std::uint32_t version      = 1;
+    std::uint64_t entry_num    = 0;
+    std::uint64_t frame_count  = 0;
+    std::int64_t  source_size  = 0;
+    std::int64_t  source_mtime = 0;
+};
+
+// 1. 优先使用 demuxer 自带的索引 (mp4 moov, mkv cues), 不读取任何 packet
+// 2. 索引不完整时顺序读取一遍该流的 packet, ctx 会被读到文件末尾
+bool BuildKeyFrameIndex(AVFormatContext* ctx, int stream_idx, KeyFrameIndex& index, std::uint64_t& frame_count);
+
+// 写入 path.tmp 后 rename, 不会留下写了一半的 sidecar
+bool SaveKeyFrameIndex(const std::string& path, const std::string& source, const KeyFrameIndex& index,
+                       std::uint64_t frame_count);
+
+// last key frame whose frame_idx <= frame, nullptr if there is none
+const KeyFrameEntry* FindKeyFrame(std::span<const KeyFrameEntry> index, std::uint64_t frame);
+
+class MappedKeyFrameIndex
+{
+public:
+    MappedKeyFrameIndex() = default;
+    ~MappedKeyFrameIndex() { Close(); }
+    MappedKeyFrameIndex(const MappedKeyFrameIndex&)            = delete;
+    MappedKeyFrameIndex& operator=(const MappedKeyFrameIndex&) = delete;
+
+    // fails when the sidecar is missing, corrupted or older than source
+    bool Open(const std::string& path, const std::string& source);
+    void Close();
+    bool IsOpen() const { return Addr != nullptr; }
+
+    std::span<const KeyFrameEntry> Entries() const;
+    std::uint64_t                  FrameCount() const;
+
+private:
+    void*       Addr = nullptr;
+    std::size_t Size = 0;
+};
+}  // namespace cv_infer
@@ -0,0 +1,218 @@
+#include "multi_encoder_node.h"
+
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <opencv2/imgproc.hpp>
+#include <thread>
+
+#include "tools/logger.h"
+
+namespace cv_infer
+{
+MultiEncoderNode::~MultiEncoderNode() { Stop(); }
+
+bool MultiEncoderNode::Init(const std::vector<OutCfg> &cfgs, double source_fps)
+{
+    if (cfgs.empty())
+    {
+        LOGE("no rendition to encode");
+        return false;
+    }
+    Renditions.clear();
+    SizeResolved = false;
+    SizeFailed   = false;
+    for (const auto &cfg : cfgs)
+    {
+        Rendition rendition;
+        rendition.cfg     = cfg;
+        rendition.cfg.fps = cfg.fps > 0.0 ? cfg.fps : source_fps;
+        rendition.encoder = std::make_shared<EncoderNode>();
+        rendition.input   = std::make_shared<SignalQue>();
+        rendition.encoder->SetName("Encoder-" + cfg.out_url);
+        if (not rendition.encoder->AddInputs(rendition.input))
+        {
+            LOGE("bind rendition [%s] failed", cfg.out_url.c_str());
+            return false;
+        }
+        Renditions.emplace_back(std::move(rendition));
+    }
+    return true;
+}
+
+bool MultiEncoderNode::ResolveSizes(const cv::Size &source, std::vector<OutCfg> &cfgs, std::vector<std::size_t> &order)
+{
+    if (source.width <= 0 or source.height <= 0)
+    {
+        LOGE("invalid source size [%dx%d]", source.width, source.height);
+        return false;
+    }
+    for (auto &cfg : cfgs)
+    {
+        int w = cfg.width;
+        int h = cfg.height;
+        if (w <= 0 and h <= 0)
+        {
+            w = source.width;
+            h = source.height;
+        }
+        else if (w <= 0)
+        {
+            w = static_cast<int>(std::lround(static_cast<double>(h) * source.width / source.height));
+        }
+        else if (h <= 0)
+        {
+            h = static_cast<int>(std::lround(static_cast<double>(w) * source.height / source.width));
+        }
+        // yuv420p needs even sizes
+        cfg.width  = w & ~1;
+        cfg.height = h & ~1;
+        if (cfg.width <= 0 or cfg.height <= 0)
+        {
+            LOGE("invalid size of rendition [%s]", cfg.out_url.c_str());
+            return false;
+        }
+    }
+    // every rendition is scaled from the previous, larger one
+    order.resize(cfgs.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    auto area = [&](std::size_t i) { return static_cast<int64_t>(cfgs[i].width) * cfgs[i].height; };
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return area(a) > area(b); });
+    return true;
+}
+
+bool MultiEncoderNode::ResolveSizes(const cv::Size &source)
+{
+    std::vector<OutCfg> cfgs;
+    for (const auto &rendition : Renditions)
+    {
+        cfgs.push_back(rendition.cfg);
+    }
+    std::vector<std::size_t> order;
+    if (not ResolveSizes(source, cfgs, order))
+    {
+        return false;
+    }
+    std::vector<Rendition> sorted;
+    for (auto i : order)
+    {
+        sorted.emplace_back(std::move(Renditions[i]));
+        sorted.back().cfg  = cfgs[i];
+        sorted.back().size = cv::Size(cfgs[i].width, cfgs[i].height);
+    }
+    Renditions = std::move(sorted);
+
+    for (auto &rendition : Renditions)
+    {
+        // the frames already have the output size, the encoder only converts the colors
+        if (not rendition.encoder->Init(rendition.cfg))
+        {
+            LOGE("init encoder of rendition [%s] failed", rendition.cfg.out_url.c_str());
+            // don't leave the opened ones behind half written, Close() of an unopened encoder does nothing
+            for (auto &opened : Renditions)
+            {
+                opened.encoder->Close();
+            }
+            return false;
+        }
+        LOGI("rendition [%s]: [%dx%d]", rendition.cfg.out_url.c_str(), rendition.size.width, rendition.size.height);
+    }
+    SizeResolved = true;
+    return true;
+}
+
+bool MultiEncoderNode::PushOneFrame(const std::shared_ptr<SignalImageBGR> &image)
+{
+    if (SizeFailed)
+    {
+        return false;
+    }
+    if (not SizeResolved and not ResolveSizes(image->Val.size()))
+    {
+        // not retried on the next frame, the same sizes would fail again
+        SizeFailed = true;
+        return false;
+    }
+    // back pressure: encoders run at their own pace, don't let the slowest one pile up frames
+    for (auto &rendition : Renditions)
+    {
+        while (Running and rendition.input->Size() >= MaxPendingFrames)
+        {
+            std::this_thread::sleep_for(SleepTime);
+        }
+    }
+
+    cv::Mat previous = image->Val;
+    for (auto &rendition : Renditions)
+    {
+        cv::Mat scaled = previous;
+        if (previous.size() != rendition.size)
+        {
+            // INTER_AREA keeps the downscale free of aliasing
+            cv::resize(previous, scaled, rendition.size, 0, 0, cv::INTER_AREA);
+        }
+        auto signal        = std::make_shared<SignalImageBGR>(scaled);
+        signal->FrameIdx   = image->FrameIdx;
+        signal->TimeStamps = image->TimeStamps;
+        rendition.input->Push(signal);
+        previous = scaled;
+    }
+    return true;
+}
+
+bool MultiEncoderNode::Start()
+{
+    for (auto &rendition : Renditions)
+    {
+        if (not rendition.encoder->Start())
+        {
+            LOGE("start encoder of rendition [%s] failed", rendition.cfg.out_url.c_str());
+            return false;
+        }
+    }
+    return NodeBase::Start();
+}
+
+bool MultiEncoderNode::Stop()
+{
+    NodeBase::Stop();
+    for (auto &rendition : Renditions)
+    {
+        rendition.encoder->Stop();
+        // flush the frames still in the codec and write the trailer now, not when the node is destroyed
+        rendition.encoder->Close();
+    }
+    // closed encoders are opened again on the first frame after the next Start()
+    SizeResolved = false;
+    return true;
+}
+
+bool MultiEncoderNode::Run()
+{
+    while (Running)
+    {
+        SignalBasePtr signal;
+        if (not InputList[0]->Pop(signal))
+        {
+            std::this_thread::sleep_for(SleepTime);
+            continue;
+        }
+        if (signal->GetSignalType() != SignalType::SIGNAL_IMAGE_BGR)
+        {
+            LOGE("MultiEncoderNode::Run() input_signal->GetSignalType() != SignalType::SIGNAL_IMAGE_BGR");
+            continue;
+        }
+        auto image = std::dynamic_pointer_cast<SignalImageBGR>(signal);
+        CostTimer.StartTimer();
+        if (not PushOneFrame(image))
+        {
+            LOGE("MultiEncoderNode::Run() PushOneFrame return false");
+        }
+        CostTimer.EndTimer();
+    }
+    return true;
+}
+}  // namespace cv_infer
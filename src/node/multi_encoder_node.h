@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "node/encoder_node.h"
+#include "node/node_base.h"
+#include "signal/signal.h"
+#include "tools/timer.h"
+
+namespace cv_infer
+{
+// 一路输入, 多路不同分辨率的输出 (e.g. 1080p / 720p / 360p)
+// 1. 每路输出由一个 OutCfg 描述, width / height 为 0 时按输入的宽高比推算, 都为 0 时与输入相同
+// 2. 按分辨率从大到小级联缩放, 每一路都从上一路的结果缩放得到
+// 3. 每一路由独立的 EncoderNode 线程编码, 各路并行
+class MultiEncoderNode : public NodeBase
+{
+public:
+    MultiEncoderNode() : NodeBase(1, 0) { SetName("MultiEncoder"); }
+    virtual ~MultiEncoderNode();
+
+    // fps of the source, e.g. DecoderNode::GetFps(), used for every cfg that does not set one
+    bool         Init(const std::vector<OutCfg> &cfgs, double source_fps = 0.0);
+    virtual bool Start() override;
+    virtual bool Stop() override;
+    virtual bool Run() override;
+    virtual bool Worker() override { return true; };
+
+    // frames waiting for the slowest rendition before the input stops being consumed
+    void SetMaxPendingFrames(std::size_t frames) { MaxPendingFrames = frames == 0 ? 1 : frames; }
+
+    // fills width / height of every cfg from the source size, order: indices of cfgs from the largest to the smallest
+    static bool ResolveSizes(const cv::Size &source, std::vector<OutCfg> &cfgs, std::vector<std::size_t> &order);
+
+private:
+    struct Rendition
+    {
+        OutCfg                       cfg;
+        cv::Size                     size;  // resolved on the first frame
+        std::shared_ptr<EncoderNode> encoder;
+        SignalQuePtr                 input;
+    };
+
+    bool ResolveSizes(const cv::Size &source);
+    bool PushOneFrame(const std::shared_ptr<SignalImageBGR> &image);
+
+    std::vector<Rendition> Renditions;  // largest first
+    bool                   SizeResolved     = false;
+    bool                   SizeFailed       = false;  // an encoder failed to open, frames are dropped until Init()
+    std::size_t            MaxPendingFrames = 8;
+
+    Timer CostTimer{"multi_encoder", true};
+};
+}  // namespace cv_infer
@@ -0,0 +1,106 @@
+#include "packet_writer.h"
+
+#include "tools/logger.h"
+
+namespace cv_infer
+{
+bool PacketWriter::Open(const std::string& url, const AVCodecParameters* par, AVRational time_base, bool make_zero)
+{
+    if (IsOpen())
+    {
+        LOGE("[%s] is still open", Url.c_str());
+        return false;
+    }
+    if (url.empty() or par == nullptr)
+    {
+        LOGE("url is empty or codec parameters is nullptr");
+        return false;
+    }
+    Url       = url;
+    PacketNum = 0;
+    if (auto ret = avformat_alloc_output_context2(&Ctx, nullptr, nullptr, Url.c_str()); ret < 0)
+    {
+        LOGE("avformat_alloc_output_context2 return [%d]", ret);
+        return false;
+    }
+    if (St = avformat_new_stream(Ctx, nullptr); St == nullptr)
+    {
+        LOGE("avformat_new_stream return nullptr");
+        Close();
+        return false;
+    }
+    if (auto r = avcodec_parameters_copy(St->codecpar, par); r < 0)
+    {
+        LOGE("avcodec_parameters_copy return [%d]", r);
+        Close();
+        return false;
+    }
+    // the source container's tag may not be valid in the output one, let the muxer choose
+    St->codecpar->codec_tag = 0;
+    St->time_base           = time_base;
+    if (make_zero)
+    {
+        Ctx->avoid_negative_ts = AVFMT_AVOID_NEG_TS_MAKE_ZERO;
+    }
+
+    if (auto r = avio_open(&Ctx->pb, Ctx->url, AVIO_FLAG_WRITE); r != 0)
+    {
+        LOGE("avio_open [%s] return [%d]", Url.c_str(), r);
+        Close();
+        return false;
+    }
+    if (auto r = avformat_write_header(Ctx, nullptr); r < 0)
+    {
+        LOGE("avformat_write_header return [%d]", r);
+        Close();
+        return false;
+    }
+    NeedTailer = true;
+    return true;
+}
+
+bool PacketWriter::Write(const AVPacket* pkt, AVRational time_base)
+{
+    if (not NeedTailer)
+    {
+        return false;
+    }
+    // the packet may still be referenced by other nodes, write a reference of our own
+    AVPacket* ref = av_packet_clone(pkt);
+    if (ref == nullptr)
+    {
+        LOGW("av_packet_clone return nullptr");
+        return false;
+    }
+    av_packet_rescale_ts(ref, time_base, St->time_base);
+    ref->stream_index = St->index;
+    ref->pos          = -1;
+    auto r            = av_write_frame(Ctx, ref);
+    av_packet_free(&ref);
+    if (r < 0)
+    {
+        LOGW("av_write_frame return [%d]", r);
+        return false;
+    }
+    ++PacketNum;
+    return true;
+}
+
+bool PacketWriter::Close()
+{
+    if (NeedTailer)
+    {
+        av_write_trailer(Ctx);
+        NeedTailer = false;
+        LOGI("wrote [%lu] packets into [%s]", PacketNum, Url.c_str());
+    }
+    if (Ctx != nullptr)
+    {
+        avio_closep(&Ctx->pb);
+        avformat_free_context(Ctx);
+        Ctx = nullptr;
+        St  = nullptr;
+    }
+    return true;
+}
+}  // namespace cv_infer
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+}
+
+namespace cv_infer
+{
+// 把已经编码好的包写入一个新的容器, 不解码也不重新编码
+class PacketWriter
+{
+public:
+    PacketWriter() = default;
+    ~PacketWriter() { Close(); }
+
+    PacketWriter(const PacketWriter&)            = delete;
+    PacketWriter& operator=(const PacketWriter&) = delete;
+
+    // par / time_base describe the source stream, make_zero shifts the first timestamp of the file to 0
+    bool Open(const std::string& url, const AVCodecParameters* par, AVRational time_base, bool make_zero = false);
+    // pkt is not modified, time_base is the one its timestamps are in
+    bool Write(const AVPacket* pkt, AVRational time_base);
+    bool Close();
+
+    bool          IsOpen() const { return Ctx != nullptr; }
+    std::uint64_t GetPacketNum() const { return PacketNum; }
+
+private:
+    std::string      Url;
+    AVFormatContext* Ctx        = nullptr;
+    AVStream*        St         = nullptr;
+    bool             NeedTailer = false;
+    std::uint64_t    PacketNum  = 0;
+};
+}  // namespace cv_infer
@@ -0,0 +1,142 @@
+#include "remux_node.h"
+
+#include <chrono>
+#include <iomanip>
+#include <thread>
+
+#include "tools/logger.h"
+
+namespace cv_infer
+{
+RemuxNode::~RemuxNode()
+{
+    Stop();
+    if (not Close()) LOGE("Close failed");
+}
+
+bool RemuxNode::Init(const std::string &out_url, const AVCodecParameters *par, AVRational time_base, double fps)
+{
+    if (out_url.empty() or par == nullptr)
+    {
+        LOGE("out_url is empty or codec parameters is nullptr");
+        return false;
+    }
+    OutUrl = out_url;
+    Fps    = fps;
+    if (not Writer.Open(OutUrl, par, time_base))
+    {
+        return false;
+    }
+
+    if (not DetectionFile)
+    {
+        DetectionFile = OutUrl + ".det.jsonl";
+    }
+    if (not DetectionFile->empty())
+    {
+        Sidecar.open(*DetectionFile, std::ios::trunc);
+        if (not Sidecar)
+        {
+            LOGE("can't open detection file [%s]", DetectionFile->c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RemuxNode::Close()
+{
+    Writer.Close();
+    if (Sidecar.is_open())
+    {
+        Sidecar.close();
+    }
+    return true;
+}
+
+bool RemuxNode::WritePacket(const SignalPacket &packet)
+{
+    return Writer.Write(packet.Val.get(), AVRational{packet.TimeBaseNum, packet.TimeBaseDen});
+}
+
+bool RemuxNode::WriteDetections(const SignalDetections &detections)
+{
+    if (not Sidecar.is_open())
+    {
+        return true;
+    }
+    Sidecar << "{\"frame\":" << detections.FrameIdx;
+    if (Fps > 0.0)
+    {
+        Sidecar << ",\"time\":" << std::fixed << std::setprecision(3) << detections.FrameIdx / Fps
+                << std::defaultfloat;
+    }
+    Sidecar << ",\"boxes\":[";
+    const auto& val = detections.Val;
+    for (std::size_t i = 0; i < val.Size(); ++i)
+    {
+        const auto& box = val[i];
+        Sidecar << (i == 0 ? "[" : ",[") << box.x1 << "," << box.y1 << "," << box.x2 << "," << box.y2 << ","
+                << box.score << "," << box.class_id;
+        const Keypoint* keypoints = val.KeypointsOf(i);
+        for (int k = 0; k < val.keypoint_num; ++k)
+        {
+            Sidecar << "," << keypoints[k].x << "," << keypoints[k].y << "," << keypoints[k].score;
+        }
+        Sidecar << "]";
+    }
+    Sidecar << "]}\n";
+    return static_cast<bool>(Sidecar);
+}
+
+bool RemuxNode::HandleSignal(const SignalBasePtr &signal)
+{
+    switch (signal->GetSignalType())
+    {
+        case SignalType::SIGNAL_PACKET:
+            return WritePacket(*std::static_pointer_cast<SignalPacket>(signal));
+        case SignalType::SIGNAL_DETECTIONS:
+            return WriteDetections(*std::static_pointer_cast<SignalDetections>(signal));
+        default:
+            LOGE("RemuxNode can't handle signal type [%d]", static_cast<int>(signal->GetSignalType()));
+            return false;
+    }
+}
+
+bool RemuxNode::Run()
+{
+    if (not Writer.IsOpen())
+    {
+        LOGE("RemuxNode is not initialized");
+        return false;
+    }
+    // packets and detections arrive independently, neither input waits for the other
+    auto drain_once = [this]() {
+        bool got = false;
+        for (auto &input : InputList)
+        {
+            SignalBasePtr signal;
+            if (input->Pop(signal))
+            {
+                got = true;
+                CostTimer.StartTimer();
+                HandleSignal(signal);
+                CostTimer.EndTimer();
+            }
+        }
+        return got;
+    };
+    while (Running)
+    {
+        if (not drain_once())
+        {
+            std::this_thread::sleep_for(SleepTime);
+        }
+    }
+    // whatever was queued before Stop() still belongs to the file
+    while (drain_once())
+    {
+    }
+    return true;
+}
+}  // namespace cv_infer
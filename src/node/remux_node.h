@@ -0,0 +1,48 @@
+#pragma once
+
+#include <fstream>
+#include <optional>
+#include <string>
+
+#include "node/node_base.h"
+#include "node/packet_writer.h"
+#include "signal/signal.h"
+#include "tools/timer.h"
+
+namespace cv_infer
+{
+// 不重新编码, 原始的压缩包直接封装到新的容器, 检测结果写到旁路文件
+// 1. input 0: SignalDetections, InferNode::SetOverlay(false)
+// 2. input 1: SignalPacket, DecoderNode::SetForwardPackets(true), bind with PipelineBase::Bind(decoder, remux)
+// 3. 旁路文件每行一个 json: {"frame":12,"time":0.400,"boxes":[[x_min,y_min,x_max,y_max,score,class],...]}
+//    模型输出关键点时每个框后面依次追加 x,y,score
+class RemuxNode : public NodeBase
+{
+public:
+    RemuxNode() : NodeBase(2, 0) { SetName("Remux"); }
+    virtual ~RemuxNode();
+
+    // stream parameters of the source, e.g. DecoderNode::GetCodecParameters() / GetTimeBase() / GetFps()
+    bool         Init(const std::string &out_url, const AVCodecParameters *par, AVRational time_base, double fps);
+    virtual bool Run() override;
+    virtual bool Worker() override { return true; };
+
+    // default is "<out_url>.det.jsonl", empty drops the detections. set before Init()
+    void SetDetectionFile(const std::string &path) { DetectionFile = path; }
+
+private:
+    bool Close();
+    bool HandleSignal(const SignalBasePtr &signal);
+    bool WritePacket(const SignalPacket &packet);
+    bool WriteDetections(const SignalDetections &detections);
+
+    std::string                OutUrl;
+    std::optional<std::string> DetectionFile;
+    std::ofstream              Sidecar;
+
+    PacketWriter Writer;
+    double       Fps = 0.0;
+
+    Timer CostTimer{"remux", true};
+};
+}  // namespace cv_infer
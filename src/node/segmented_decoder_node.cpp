@@ -0,0 +1,284 @@
+#include "segmented_decoder_node.h"
+
+#include <future>
+#include <opencv2/opencv.hpp>
+
+#include "signal/signal.h"
+#include "tools/logger.h"
+#include "tools/threadpool.h"
+
+namespace cv_infer
+{
+bool SegmentedDecoderNode::Init(const std::string &source)
+{
+    if (source.empty())
+    {
+        LOGE("SegmentedDecoderNode source is empty");
+        return false;
+    }
+    URI = source;
+
+    AVFormatContext *raw_ctx = nullptr;
+    if (auto ret = avformat_open_input(&raw_ctx, URI.c_str(), nullptr, nullptr); ret != 0)
+    {
+        LOGE("call avformat_open_input return [%d], source = [%s]", ret, URI.c_str());
+        return false;
+    }
+    AVFormatInputPtr ctx{raw_ctx};
+    StreamIdx = av_find_best_stream(ctx.get(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (StreamIdx < 0)
+    {
+        LOGE("find AVMEDIA_TYPE_VIDEO failed");
+        return false;
+    }
+    auto *st  = ctx->streams[StreamIdx];
+    TimeBase  = st->time_base;
+    StreamFps = av_q2d(av_guess_frame_rate(ctx.get(), st, nullptr));
+    StartTime = st->start_time == AV_NOPTS_VALUE ? 0 : st->start_time;
+
+    KeyFrameIndex index;
+    std::uint64_t frame_count = 0;
+    if (not BuildKeyFrameIndex(ctx.get(), StreamIdx, index, frame_count))
+    {
+        LOGE("BuildKeyFrameIndex failed, source = [%s]", URI.c_str());
+        return false;
+    }
+
+    // GOP aligned ranges, each range holds a run of whole GOPs
+    auto segment_num = SegmentNum > 0 ? static_cast<std::size_t>(SegmentNum) : static_cast<std::size_t>(WorkerNum) * 4;
+    auto range_num   = std::min(index.size(), segment_num);
+    Ranges.clear();
+    for (std::size_t r = 0; r < range_num; ++r)
+    {
+        auto first_gop = r * index.size() / range_num;
+        auto end_gop   = (r + 1) * index.size() / range_num;
+        Ranges.push_back({index[first_gop], end_gop < index.size() ? index[end_gop].frame_idx : frame_count});
+    }
+    LOGI("Source [%s] frames = [%lu], key frames = [%zu], ranges = [%zu]", URI.c_str(), frame_count, index.size(),
+         Ranges.size());
+    return true;
+}
+
+std::int64_t SegmentedDecoderNode::GetFrameNumber(std::int64_t pts) const
+{
+    if (pts == AV_NOPTS_VALUE or StreamFps <= 0.0)
+    {
+        return -1;
+    }
+    return std::max<std::int64_t>(0, std::llround((pts - StartTime) * av_q2d(TimeBase) * StreamFps));
+}
+
+bool SegmentedDecoderNode::DecodeRange(std::size_t range_idx)
+{
+    const auto &range = Ranges[range_idx];
+    auto       &que   = *RangeQues[range_idx];
+    // the consumer waits for the queue to be closed, close it on every path
+    std::unique_ptr<BoundedQueue<SignalBasePtr>, void (*)(BoundedQueue<SignalBasePtr> *)> close_guard{
+        &que, [](BoundedQueue<SignalBasePtr> *q) { q->Close(); }};
+
+    AVFormatContext *raw_ctx = nullptr;
+    if (auto ret = avformat_open_input(&raw_ctx, URI.c_str(), nullptr, nullptr); ret != 0)
+    {
+        LOGE("call avformat_open_input return [%d], range = [%zu]", ret, range_idx);
+        return false;
+    }
+    AVFormatInputPtr ctx{raw_ctx};
+    auto            *par     = ctx->streams[StreamIdx]->codecpar;
+    const auto      *decoder = avcodec_find_decoder(par->codec_id);
+    if (decoder == nullptr)
+    {
+        LOGE("avcodec_find_decoder failed, codec id = [%d]", par->codec_id);
+        return false;
+    }
+    AVCodecContextPtr cctx{avcodec_alloc_context3(decoder)};
+    if (cctx == nullptr or avcodec_parameters_to_context(cctx.get(), par) < 0)
+    {
+        LOGE("create decoder context failed, range = [%zu]", range_idx);
+        return false;
+    }
+    cctx->thread_count = 1;  // parallelism comes from the ranges
+    if (auto ret = avcodec_open2(cctx.get(), decoder, nullptr); ret != 0)
+    {
+        LOGE("avcodec_open2 return [%d], range = [%zu]", ret, range_idx);
+        return false;
+    }
+
+    auto seek_ts = range.start.dts != AV_NOPTS_VALUE ? range.start.dts : range.start.pts;
+    if (auto ret = av_seek_frame(ctx.get(), StreamIdx, seek_ts, AVSEEK_FLAG_BACKWARD); ret < 0)
+    {
+        LOGE("av_seek_frame to [%ld] return [%d], range = [%zu]", seek_ts, ret, range_idx);
+        return false;
+    }
+
+    AVPacketPtr  pkt{av_packet_alloc()};
+    AVFramePtr   frame{av_frame_alloc()};
+    SwsConverter converter(1, OutFlags);
+    if (pkt == nullptr or frame == nullptr)
+    {
+        LOGE("alloc packet or frame failed");
+        return false;
+    }
+
+    // frames outside [begin_number, end_number) belong to the neighbour ranges, -1: not bounded
+    std::int64_t  begin_number = -1;
+    std::int64_t  end_number   = -1;
+    std::uint64_t output_num   = 0;
+    auto          drain        = [&]() -> bool
+    {
+        while (avcodec_receive_frame(cctx.get(), frame.get()) == 0)
+        {
+            // the packet count of the key frame is in decode order, number by pts wherever it is known
+            auto number = GetFrameNumber(frame->best_effort_timestamp);
+            if (number >= 0 and (number < begin_number or (end_number >= 0 and number >= end_number)))
+            {
+                av_frame_unref(frame.get());
+                continue;
+            }
+            cv::Mat image;
+            auto    converted = converter.ToBGR(frame.get(), image);
+            av_frame_unref(frame.get());
+            if (not converted)
+            {
+                continue;
+            }
+
+            auto frame_idx = number >= 0 ? static_cast<std::uint64_t>(number) : range.start.frame_idx + output_num;
+            ++output_num;
+
+            SignalBasePtr signal = std::make_shared<SignalImageBGR>(image);
+            signal->FrameIdx     = frame_idx;
+            signal->TimeStamps.push_back(std::chrono::steady_clock::now());
+            while (not que.Push(std::move(signal), SleepTime))
+            {
+                if (not Running or que.IsClosed())
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    // the seek lands on or before our key frame, skip until it, then take the packets of this range. in an open GOP
+    // the leading frames of the next key frame follow it in decode order but are shown before it: they are decoded
+    // here, together with the next key frame they refer to, and dropped by the next range
+    const auto    packet_num = range.end_frame - range.start.frame_idx;
+    std::uint64_t sent       = 0;
+    std::int64_t  end_pts    = AV_NOPTS_VALUE;
+    bool          started    = false;
+    while (Running and av_read_frame(ctx.get(), pkt.get()) == 0)
+    {
+        std::unique_ptr<AVPacket, decltype(av_packet_unref) *> unref_guard{pkt.get(), av_packet_unref};
+        if (pkt->stream_index != StreamIdx)
+        {
+            continue;
+        }
+        if (not started)
+        {
+            bool at_start = (range.start.pos >= 0 and pkt->pos >= 0) ? pkt->pos >= range.start.pos
+                                                                     : pkt->dts >= range.start.dts;
+            if (not at_start or not(pkt->flags & AV_PKT_FLAG_KEY))
+            {
+                continue;
+            }
+            started      = true;
+            begin_number = range_idx == 0 ? -1 : GetFrameNumber(pkt->pts);
+        }
+        if (sent == packet_num)
+        {
+            // the next range's key frame, without its pts there is no telling its leading frames apart
+            end_pts    = pkt->pts;
+            end_number = GetFrameNumber(end_pts);
+            if (end_number < 0)
+            {
+                break;
+            }
+        }
+        else if (sent > packet_num and (pkt->pts == AV_NOPTS_VALUE or pkt->pts >= end_pts))
+        {
+            break;
+        }
+        ++sent;
+        if (auto ret = avcodec_send_packet(cctx.get(), pkt.get()); ret != 0)
+        {
+            LOGT("can't send packet to decoder, return [%d]", ret);
+            continue;
+        }
+        if (not drain())
+        {
+            return false;
+        }
+    }
+    avcodec_send_packet(cctx.get(), nullptr);
+    if (not drain())
+    {
+        return false;
+    }
+    LOGD("range [%zu] done, packets = [%lu], frames = [%lu]", range_idx, sent, output_num);
+    return true;
+}
+
+bool SegmentedDecoderNode::Run()
+{
+    if (Ranges.empty())
+    {
+        LOGE("SegmentedDecoderNode not initialized");
+        return false;
+    }
+    RangeQues.clear();
+    for (std::size_t i = 0; i < Ranges.size(); ++i)
+    {
+        RangeQues.push_back(std::make_unique<BoundedQueue<SignalBasePtr>>(BufferFrames));
+    }
+
+    ThreadPool pool(static_cast<std::uint8_t>(std::min(WorkerNum, 255)));
+    pool.Start();
+    std::vector<std::future<bool>> futures(Ranges.size());
+
+    // at most WorkerNum ranges in flight, bounds the memory held by decoded frames
+    std::size_t next_submit = 0;
+    for (std::size_t cur = 0; Running and cur < Ranges.size(); ++cur)
+    {
+        for (; next_submit < Ranges.size() and next_submit < cur + WorkerNum; ++next_submit)
+        {
+            futures[next_submit] = pool.Commit(&SegmentedDecoderNode::DecodeRange, this, next_submit);
+        }
+        auto         &que = *RangeQues[cur];
+        SignalBasePtr signal;
+        while (Running)
+        {
+            if (que.Pop(signal, SleepTime))
+            {
+                OutputList[0]->Push(std::move(signal));
+            }
+            else if (que.IsClosed() and que.Empty())
+            {
+                break;
+            }
+        }
+        if (futures[cur].valid() and not futures[cur].get())
+        {
+            LOGW("decode range [%zu] failed, frames [%lu, %lu) are missing", cur, Ranges[cur].start.frame_idx,
+                 Ranges[cur].end_frame);
+        }
+        RangeQues[cur].reset();
+    }
+
+    for (std::size_t i = 0; i < next_submit; ++i)
+    {
+        if (RangeQues[i] != nullptr)
+        {
+            RangeQues[i]->Close();
+        }
+    }
+    for (auto &future : futures)
+    {
+        if (future.valid())
+        {
+            future.wait();
+        }
+    }
+    LOGW("segmented decoder done, exit !!");
+    return true;
+}
+}  // namespace cv_infer
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "node/av_helper.h"
+#include "node/keyframe_index.h"
+#include "node/node_base.h"
+#include "node/sws_converter.h"
+#include "tools/queue.h"
+
+namespace cv_infer
+{
+// 单个长视频文件的并行解码
+// 1. Init 时建立关键帧索引, 按 GOP 边界把文件切分成若干段
+// 2. 每段在线程池中用独立的 AVFormatContext/AVCodecContext 解码
+// 3. Run 按段顺序输出, FrameIdx 为该帧在整个文件中的序号, 有 pts 时按 pts 推算 (同 DecoderNode)
+// 4. open GOP 中下一段关键帧的前导帧 (解码顺序在后, 显示顺序在前) 由本段多解码下一个关键帧得到, 下一段丢弃它们
+// 只适用于可 seek 的文件
+class SegmentedDecoderNode : public NodeBase
+{
+public:
+    SegmentedDecoderNode() : NodeBase(0, 1) { SetName("SegmentedDecoder"); }
+    virtual ~SegmentedDecoderNode() = default;
+
+    bool         Init(const std::string& source);
+    virtual bool Run() override;
+    virtual bool Worker() override { return true; };
+
+    // set before Init(), segment num defaults to 4 * worker num
+    void SetWorkerNum(int worker_num) { WorkerNum = std::max(1, worker_num); }
+    void SetSegmentNum(int segment_num) { SegmentNum = segment_num; }
+    // decoded frames buffered per in-flight segment
+    void SetBufferFrames(std::size_t frames) { BufferFrames = std::max<std::size_t>(1, frames); }
+
+private:
+    struct Range
+    {
+        KeyFrameEntry start;
+        std::uint64_t end_frame = 0;  // frame_idx of the next range's key frame, exclusive
+    };
+
+    bool         DecodeRange(std::size_t range_idx);
+    // display order frame number from the pts, -1 when the pts or the frame rate is unknown
+    std::int64_t GetFrameNumber(std::int64_t pts) const;
+
+    std::string  URI;
+    int          StreamIdx    = -1;
+    int          WorkerNum    = 4;
+    int          SegmentNum   = 0;
+    std::size_t  BufferFrames = 16;
+    int          OutFlags     = SWS_BILINEAR;
+    AVRational   TimeBase     = {0, 1};
+    double       StreamFps    = 0.0;
+    std::int64_t StartTime    = 0;
+
+    std::vector<Range>                                        Ranges;
+    std::vector<std::unique_ptr<BoundedQueue<SignalBasePtr>>> RangeQues;
+};
+}  // namespace cv_infer
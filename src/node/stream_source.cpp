@@ -0,0 +1,147 @@
+#include "stream_source.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "tools/logger.h"
+
+namespace cv_infer
+{
+bool StreamSource::Submit(Chunk chunk)
+{
+    if (chunk == nullptr)
+    {
+        return Submit(std::shared_ptr<const void>(), 0);
+    }
+    // aliasing: the bytes are the vector's, the vector is kept alive with them
+    const auto *bytes = chunk->data();
+    auto        size  = chunk->size();
+    return Submit(std::shared_ptr<const void>(std::move(chunk), bytes), size);
+}
+
+bool StreamSource::Submit(std::shared_ptr<const void> data, std::size_t size)
+{
+    if (Read)
+    {
+        LOGE("StreamSource is created with a read callback, Submit is not allowed");
+        return false;
+    }
+    if (Aborted)
+    {
+        return false;
+    }
+    if (data == nullptr or size == 0)
+    {
+        return true;
+    }
+    Block block;
+    block.data  = static_cast<const std::uint8_t *>(data.get());
+    block.size  = size;
+    block.owner = std::move(data);
+    while (not Chunks.Push(std::move(block), WaitTime))
+    {
+        if (Chunks.IsClosed())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StreamSource::Finish() { Chunks.Close(); }
+
+void StreamSource::Abort()
+{
+    Aborted = true;
+    Chunks.Close();
+}
+
+void StreamSource::Interrupt() { Interrupted = true; }
+
+void StreamSource::Resume() { Interrupted = false; }
+
+AVIOContext *StreamSource::CreateAVIOContext(int buffer_size)
+{
+    auto *buffer = static_cast<std::uint8_t *>(av_malloc(buffer_size));
+    if (buffer == nullptr)
+    {
+        LOGE("av_malloc [%d] bytes failed", buffer_size);
+        return nullptr;
+    }
+    auto *ctx = avio_alloc_context(buffer, buffer_size, 0, this, &StreamSource::ReadPacket, nullptr,
+                                   Seek ? &StreamSource::SeekPacket : nullptr);
+    if (ctx == nullptr)
+    {
+        LOGE("avio_alloc_context return nullptr");
+        av_free(buffer);
+    }
+    return ctx;
+}
+
+void StreamSource::FreeAVIOContext(AVIOContext **ctx)
+{
+    if (ctx == nullptr or *ctx == nullptr)
+    {
+        return;
+    }
+    // the buffer may have been replaced by ffmpeg, free the current one
+    av_freep(&(*ctx)->buffer);
+    avio_context_free(ctx);
+}
+
+int StreamSource::ReadPacket(void *opaque, std::uint8_t *buf, int buf_size)
+{
+    auto *source = static_cast<StreamSource *>(opaque);
+    if (source->Stopped())
+    {
+        return AVERROR_EXIT;
+    }
+    if (source->Read)
+    {
+        // a failed read is not a clean end, a truncated input must not look like a complete one
+        auto ret = source->Read(buf, buf_size);
+        return ret > 0 ? ret : (ret == 0 ? AVERROR_EOF : AVERROR(EIO));
+    }
+    return source->ReadChunks(buf, buf_size);
+}
+
+std::int64_t StreamSource::SeekPacket(void *opaque, std::int64_t offset, int whence)
+{
+    auto *source = static_cast<StreamSource *>(opaque);
+    return source->Seek(offset, whence);
+}
+
+int StreamSource::ReadChunks(std::uint8_t *buf, int buf_size)
+{
+    int filled = 0;
+    while (filled < buf_size)
+    {
+        if (Current.owner == nullptr or Offset >= Current.size)
+        {
+            Current = Block();
+            Offset  = 0;
+            // return what we have rather than waiting for more, the demuxer asks again
+            if (filled > 0 and Chunks.Empty())
+            {
+                break;
+            }
+            while (not Chunks.Pop(Current, WaitTime))
+            {
+                if (Stopped())
+                {
+                    return filled > 0 ? filled : AVERROR_EXIT;
+                }
+                if (Chunks.IsClosed() and Chunks.Empty())
+                {
+                    return filled > 0 ? filled : AVERROR_EOF;
+                }
+            }
+        }
+        auto size = std::min<std::size_t>(buf_size - filled, Current.size - Offset);
+        std::memcpy(buf + filled, Current.data + Offset, size);
+        Offset += size;
+        filled += static_cast<int>(size);
+    }
+    return filled;
+}
+}  // namespace cv_infer
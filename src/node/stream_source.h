@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "tools/queue.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+namespace cv_infer
+{
+// 内存中的编码数据输入, 给 DecoderNode 提供自定义 AVIOContext, 不经过临时文件
+// 1. 推模式: 调用方 Submit 编码数据块, 数据块以 shared_ptr 入队, 不拷贝, 直到被 demuxer 读取
+// 2. 拉模式: 构造时给出读回调 (可选 seek 回调), demuxer 需要数据时直接调用
+// 推模式下 demuxer 读数据时会阻塞等待, Finish 之后读完剩余数据返回 EOF, Abort 立即返回
+// Interrupt 只唤醒当前的读取, Resume 之后可以继续读, 用于读取方 (DecoderNode) 的 Stop/Start
+class StreamSource
+{
+public:
+    using Chunk    = std::shared_ptr<const std::vector<std::uint8_t>>;
+    using ReadFunc = std::function<int(std::uint8_t* buf, int size)>;  // bytes read, 0: end of stream, < 0: error
+    using SeekFunc = std::function<std::int64_t(std::int64_t offset, int whence)>;  // lseek like, plus AVSEEK_SIZE
+
+    explicit StreamSource(std::size_t max_chunks = 256) : Chunks(max_chunks) {}
+    StreamSource(ReadFunc read, SeekFunc seek = nullptr) : Read(std::move(read)), Seek(std::move(seek)) {}
+
+    StreamSource(const StreamSource&)            = delete;
+    StreamSource& operator=(const StreamSource&) = delete;
+
+    // block while max_chunks are queued, false after Finish/Abort
+    bool Submit(Chunk chunk);
+    bool Submit(std::vector<std::uint8_t>&& data)
+    {
+        return Submit(std::make_shared<const std::vector<std::uint8_t>>(std::move(data)));
+    }
+    // size bytes at data.get(), not copied. the caller's buffer is released when the demuxer has read it, an
+    // aliasing shared_ptr can point into a larger buffer
+    bool Submit(std::shared_ptr<const void> data, std::size_t size);
+    // copied, the caller keeps its buffer
+    bool Submit(const std::uint8_t* data, std::size_t size)
+    {
+        return Submit(std::vector<std::uint8_t>(data, data + size));
+    }
+
+    void Finish();  // no more data, end of stream after the queued chunks
+    void Abort();   // stop for good, pending and later reads return AVERROR_EXIT, Submit fails
+    // wake a blocked read and fail reads with AVERROR_EXIT until Resume(), the queued data and Submit are untouched
+    void Interrupt();
+    void Resume();
+
+    // the caller owns the context, free it with FreeAVIOContext after avformat_close_input
+    AVIOContext* CreateAVIOContext(int buffer_size = 64 * 1024);
+    static void  FreeAVIOContext(AVIOContext** ctx);
+
+private:
+    static int          ReadPacket(void* opaque, std::uint8_t* buf, int buf_size);
+    static std::int64_t SeekPacket(void* opaque, std::int64_t offset, int whence);
+    int                 ReadChunks(std::uint8_t* buf, int buf_size);
+    bool                Stopped() const { return Aborted or Interrupted; }
+
+    struct Block
+    {
+        std::shared_ptr<const void> owner;
+        const std::uint8_t*         data = nullptr;
+        std::size_t                 size = 0;
+    };
+
+    ReadFunc Read;
+    SeekFunc Seek;
+
+    BoundedQueue<Block> Chunks{1};
+    Block               Current;
+    std::size_t         Offset = 0;
+    std::atomic_bool    Aborted{false};
+    std::atomic_bool    Interrupted{false};
+
+    std::chrono::milliseconds WaitTime{10};
+};
+}  // namespace cv_infer
@@ -0,0 +1,145 @@
+#include "sws_converter.h"
+
+#include <algorithm>
+
+#include "tools/logger.h"
+
+extern "C"
+{
+#include <libavutil/opt.h>
+}
+
+namespace cv_infer
+{
+static void NoopFree(void *, std::uint8_t *) {}
+
+// the buffer ref lets sws_scale_frame use the Mat memory instead of allocating its own
+static bool WrapMat(const cv::Mat &mat, AVFrame *frame)
+{
+    frame->format      = AV_PIX_FMT_BGR24;
+    frame->width       = mat.cols;
+    frame->height      = mat.rows;
+    frame->data[0]     = mat.data;
+    frame->linesize[0] = static_cast<int>(mat.step[0]);
+    frame->buf[0]      = av_buffer_create(mat.data, mat.step[0] * mat.rows, NoopFree, nullptr, 0);
+    return frame->buf[0] != nullptr;
+}
+
+void SwsConverter::SetThreads(int threads)
+{
+    threads = std::max(1, threads);
+    if (threads != Threads)
+    {
+        Threads = threads;
+        Reset();
+    }
+}
+
+void SwsConverter::Reset()
+{
+    if (Ctx != nullptr)
+    {
+        sws_freeContext(Ctx);
+        Ctx = nullptr;
+    }
+    SrcW = SrcH = DstW = DstH = 0;
+    SrcFmt = DstFmt = AV_PIX_FMT_NONE;
+}
+
+bool SwsConverter::Prepare(int src_w, int src_h, AVPixelFormat src_fmt, int dst_w, int dst_h, AVPixelFormat dst_fmt)
+{
+    if (Ctx != nullptr and src_w == SrcW and src_h == SrcH and src_fmt == SrcFmt and dst_w == DstW and
+        dst_h == DstH and dst_fmt == DstFmt)
+    {
+        return true;
+    }
+    Reset();
+    if (Threads == 1)
+    {
+        Ctx = sws_getContext(src_w, src_h, src_fmt, dst_w, dst_h, dst_fmt, Flags, nullptr, nullptr, nullptr);
+    }
+    else
+    {
+        // the threads option is only reachable through the AVOptions of an allocated context
+        Ctx = sws_alloc_context();
+        if (Ctx != nullptr)
+        {
+            av_opt_set_int(Ctx, "srcw", src_w, 0);
+            av_opt_set_int(Ctx, "srch", src_h, 0);
+            av_opt_set_int(Ctx, "src_format", src_fmt, 0);
+            av_opt_set_int(Ctx, "dstw", dst_w, 0);
+            av_opt_set_int(Ctx, "dsth", dst_h, 0);
+            av_opt_set_int(Ctx, "dst_format", dst_fmt, 0);
+            av_opt_set_int(Ctx, "sws_flags", Flags, 0);
+            av_opt_set_int(Ctx, "threads", Threads, 0);
+            if (auto ret = sws_init_context(Ctx, nullptr, nullptr); ret < 0)
+            {
+                LOGE("sws_init_context return [%d]", ret);
+                sws_freeContext(Ctx);
+                Ctx = nullptr;
+            }
+        }
+    }
+    if (Ctx == nullptr)
+    {
+        LOGE("create SwsContext failed, [%dx%d fmt %d] -> [%dx%d fmt %d]", src_w, src_h, src_fmt, dst_w, dst_h,
+             dst_fmt);
+        return false;
+    }
+    SrcW   = src_w;
+    SrcH   = src_h;
+    SrcFmt = src_fmt;
+    DstW   = dst_w;
+    DstH   = dst_h;
+    DstFmt = dst_fmt;
+    return true;
+}
+
+bool SwsConverter::Scale(const AVFrame *src, AVFrame *dst)
+{
+    if (Threads == 1)
+    {
+        sws_scale(Ctx, src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+        return true;
+    }
+    if (auto ret = sws_scale_frame(Ctx, dst, src); ret < 0)
+    {
+        LOGW("sws_scale_frame return [%d]", ret);
+        return false;
+    }
+    return true;
+}
+
+bool SwsConverter::ToBGR(const AVFrame *src, cv::Mat &dst)
+{
+    if (not Prepare(src->width, src->height, static_cast<AVPixelFormat>(src->format), src->width, src->height,
+                    AV_PIX_FMT_BGR24))
+    {
+        return false;
+    }
+    dst.create(src->height, src->width, CV_8UC3);
+    if (not WrapMat(dst, MatFrame.get()))
+    {
+        return false;
+    }
+    auto ret = Scale(src, MatFrame.get());
+    av_frame_unref(MatFrame.get());
+    return ret;
+}
+
+bool SwsConverter::FromBGR(const cv::Mat &src, AVFrame *dst)
+{
+    if (not Prepare(src.cols, src.rows, AV_PIX_FMT_BGR24, dst->width, dst->height,
+                    static_cast<AVPixelFormat>(dst->format)))
+    {
+        return false;
+    }
+    if (not WrapMat(src, MatFrame.get()))
+    {
+        return false;
+    }
+    auto ret = Scale(MatFrame.get(), dst);
+    av_frame_unref(MatFrame.get());
+    return ret;
+}
+}  // namespace cv_infer
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include "node/av_helper.h"
+
+extern "C"
+{
+#include <libswscale/swscale.h>
+}
+
+namespace cv_infer
+{
+// BGR24 cv::Mat <-> AVFrame 转换
+// threads > 1 时使用 swscale 自带的 slice 线程 (sws_scale_frame), 输出按行切片并行计算,
+// 每一行的计算与单线程完全相同, 结果逐字节一致; threads == 1 时走 sws_scale
+// SwsContext 按几何尺寸/格式缓存, 变化时重建
+class SwsConverter
+{
+public:
+    explicit SwsConverter(int threads = 1, int flags = SWS_BILINEAR) : Threads(threads), Flags(flags) {}
+    ~SwsConverter() { Reset(); }
+    SwsConverter(const SwsConverter&)            = delete;
+    SwsConverter& operator=(const SwsConverter&) = delete;
+
+    void SetThreads(int threads);
+    int  GetThreads() const { return Threads; }
+
+    // any pixel format -> BGR24 of the same size, dst is (re)allocated when needed
+    bool ToBGR(const AVFrame* src, cv::Mat& dst);
+    // BGR24 -> dst->format, scaled to dst->width x dst->height, dst must own its buffers
+    bool FromBGR(const cv::Mat& src, AVFrame* dst);
+
+    void Reset();
+
+private:
+    bool Prepare(int src_w, int src_h, AVPixelFormat src_fmt, int dst_w, int dst_h, AVPixelFormat dst_fmt);
+    bool Scale(const AVFrame* src, AVFrame* dst);
+
+    SwsContext* Ctx     = nullptr;
+    int         Threads = 1;
+    int         Flags   = SWS_BILINEAR;
+
+    int           SrcW = 0, SrcH = 0, DstW = 0, DstH = 0;
+    AVPixelFormat SrcFmt = AV_PIX_FMT_NONE;
+    AVPixelFormat DstFmt = AV_PIX_FMT_NONE;
+
+    AVFramePtr MatFrame{av_frame_alloc()};  // wraps the cv::Mat side without copying
+};
+}  // namespace cv_infer
@@ -1,5 +1,7 @@
 #include "pipeline_base.h"
 
+#include <algorithm>
+
 #include "node/node_base.h"
 #include "signal/signal.h"
 #include "tools/logger.h"
@@ -82,6 +84,14 @@ bool PipelineBase::Bind(std::shared_ptr<NodeBase> pre, std::shared_ptr<NodeBase>
         LOGE("Node [%s] AddOutputs failed", pre->GetName().c_str());
         return false;
     }
+    // extra links after BindAll (e.g. packets to a remuxer) also start and stop with the pipeline
+    for (const auto& node : {pre, next})
+    {
+        if (std::find(NodeList.begin(), NodeList.end(), node) == NodeList.end())
+        {
+            NodeList.push_back(node);
+        }
+    }
     return true;
 }
 
@@ -93,7 +103,33 @@ bool PipelineBase::SetSource(const std::string& source)
 
 bool PipelineBase::RegisterCallback(EventId event, EventCallbackFunc callback)
 {
-    CallBackMap[event] = callback;
+    if (not callback)
+    {
+        LOGE("callback is empty");
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(CallBackMutex);
+    CallBackMap[event].push_back(std::move(callback));
     return true;
 };
+
+bool PipelineBase::Notify(EventId event, const char* msg)
+{
+    // called without the lock, a callback may register another one or notify again
+    std::vector<EventCallbackFunc> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(CallBackMutex);
+        auto                        it = CallBackMap.find(event);
+        if (it == CallBackMap.end() or it->second.empty())
+        {
+            return false;
+        }
+        callbacks = it->second;
+    }
+    for (const auto& callback : callbacks)
+    {
+        callback(msg);
+    }
+    return true;
+}
 }  // namespace cv_infer
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 #include <initializer_list>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -28,7 +29,10 @@ public:
     virtual bool Bind(std::shared_ptr<NodeBase> pre,
                       std::shared_ptr<NodeBase> next);
     virtual bool SetSource(const std::string& source);
+    // callbacks of an event are kept in registration order, a new one never replaces an earlier one
     virtual bool RegisterCallback(EventId event, EventCallbackFunc callback);
+    // call every callback registered for event, false if there is none. safe from any thread
+    virtual bool Notify(EventId event, const char* msg);
 
     std::string GetName() const { return PipelineName; }
 
@@ -40,6 +44,7 @@ private:
     std::string      PipelineName = "Pipeline";
     std::string      Source;
     EventCallbackMap CallBackMap;
+    std::mutex       CallBackMutex;
 
     std::vector<std::shared_ptr<NodeBase>> NodeList;
 };
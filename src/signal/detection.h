@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace cv_infer
+{
+struct Keypoint
+{
+    float x     = 0.0f;
+    float y     = 0.0f;
+    float score = 0.0f;
+};
+
+// 单个检测框, 坐标为原图上的 [x_min, y_min, x_max, y_max]
+struct Detection
+{
+    float x1          = 0.0f;
+    float y1          = 0.0f;
+    float x2          = 0.0f;
+    float y2          = 0.0f;
+    float score       = 0.0f;
+    int   class_id    = -1;
+    int   batch_index = 0;  // 所属图片在 batch 中的序号
+};
+
+// 一次推理 (一帧或一个 batch) 的检测结果, 所有框连续存放, 不需要逐框分配
+// 关键点可选: keypoint_num > 0 时第 i 个框的关键点是 keypoints[i * keypoint_num, (i + 1) * keypoint_num)
+struct Detections
+{
+    std::vector<Detection> boxes;
+    std::vector<Keypoint>  keypoints;
+    int                    keypoint_num = 0;
+
+    std::size_t Size() const { return boxes.size(); }
+    bool        Empty() const { return boxes.empty(); }
+
+    void Reserve(std::size_t n)
+    {
+        boxes.reserve(n);
+        keypoints.reserve(n * keypoint_num);
+    }
+
+    void Clear()
+    {
+        boxes.clear();
+        keypoints.clear();
+    }
+
+    const Keypoint* KeypointsOf(std::size_t i) const
+    {
+        return keypoint_num > 0 ? keypoints.data() + i * keypoint_num : nullptr;
+    }
+
+    auto begin() const { return boxes.begin(); }
+    auto end() const { return boxes.end(); }
+
+    const Detection& operator[](std::size_t i) const { return boxes[i]; }
+};
+}  // namespace cv_infer
@@ -10,8 +10,11 @@
 #include <string>
 #include <vector>
 
+#include "signal/detection.h"
 #include "tools/queue.h"
 
+struct AVPacket;  // ffmpeg, only held by pointer here
+
 namespace cv_infer
 {
 enum class SignalType
@@ -39,6 +42,8 @@ enum class SignalType
     SIGNAL_IMAGE_RGBA,
     SIGNAL_IMAGE_BGRA,
     SIGNAL_IMAGE_YUV,
+    SIGNAL_PACKET,
+    SIGNAL_DETECTIONS,
 };
 
 struct SignalBase
@@ -153,6 +158,37 @@ struct SignalImageRGB : public SignalBase
     cv::Mat Val;
 };
 
+// 未解码的压缩包, 透传给 RemuxNode 等不需要重新编码的节点
+struct SignalPacket : public SignalBase
+{
+    // the deleter is bound by the producer, this header does not need ffmpeg
+    SignalPacket(std::shared_ptr<AVPacket> packet, int time_base_num, int time_base_den)
+        : SignalBase(SignalType::SIGNAL_PACKET), Val(std::move(packet)), TimeBaseNum(time_base_num),
+          TimeBaseDen(time_base_den)
+    {
+        if (Val == nullptr)
+        {
+            throw std::invalid_argument("The input packet is null");
+        }
+    }
+    virtual ~SignalPacket() override = default;
+
+    std::shared_ptr<AVPacket> Val;
+    int                       TimeBaseNum{0};
+    int                       TimeBaseDen{1};
+};
+
+// 一帧的检测结果, 可以为空
+struct SignalDetections : public SignalBase
+{
+    SignalDetections(Detections &&detections) : SignalBase(SignalType::SIGNAL_DETECTIONS), Val(std::move(detections))
+    {
+    }
+    virtual ~SignalDetections() override = default;
+
+    Detections Val;
+};
+
 using SignalBasePtr    = std::shared_ptr<SignalBase>;
 using SignalQue        = Queue<SignalBasePtr>;
 using SignalQuePtr     = std::shared_ptr<SignalQue>;
@@ -2,6 +2,7 @@
 
 #include <functional>
 #include <unordered_map>
+#include <vector>
 
 namespace cv_infer
 {
@@ -10,8 +11,9 @@ enum class EventId
     FirstFrameDone = 0,
     OneFrameDone,
     AllFrameDone,
+    EventTriggered,  // an application event, e.g. a detection worth a clip
 };
 using EventCallbackFunc = std::function<void(const char*)>;
-using EventCallbackMap  = std::unordered_map<EventId, EventCallbackFunc>;
+using EventCallbackMap  = std::unordered_map<EventId, std::vector<EventCallbackFunc>>;
 
 }  // namespace cv_infer
\ No newline at end of file
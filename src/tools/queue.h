@@ -1,5 +1,8 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <mutex>
 #include <queue>
 
@@ -83,4 +86,95 @@ private:
     std::mutex    Mutex;
     std::uint64_t MaxSize{100000};
 };
-}  // namespace cv_infer
\ No newline at end of file
+
+// 有界阻塞队列
+// 1. 队列满时 Push 阻塞, 队列空时 Pop 阻塞, 都支持超时
+// 2. Close 之后唤醒所有等待者, Push 失败, Pop 可以继续取完剩余元素
+// 3. 元素只需要可移动, 可以存放 unique_ptr
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(std::size_t max_size = 64) : MaxSize(max_size == 0 ? 1 : max_size) {}
+
+    BoundedQueue(const BoundedQueue&)            = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    template <typename Rep, typename Period>
+    bool Push(T&& item, std::chrono::duration<Rep, Period> timeout)
+    {
+        std::unique_lock<std::mutex> lock(Mutex);
+        if (not NotFull.wait_for(lock, timeout, [this] { return Closed or Que.size() < MaxSize; }) or Closed)
+        {
+            return false;
+        }
+        Que.push(std::move(item));
+        NotEmpty.notify_one();
+        return true;
+    }
+
+    template <typename Rep, typename Period>
+    bool Pop(T& item, std::chrono::duration<Rep, Period> timeout)
+    {
+        std::unique_lock<std::mutex> lock(Mutex);
+        if (not NotEmpty.wait_for(lock, timeout, [this] { return Closed or not Que.empty(); }) or Que.empty())
+        {
+            return false;
+        }
+        item = std::move(Que.front());
+        Que.pop();
+        NotFull.notify_one();
+        return true;
+    }
+
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            Closed = true;
+        }
+        NotEmpty.notify_all();
+        NotFull.notify_all();
+    }
+
+    // 清空并重新打开队列
+    void Reset()
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        Que    = {};
+        Closed = false;
+    }
+
+    bool IsClosed()
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        return Closed;
+    }
+
+    bool Empty()
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        return Que.empty();
+    }
+
+    size_t Size()
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        return Que.size();
+    }
+
+    void SetMaxSize(std::size_t max_size)
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        MaxSize = max_size == 0 ? 1 : max_size;
+    }
+
+private:
+    std::queue<T>           Que;
+    std::mutex              Mutex;
+    std::condition_variable NotEmpty;
+    std::condition_variable NotFull;
+    std::size_t             MaxSize{64};
+    bool                    Closed{false};
+};
+}  // namespace cv_infer
@@ -0,0 +1,54 @@
+// nms benchmark: compare the naive reference with the block and grid paths of Nms
+// usage: bench_nms [box num ...], default 100 1000 10000
+#include <chrono>
+#include <cstdlib>
+
+#include "../src/math/nms.h"
+#include "../src/tools/logger.h"
+#include "nms_reference.h"
+
+using namespace cv_infer;
+
+int main(int argc, char* argv[])
+{
+    Logger::SetLogLevel(LogLevel::INFO);
+    std::vector<int> box_nums{100, 1000, 10000};
+    if (argc > 1)
+    {
+        box_nums.clear();
+        for (int i = 1; i < argc; ++i)
+        {
+            box_nums.push_back(std::max(std::atoi(argv[i]), 1));
+        }
+    }
+
+    std::mt19937 random(0);
+    for (int n : box_nums)
+    {
+        // 每个目标 20 个框 / 4 个框
+        for (int object_num : {std::max(n / 20, 1), std::max(n / 4, 1)})
+        {
+            auto     boxes = RandomNmsBoxes(n, object_num, 1, random);
+            NmsParam param;
+            auto     cost = [&](auto&& func)
+            {
+                const int loop  = std::max(100000 / n, 3);
+                auto      start = std::chrono::steady_clock::now();
+                for (int i = 0; i < loop; ++i)
+                {
+                    func();
+                }
+                return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() /
+                       loop;
+            };
+            double reference     = cost([&]() { NmsReference(boxes, param.iou_threshold, false); });
+            param.grid_min_boxes = 0;
+            double block         = cost([&]() { Nms(boxes, param); });
+            param.grid_min_boxes = 1;
+            double grid          = cost([&]() { Nms(boxes, param); });
+            LOGI("nms %5d boxes %4d objects: reference %9.1f us, block %8.1f us, grid %8.1f us", n, object_num,
+                 reference, block, grid);
+        }
+    }
+    return 0;
+}
@@ -2,12 +2,17 @@
 #include <thread>
 #include <vector>
 
+#ifdef CVINFER_WITH_TENSORRT
 #include "../src/engine/trt_infer.h"
+#else
+#include "../src/engine/cpu_infer.h"
+#endif
 #include "../src/model/personball_mini.h"
 #include "../src/model/yolo.h"
 #include "../src/node/decoder_node.h"
 #include "../src/node/encoder_node.h"
 #include "../src/node/infer_node.h"
+#include "../src/node/remux_node.h"
 #include "../src/pipeline/pipeline_base.h"
 #include "../src/tools/logger.h"
 #include "../src/tools/version.h"
@@ -15,17 +20,23 @@
 using namespace cv_infer;
 using namespace std::chrono_literals;
 
+#ifdef CVINFER_WITH_TENSORRT
+using DemoEngine = trt::TrtEngine;
+#else
+using DemoEngine = cpu::CpuEngine;
+#endif
+
 bool test_personball_mini(const std::string& src, const std::string& dst)
 {
     auto decoder = std::make_shared<DecoderNode>();
     auto encoder = std::make_shared<EncoderNode>();
-    auto infer   = std::make_shared<InferNode<PersonBallMini<trt::TrtEngine>>>();
+    auto infer   = std::make_shared<InferNode<PersonBallMini<DemoEngine>>>();
     if (not decoder->Init(src))
     {
         LOGE("decoder init failed");
         return -1;
     }
-    if (not encoder->Init(dst))
+    if (not encoder->Init(dst, decoder->GetFps()))
     {
         LOGE("encoder init failed");
         return -1;
@@ -53,13 +64,13 @@ bool test_personball(const std::string& src, const std::string& dst)
 {
     auto decoder = std::make_shared<DecoderNode>();
     auto encoder = std::make_shared<EncoderNode>();
-    auto infer   = std::make_shared<InferNode<PersonBall<trt::TrtEngine>>>();
+    auto infer   = std::make_shared<InferNode<PersonBall<DemoEngine>>>();
     if (not decoder->Init(src))
     {
         LOGE("decoder init failed");
         return -1;
     }
-    if (not encoder->Init(dst))
+    if (not encoder->Init(dst, decoder->GetFps()))
     {
         LOGE("encoder init failed");
         return -1;
@@ -100,13 +111,13 @@ bool test_yolo(const std::string& src, const std::string& dst, const std::string
         model_path = "../test/yolov7.onnx";
     }
 
-    auto infer = std::make_shared<InferNode<Yolo<trt::TrtEngine, YoloType::YOLOV7>>>();
+    auto infer = std::make_shared<InferNode<Yolo<DemoEngine, YoloType::YOLOV7>>>();
     if (not decoder->Init(src))
     {
         LOGE("decoder init failed");
         return -1;
     }
-    if (not encoder->Init(dst))
+    if (not encoder->Init(dst, decoder->GetFps()))
     {
         LOGE("encoder init failed");
         return -1;
@@ -130,6 +141,43 @@ bool test_yolo(const std::string& src, const std::string& dst, const std::string
     return true;
 }
 
+// no burned-in boxes: the source packets are remuxed and the detections go to "<dst>.det.jsonl"
+bool test_yolov7_remux(const std::string& src, const std::string& dst)
+{
+    auto decoder = std::make_shared<DecoderNode>();
+    auto remux   = std::make_shared<RemuxNode>();
+    auto infer   = std::make_shared<InferNode<Yolo<DemoEngine, YoloType::YOLOV7>>>();
+    decoder->SetForwardPackets(true);
+    infer->SetOverlay(false);
+    if (not decoder->Init(src))
+    {
+        LOGE("decoder init failed");
+        return -1;
+    }
+    if (not remux->Init(dst, decoder->GetCodecParameters(), decoder->GetTimeBase(), decoder->GetFps()))
+    {
+        LOGE("remux init failed");
+        return -1;
+    }
+    if (not infer->Init("../test/yolov7.onnx"))
+    {
+        LOGE("infer init failed");
+        return -1;
+    }
+
+    auto pipeline = std::make_unique<PipelineBase>("test_pipeline");
+    if (not pipeline->BindAll({decoder, infer, remux}) or not pipeline->Bind(decoder, remux))
+    {
+        LOGE("pipeline bind failed");
+        return -1;
+    }
+    pipeline->Start();
+
+    std::this_thread::sleep_for(15s);
+    pipeline->Stop();
+    return true;
+}
+
 bool test_yolov7(const std::string& src, const std::string& dst) { return test_yolo(src, dst, "yolov7"); }
 
 bool test_yolov5s(const std::string& src, const std::string& dst) { return test_yolo(src, dst, "yolov5s"); }
@@ -178,6 +226,13 @@ int main(int argc, char* argv[])
             LOGE("test_yolov5 failed");
         }
     }
+    else if (test_targrt == "yolov7_remux")
+    {
+        if (not test_yolov7_remux(src, dst))
+        {
+            LOGE("test_yolov7_remux failed");
+        }
+    }
     else
     {
         LOGE("unknown test target: %s", test_targrt.c_str());
@@ -0,0 +1,76 @@
+#pragma once
+
+// Nms 的对照实现和测试数据, 单元测试和 bench_nms 共用
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "../src/math/nms.h"
+
+namespace cv_infer
+{
+// 按分数从高到低逐个比较的 nms, 作为 Nms 的对照
+inline std::vector<int> NmsReference(const NmsBoxes& boxes, float iou_threshold, bool class_aware)
+{
+    std::vector<int> order(boxes.Size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return boxes.score[a] > boxes.score[b]; });
+    std::vector<bool> removed(boxes.Size(), false);
+    std::vector<int>  keep;
+    for (int i = 0; i < order.size(); ++i)
+    {
+        if (removed[i])
+        {
+            continue;
+        }
+        int a = order[i];
+        keep.push_back(a);
+        for (int j = i + 1; j < order.size(); ++j)
+        {
+            int b = order[j];
+            if (removed[j] or (class_aware and boxes.label[a] != boxes.label[b]))
+            {
+                continue;
+            }
+            float w     = std::max(std::min(boxes.x2[a], boxes.x2[b]) - std::max(boxes.x1[a], boxes.x1[b]), 0.0f);
+            float h     = std::max(std::min(boxes.y2[a], boxes.y2[b]) - std::max(boxes.y1[a], boxes.y1[b]), 0.0f);
+            float inter = w * h;
+            float area1 = (boxes.x2[a] - boxes.x1[a]) * (boxes.y2[a] - boxes.y1[a]);
+            float area2 = (boxes.x2[b] - boxes.x1[b]) * (boxes.y2[b] - boxes.y1[b]);
+            if (inter / (area1 + area2 - inter) > iou_threshold)
+            {
+                removed[j] = true;
+            }
+        }
+    }
+    return keep;
+}
+
+// 模拟检测器输出: n 个框围绕 object_num 个目标聚集, 目标大小不一
+inline NmsBoxes RandomNmsBoxes(int n, int object_num, int class_num, std::mt19937& random)
+{
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::normal_distribution<float>       jitter(0.0f, 0.05f);
+    NmsBoxes                              boxes;
+    boxes.Reserve(n);
+    std::vector<std::array<float, 4>> objects(object_num);
+    for (auto& object : objects)
+    {
+        float w = 16 + uniform(random) * 240;
+        float h = 16 + uniform(random) * 240;
+        object  = {uniform(random) * (1920 - w), uniform(random) * (1080 - h), w, h};
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        auto [x, y, w, h] = objects[random() % object_num];
+        float cx          = x + w * (0.5f + jitter(random));
+        float cy          = y + h * (0.5f + jitter(random));
+        float bw          = w * (1.0f + jitter(random));
+        float bh          = h * (1.0f + jitter(random));
+        boxes.Push(cx - bw / 2, cy - bh / 2, cx + bw / 2, cy + bh / 2, uniform(random), random() % class_num);
+    }
+    return boxes;
+}
+}  // namespace cv_infer
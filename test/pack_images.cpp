@@ -0,0 +1,23 @@
+// pack a directory / file list of images into one file for ImageLoader
+// usage: pack_images <image dir | list.txt> <out.pack>
+#include "../src/node/image_loader.h"
+#include "../src/node/image_pack.h"
+#include "../src/tools/logger.h"
+
+using namespace cv_infer;
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        LOGE("usage: %s <image dir | list.txt> <out.pack>", argv[0]);
+        return 1;
+    }
+    std::vector<std::string> files;
+    if (not ImageLoader::ListFiles(argv[1], files) or files.empty())
+    {
+        LOGE("no image in [%s]", argv[1]);
+        return 1;
+    }
+    return PackImages(files, argv[2]) ? 0 : 1;
+}
@@ -1,11 +1,25 @@
 #include <gtest/gtest.h>
 
+#include <array>
+#include <chrono>
+#include <cmath>
 #include <memory>
+#include <numeric>
+#include <random>
+#include <thread>
 #include <opencv2/core/types.hpp>
 #include <opencv2/opencv.hpp>
 
+#include "engine/cpu_infer.h"
+#include "engine/math.h"
+#include "engine/mock_infer.h"
+#ifdef CVINFER_WITH_TENSORRT
 #include "engine/trt_infer.h"
+#endif
+#include "math/nms.h"
 #include "model/personball.h"
+#include "model/yolo.h"
+#include "nms_reference.h"
 #include "node/infer_node.h"
 #include "signal/signal.h"
 #include "tools/timer.h"
@@ -31,6 +45,7 @@ using namespace cv_infer;
 //     cv::imwrite("tmp.png", image);
 // }
 
+#ifdef CVINFER_WITH_TENSORRT
 TEST(TrtInfer, Personball)
 {
     Timer timer("PersonBall");
@@ -51,14 +66,673 @@ TEST(TrtInfer, Personball)
     // }
     for (const auto& bbox : output_signals)
     {
-        EXPECT_TRUE(bbox.size() == 5);
-        cv::Rect rect(cv::Point2f(bbox[0], bbox[1]), cv::Point2f(bbox[2], bbox[3]));
+        EXPECT_TRUE(bbox.class_id == 0 or bbox.class_id == 1);
+        cv::Rect rect(cv::Point2f(bbox.x1, bbox.y1), cv::Point2f(bbox.x2, bbox.y2));
         cv::rectangle(image, rect, cv::Scalar(0, 255, 0), 2);
     }
     cv::imwrite("personball.png", image);
 }
 
 TEST(TrtInfer, infer_node) { auto infer_node = std::make_shared<InferNode<PersonBall<trt::TrtEngine>>>(); }
+#endif
+
+TEST(CpuInfer, Personball)
+{
+    auto model = std::make_unique<PersonBall<cpu::CpuEngine>>();
+    EXPECT_TRUE(model->Init("/workspace/github/CVInfer/test/personball_512_768_best_1_0.onnx"));
+
+    const auto& inputs = model->Engine.GetInputs();
+    ASSERT_EQ(inputs.size(), 1);
+    EXPECT_EQ(inputs[0].dims[2], 512);
+    EXPECT_EQ(inputs[0].dims[3], 768);
+
+    auto image         = cv::imread("/workspace/github/CVInfer/test/street.jpg");
+    auto input_signals = std::make_shared<SignalImageBGR>(image);
+    for (const auto& bbox : model->Forwards({input_signals}))
+    {
+        EXPECT_TRUE(bbox.class_id == 0 or bbox.class_id == 1);
+    }
+}
+
+TEST(CpuInfer, Batch)
+{
+    cpu::CpuEngine engine;
+    engine.SetMaxBatch(2);
+    ASSERT_TRUE(engine.LoadModel("/workspace/github/CVInfer/test/personball_512_768_best_1_0.onnx"));
+    const auto& input     = engine.GetInputs()[0];
+    const auto  image_len = input.dims[1] * input.dims[2] * input.dims[3];
+
+    // 第 i 张图写到 blob + i * image_len, 内容只由图片的第一个像素决定
+    engine.RegisterPreProcessFunc(
+        [&](const std::vector<cv::Mat>& images, std::vector<float*>& preprocessed)
+        {
+            EXPECT_EQ(preprocessed.size(), 1);
+            for (int i = 0; i < images.size(); ++i)
+            {
+                std::fill_n(preprocessed[0] + i * image_len, image_len, images[i].data[0] / 128.0f - 1.0f);
+            }
+            return true;
+        });
+    std::vector<float> output;
+    engine.RegisterPostProcessFunc(
+        [&](const std::vector<cv::Mat>& images, const EngineOutputs& outputs)
+        {
+            output = outputs[0];
+            return Detections{};
+        });
+
+    cv::Mat dark(64, 64, CV_8UC3, cv::Scalar(0, 0, 0));
+    cv::Mat bright(64, 64, CV_8UC3, cv::Scalar(255, 255, 255));
+    engine.Forwards({dark});
+    const auto dark_output = output;
+    engine.Forwards({bright});
+    const auto bright_output = output;
+    ASSERT_FALSE(dark_output.empty());
+
+    // 一次推理两张图, 输出是两张图各自的结果连续存放
+    engine.Forwards({dark, bright});
+    ASSERT_EQ(output.size(), dark_output.size() * 2);
+    for (int i = 0; i < dark_output.size(); ++i)
+    {
+        ASSERT_NEAR(output[i], dark_output[i], 1e-4f) << "index " << i;
+        ASSERT_NEAR(output[dark_output.size() + i], bright_output[i], 1e-4f) << "index " << i;
+    }
+
+    // 超过最大 batch 时直接返回, 不调用后处理
+    output.clear();
+    EXPECT_TRUE(engine.Forwards({dark, bright, dark}).Empty());
+    EXPECT_TRUE(output.empty());
+}
+
+TEST(MockInfer, Personball)
+{
+    using namespace std::chrono_literals;
+    auto model = std::make_unique<PersonBall<mock::MockEngine>>();
+    model->Engine.SetInputs({{"images", {1, 3, 512, 768}}});
+    model->Engine.SetOutputs({{"output", {1, 8064, 7}}});
+    model->Engine.SetLatency(30ms, 5ms);
+    model->Engine.SetMaxConcurrency(2);
+    model->Engine.SetMaxInFlight(4);
+    EXPECT_TRUE(model->Init("mock"));
+
+    // 第一次推理会记录输入尺寸, 先单独跑一次
+    auto input = std::make_shared<SignalImageBGR>(cv::Mat(1080, 1920, CV_8UC3, cv::Scalar(0, 0, 0)));
+    model->Forwards({input});
+
+    // 4 个线程同时推理, 同时执行的请求数受 MaxConcurrency 限制
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.emplace_back(
+            [&]()
+            {
+                for (const auto& bbox : model->Forwards({input}))
+                {
+                    EXPECT_TRUE(bbox.class_id == 0 or bbox.class_id == 1);
+                    EXPECT_LE(bbox.x1, bbox.x2);
+                }
+            });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    EXPECT_EQ(model->Engine.GetPeakConcurrency(), 2);
+    EXPECT_EQ(model->Engine.GetForwardNum(), 5);
+}
+
+TEST(MockInfer, Submit)
+{
+    using namespace std::chrono_literals;
+    // personball mini 的形状, 推理尺寸和各层大小从引擎推导
+    auto model = std::make_unique<PersonBall<mock::MockEngine>>();
+    model->Engine.SetInputs({{"images", {1, 3, 256, 384}}});
+    model->Engine.SetOutputs({{"output", {1, 2016, 7}}});
+    model->Engine.SetLatency(30ms);
+    model->Engine.SetMaxConcurrency(4);
+    model->Engine.SetMaxInFlight(2);
+    EXPECT_TRUE(model->Init("mock"));
+
+    auto input = std::make_shared<SignalImageBGR>(cv::Mat(1080, 1920, CV_8UC3, cv::Scalar(0, 0, 0)));
+    model->Forwards({input});
+
+    std::vector<std::future<Detections>> results;
+    for (int i = 0; i < 8; ++i)
+    {
+        results.push_back(model->Submit({input}));
+    }
+    for (auto& result : results)
+    {
+        EXPECT_NO_THROW(result.get());
+    }
+    // 8 个请求, 同时执行的请求数受 MaxInFlight 限制
+    EXPECT_EQ(model->Engine.GetPeakConcurrency(), 2);
+    EXPECT_EQ(model->Engine.GetForwardNum(), 9);
+}
+
+TEST(MockInfer, PersonballBatch)
+{
+    auto model = std::make_unique<PersonBall<mock::MockEngine>>();
+    model->Engine.SetInputs({{"images", {1, 3, 512, 768}}});
+    model->Engine.SetOutputs({{"output", {1, 8064, 7}}});
+    ASSERT_TRUE(model->Init("mock"));
+
+    // mock 每张图的输出相同, batch 中每张图的结果都应该与单张推理一致
+    auto input  = std::make_shared<SignalImageBGR>(cv::Mat(1080, 1920, CV_8UC3, cv::Scalar(0, 0, 0)));
+    auto single = model->Forwards({input});
+    auto batch  = model->Forwards({input, input});
+    ASSERT_FALSE(single.Empty());
+    ASSERT_EQ(batch.Size(), single.Size() * 2);
+    for (int i = 0; i < batch.Size(); ++i)
+    {
+        const auto& expect = single[i % single.Size()];
+        EXPECT_EQ(batch[i].batch_index, i / single.Size());
+        EXPECT_EQ(batch[i].class_id, expect.class_id);
+        EXPECT_FLOAT_EQ(batch[i].x1, expect.x1);
+        EXPECT_FLOAT_EQ(batch[i].y2, expect.y2);
+        EXPECT_FLOAT_EQ(batch[i].score, expect.score);
+    }
+}
+
+TEST(MockInfer, YoloBatchPreProcess)
+{
+    auto model = std::make_unique<Yolo<mock::MockEngine, YoloType::YOLOV5>>();
+    model->Engine.SetInputs({{"images", {1, 3, 64, 64}}});
+    model->Engine.SetOutputs({{"output", {1, 252, 85}}});
+    ASSERT_TRUE(model->Init("mock"));
+
+    // 一个黑图和一个白图, 整个 batch 写到同一个输入 buffer 中, 每张图在自己的位置
+    std::vector<cv::Mat> images{cv::Mat(48, 64, CV_8UC3), cv::Mat(48, 64, CV_8UC3)};
+    std::fill_n(images[0].data, images[0].total() * images[0].elemSize(), 0);
+    std::fill_n(images[1].data, images[1].total() * images[1].elemSize(), 255);
+    const int           image_len = 3 * 64 * 64;
+    std::vector<float>  buffer(2 * image_len, -1.0f);
+    std::vector<float*> preprocessed{buffer.data()};
+    ASSERT_TRUE(model->PreProcess(images, preprocessed));
+    for (int c = 0; c < 3; ++c)
+    {
+        // 第一行是 letterbox 的填充, 中心是图片内容
+        EXPECT_FLOAT_EQ(buffer[c * 64 * 64], 114 / 255.0f);
+        EXPECT_FLOAT_EQ(buffer[c * 64 * 64 + 32 * 64 + 32], 0.0f);
+        EXPECT_FLOAT_EQ(buffer[image_len + c * 64 * 64], 114 / 255.0f);
+        EXPECT_FLOAT_EQ(buffer[image_len + c * 64 * 64 + 32 * 64 + 32], 1.0f);
+    }
+}
+
+TEST(MockInfer, YoloV8)
+{
+    // [1, 84, 8400], 每行一个分量: cx, cy, w, h, 80 个类别分数
+    const int          anchor_num = 8400;
+    std::vector<float> output(84 * anchor_num, 0.0f);
+    auto               set_anchor = [&](int a, float cx, float cy, float w, float h, int label, float score)
+    {
+        output[0 * anchor_num + a]           = cx;
+        output[1 * anchor_num + a]           = cy;
+        output[2 * anchor_num + a]           = w;
+        output[3 * anchor_num + a]           = h;
+        output[(4 + label) * anchor_num + a] = score;
+    };
+    set_anchor(5, 200, 340, 100, 100, 7, 0.9f);
+    set_anchor(6, 205, 340, 100, 100, 7, 0.6f);  // 与第 5 个同类别且重叠, 被 nms 抑制
+    set_anchor(8000, 500, 400, 40, 60, 3, 0.5f);
+    set_anchor(8001, 100, 200, 40, 60, 3, 0.2f);  // 低于阈值
+
+    auto model = std::make_unique<Yolo<mock::MockEngine, YoloType::YOLOV8>>();
+    model->Engine.SetInputs({{"images", {1, 3, 640, 640}}});
+    model->Engine.SetOutputs({{"output0", {1, 84, anchor_num}}});
+    model->Engine.SetOutputValues({output});
+    ASSERT_TRUE(model->Init("mock"));
+
+    // 1280x720 letterbox 到 640x640: scale = 0.5, pad_y = 140
+    auto input      = std::make_shared<SignalImageBGR>(cv::Mat(720, 1280, CV_8UC3));
+    auto detections = model->Forwards({input});
+    ASSERT_EQ(detections.Size(), 2);
+    EXPECT_EQ(detections[0].class_id, 7);
+    EXPECT_FLOAT_EQ(detections[0].score, 0.9f);
+    EXPECT_FLOAT_EQ(detections[0].x1, 300);
+    EXPECT_FLOAT_EQ(detections[0].y1, 300);
+    EXPECT_FLOAT_EQ(detections[0].x2, 500);
+    EXPECT_FLOAT_EQ(detections[0].y2, 500);
+    EXPECT_EQ(detections[1].class_id, 3);
+    EXPECT_FLOAT_EQ(detections[1].score, 0.5f);
+    EXPECT_FLOAT_EQ(detections[1].x1, 960);
+    EXPECT_FLOAT_EQ(detections[1].y1, 460);
+    EXPECT_FLOAT_EQ(detections[1].x2, 1040);
+    EXPECT_FLOAT_EQ(detections[1].y2, 580);
+}
+
+TEST(MockInfer, YoloMixedResolution)
+{
+    // 与 YoloV8 相同的输出, batch 中的两张图分辨率不同, 各自按自己的尺寸还原 letterbox
+    const int          anchor_num = 8400;
+    std::vector<float> output(84 * anchor_num, 0.0f);
+    auto               set_anchor = [&](int a, float cx, float cy, float w, float h, int label, float score)
+    {
+        output[0 * anchor_num + a]           = cx;
+        output[1 * anchor_num + a]           = cy;
+        output[2 * anchor_num + a]           = w;
+        output[3 * anchor_num + a]           = h;
+        output[(4 + label) * anchor_num + a] = score;
+    };
+    set_anchor(5, 200, 340, 100, 100, 7, 0.9f);
+    set_anchor(8000, 500, 400, 40, 60, 3, 0.5f);
+
+    auto model = std::make_unique<Yolo<mock::MockEngine, YoloType::YOLOV8>>();
+    model->Engine.SetInputs({{"images", {1, 3, 640, 640}}});
+    model->Engine.SetOutputs({{"output0", {1, 84, anchor_num}}});
+    model->Engine.SetOutputValues({output});
+    ASSERT_TRUE(model->Init("mock"));
+
+    // 1280x720: scale = 0.5, pad_y = 140; 640x640: scale = 1, 没有填充
+    auto wide   = std::make_shared<SignalImageBGR>(cv::Mat(720, 1280, CV_8UC3));
+    auto square = std::make_shared<SignalImageBGR>(cv::Mat(640, 640, CV_8UC3));
+    for (int round = 0; round < 2; ++round)
+    {
+        // 第二轮使用归还的后处理 buffer, 结果不变
+        auto detections = model->Forwards({wide, square});
+        ASSERT_EQ(detections.Size(), 4);
+        EXPECT_EQ(detections[0].batch_index, 0);
+        EXPECT_FLOAT_EQ(detections[0].x1, 300);
+        EXPECT_FLOAT_EQ(detections[0].y1, 300);
+        EXPECT_FLOAT_EQ(detections[1].x2, 1040);
+        EXPECT_FLOAT_EQ(detections[1].y2, 580);
+        EXPECT_EQ(detections[2].batch_index, 1);
+        EXPECT_FLOAT_EQ(detections[2].x1, 150);
+        EXPECT_FLOAT_EQ(detections[2].y1, 290);
+        EXPECT_FLOAT_EQ(detections[2].x2, 250);
+        EXPECT_FLOAT_EQ(detections[2].y2, 390);
+        EXPECT_EQ(detections[3].batch_index, 1);
+        EXPECT_FLOAT_EQ(detections[3].x1, 480);
+        EXPECT_FLOAT_EQ(detections[3].y2, 430);
+    }
+}
+
+TEST(MockInfer, YoloV10)
+{
+    // [1, 300, 6], 每行 x1, y1, x2, y2, score, class, 已经按分数排序, 剩余的行分数为 0
+    std::vector<float> output(300 * 6, 0.0f);
+    const float        rows[][6]{
+        {100, 240, 300, 440, 0.9f, 2},
+        {110, 250, 310, 450, 0.8f, 2},  // 与第一行同类别且重叠, v10 不做 nms, 需要保留
+        {400, 300, 500, 400, 0.3f, 0},
+        {0, 140, 640, 500, 0.1f, 5},  // 低于阈值
+    };
+    std::copy(&rows[0][0], &rows[0][0] + sizeof(rows) / sizeof(float), output.begin());
+
+    auto model = std::make_unique<Yolo<mock::MockEngine, YoloType::YOLOV10>>();
+    model->Engine.SetInputs({{"images", {1, 3, 640, 640}}});
+    model->Engine.SetOutputs({{"output0", {1, 300, 6}}});
+    model->Engine.SetOutputValues({output});
+    ASSERT_TRUE(model->Init("mock"));
+
+    // 1280x720 letterbox 到 640x640: scale = 0.5, pad_y = 140
+    auto input      = std::make_shared<SignalImageBGR>(cv::Mat(720, 1280, CV_8UC3));
+    auto detections = model->Forwards({input});
+    ASSERT_EQ(detections.Size(), 3);
+    for (int i = 0; i < 3; ++i)
+    {
+        EXPECT_EQ(detections[i].class_id, (int)rows[i][5]);
+        EXPECT_FLOAT_EQ(detections[i].score, rows[i][4]);
+        EXPECT_FLOAT_EQ(detections[i].x1, rows[i][0] / 0.5f);
+        EXPECT_FLOAT_EQ(detections[i].y1, (rows[i][1] - 140) / 0.5f);
+        EXPECT_FLOAT_EQ(detections[i].x2, rows[i][2] / 0.5f);
+        EXPECT_FLOAT_EQ(detections[i].y2, (rows[i][3] - 140) / 0.5f);
+        EXPECT_EQ(detections[i].batch_index, 0);
+    }
+}
+
+// CUDAKernal::ConverHWC2CHWAlpahNormResizeKeepRatioKernel 的逐像素翻译, 作为 cpu 向量化版本的参考
+static void LetterBoxReference(const unsigned char* src, int src_h, int src_w, int src_c, int dst_h, int dst_w,
+                               float alpha, float beta, float fill_value, float* dst)
+{
+    float scale = std::min((float)dst_w / src_w, (float)dst_h / src_h);
+    int   new_w = (int)(src_w * scale);
+    int   new_h = (int)(src_h * scale);
+    int   pad_x = (dst_w - new_w) / 2;
+    int   pad_y = (dst_h - new_h) / 2;
+    for (int z = 0; z < src_c; z++)
+    {
+        for (int y = 0; y < dst_h; y++)
+        {
+            for (int x = 0; x < dst_w; x++)
+            {
+                auto& value = dst[z * dst_h * dst_w + y * dst_w + x];
+                if (x < pad_x || x >= pad_x + new_w || y < pad_y || y >= pad_y + new_h)
+                {
+                    value = fill_value * alpha + beta;
+                    continue;
+                }
+                int src_x = (int)((x - pad_x) / scale);
+                int src_y = (int)((y - pad_y) / scale);
+                value     = ((float)src[src_y * src_w * src_c + src_x * src_c + (src_c - 1 - z)]) * alpha + beta;
+            }
+        }
+    }
+}
+
+TEST(CpuPreProcess, LetterBox)
+{
+    std::mt19937                       random(0);
+    std::uniform_int_distribution<int> pixel(0, 255);
+    for (auto [src_h, src_w] : {std::pair{1080, 1920}, {37, 91}, {5, 3}, {1000, 17}})
+    {
+        for (auto [dst_h, dst_w] : {std::pair{640, 640}, {512, 768}, {50, 200}})
+        {
+            std::vector<unsigned char> src(src_h * src_w * 3);
+            std::generate(src.begin(), src.end(), [&]() { return pixel(random); });
+            std::vector<float> expect(dst_h * dst_w * 3);
+            std::vector<float> actual(dst_h * dst_w * 3, -1.0f);
+            LetterBoxReference(src.data(), src_h, src_w, 3, dst_h, dst_w, 1 / 255.0f, 0.0f, 114, expect.data());
+            ConverHWC2CHWAlpahNormResizeKeepRatio(src.data(), src_h, src_w, 3, dst_h, dst_w, 3, 1 / 255.0f, 0.0f, 114,
+                                                  actual.data());
+            for (int i = 0; i < expect.size(); ++i)
+            {
+                // simd 版本使用 fma, 与标量结果最多差 1 ulp
+                ASSERT_NEAR(expect[i], actual[i], 1e-6f) << src_w << "x" << src_h << " -> " << dst_w << "x" << dst_h;
+            }
+        }
+    }
+}
+
+TEST(CpuPreProcess, LetterBoxStride)
+{
+    // 行之间有填充的源图像 (如 cv::Mat 的 ROI), 结果与紧密排列的同一张图一致
+    std::mt19937                       random(0);
+    std::uniform_int_distribution<int> pixel(0, 255);
+    for (auto [src_h, src_w] : {std::pair{1080, 1920}, {37, 91}, {5, 3}})
+    {
+        const int                  row_bytes = src_w * 3;
+        const int                  step      = row_bytes + 13;
+        std::vector<unsigned char> packed(src_h * row_bytes);
+        std::generate(packed.begin(), packed.end(), [&]() { return pixel(random); });
+        // 最后一行紧贴 buffer 末尾, 越界读取会被 sanitizer 发现
+        std::vector<unsigned char> strided((src_h - 1) * step + row_bytes, 0);
+        for (int y = 0; y < src_h; ++y)
+        {
+            std::copy_n(packed.data() + y * row_bytes, row_bytes, strided.data() + y * step);
+        }
+        const int          dst_h = 640;
+        const int          dst_w = 640;
+        std::vector<float> expect(dst_h * dst_w * 3);
+        std::vector<float> actual(dst_h * dst_w * 3, -1.0f);
+        ConverHWC2CHWAlpahNormResizeKeepRatio(packed.data(), src_h, src_w, 3, dst_h, dst_w, 3, 1 / 255.0f, 0.0f, 114,
+                                              expect.data());
+        ConverHWC2CHWAlpahNormResizeKeepRatio(strided.data(), src_h, src_w, 3, dst_h, dst_w, 3, 1 / 255.0f, 0.0f, 114,
+                                              actual.data(), step);
+        ASSERT_EQ(expect, actual) << src_w << "x" << src_h;
+    }
+}
+
+// 标量的双线性缩放 + 归一化 + HWC -> CHW, 坐标映射与 cv::resize(INTER_LINEAR) 一致
+static void ResizeMeanStdReference(const cv::Mat& image, int dst_h, int dst_w, const float* mean, const float* scale,
+                                   float* dst)
+{
+    auto coord = [](int i, int src_len, int dst_len, int& s0, int& s1, float& f)
+    {
+        f     = (float)((i + 0.5) * src_len / dst_len - 0.5);
+        int s = (int)std::floor(f);
+        f -= s;
+        if (s < 0)
+        {
+            s = 0;
+            f = 0;
+        }
+        if (s >= src_len - 1)
+        {
+            s = src_len - 1;
+            f = 0;
+        }
+        s0 = s;
+        s1 = std::min(s + 1, src_len - 1);
+    };
+    const int c = image.channels();
+    for (int y = 0; y < dst_h; y++)
+    {
+        int   y0, y1;
+        float fy;
+        coord(y, image.rows, dst_h, y0, y1, fy);
+        for (int x = 0; x < dst_w; x++)
+        {
+            int   x0, x1;
+            float fx;
+            coord(x, image.cols, dst_w, x0, x1, fx);
+            for (int z = 0; z < c; z++)
+            {
+                auto  pixel = [&](int yy, int xx) { return (float)image.ptr<unsigned char>(yy)[xx * c + z]; };
+                float top   = pixel(y0, x0) + fx * (pixel(y0, x1) - pixel(y0, x0));
+                float bot   = pixel(y1, x0) + fx * (pixel(y1, x1) - pixel(y1, x0));
+                dst[z * dst_h * dst_w + y * dst_w + x] = (top + fy * (bot - top) - mean[z]) / scale[z];
+            }
+        }
+    }
+}
+
+TEST(CpuPreProcess, ResizeMeanStd)
+{
+    std::mt19937                       random(0);
+    std::uniform_int_distribution<int> pixel(0, 255);
+    std::vector<float>                 mean{128, 128, 128};
+    std::vector<float>                 scale{128, 128, 128};
+    for (auto [src_h, src_w] : {std::pair{1080, 1920}, {512, 768}, {37, 91}, {5, 3}})
+    {
+        for (auto [dst_h, dst_w] : {std::pair{512, 768}, {256, 384}, {300, 300}})
+        {
+            // 两张不同的图写到同一个 batch buffer 中
+            std::vector<cv::Mat> images;
+            for (int i = 0; i < 2; ++i)
+            {
+                cv::Mat image(src_h, src_w, CV_8UC3);
+                std::generate(image.data, image.data + image.total() * 3, [&]() { return pixel(random); });
+                images.push_back(image);
+            }
+            const int          image_len = 3 * dst_h * dst_w;
+            std::vector<float> expect(2 * image_len);
+            std::vector<float> actual(2 * image_len, -1.0f);
+            for (int i = 0; i < 2; ++i)
+            {
+                ResizeMeanStdReference(images[i], dst_h, dst_w, mean.data(), scale.data(),
+                                       expect.data() + i * image_len);
+            }
+            ConverHWC2CHWResizeMeanStd(images, dst_h, dst_w, mean.data(), scale.data(),
+                                       {actual.data(), actual.data() + image_len});
+            for (int i = 0; i < expect.size(); ++i)
+            {
+                ASSERT_NEAR(expect[i], actual[i], 1e-4f) << src_w << "x" << src_h << " -> " << dst_w << "x" << dst_h;
+            }
+        }
+    }
+}
+
+// 原始的逐 anchor 解码, 作为 DecodeYoloRows 的对照
+static void DecodeYoloReference(const float* data, int anchor_num, int anchor_len, float conf_threshold, float scale,
+                                float pad_x, float pad_y, std::vector<float>& boxes)
+{
+    for (int i = 0; i < anchor_num; ++i)
+    {
+        const float* row = data + i * anchor_len;
+        if (row[4] < conf_threshold)
+        {
+            continue;
+        }
+        float max_confidence = 0.0f;
+        int   label          = -1;
+        for (int j = 0; j < anchor_len - 5; j++)
+        {
+            if (row[5 + j] > max_confidence)
+            {
+                max_confidence = row[5 + j];
+                label          = j;
+            }
+        }
+        boxes.insert(boxes.end(), {(row[0] - row[2] * 0.5f - pad_x) / scale, (row[1] - row[3] * 0.5f - pad_y) / scale,
+                                   (row[0] + row[2] * 0.5f - pad_x) / scale, (row[1] + row[3] * 0.5f - pad_y) / scale,
+                                   row[4], (float)label});
+    }
+}
+
+TEST(CpuPostProcess, DecodeYolo)
+{
+    std::mt19937                          random(0);
+    std::uniform_real_distribution<float> coord(0.0f, 640.0f);
+    std::uniform_real_distribution<float> prob(0.0f, 1.0f);
+    for (int anchor_len : {6, 13, 85})
+    {
+        // 大部分 anchor 的 obj 低于阈值, 少量 obj 恰好等于阈值
+        const int          anchor_num = 25200 + 3;
+        std::vector<float> output(anchor_num * anchor_len);
+        for (int i = 0; i < anchor_num; ++i)
+        {
+            float* row = output.data() + i * anchor_len;
+            for (int j = 0; j < 4; ++j)
+            {
+                row[j] = coord(random);
+            }
+            float p = prob(random);
+            row[4]  = p < 0.02f ? 0.25f : p * p * p;
+            for (int j = 5; j < anchor_len; ++j)
+            {
+                row[j] = prob(random) < 0.1f ? 0.0f : prob(random);
+            }
+        }
+        std::vector<float> expect;
+        std::vector<float> actual;
+        DecodeYoloReference(output.data(), anchor_num, anchor_len, 0.25f, 0.5f, 0, 140, expect);
+        int num = DecodeYoloRows(output.data(), anchor_num, anchor_len, 0.25f, 0.5f, 0, 140, actual);
+        ASSERT_EQ(num * 6, expect.size());
+        ASSERT_EQ(actual.size(), expect.size());
+        for (int i = 0; i < expect.size(); ++i)
+        {
+            ASSERT_FLOAT_EQ(expect[i], actual[i]) << "anchor_len " << anchor_len << " index " << i;
+        }
+    }
+}
+
+TEST(CpuPostProcess, DecodeYoloColumns)
+{
+    std::mt19937                          random(0);
+    std::uniform_real_distribution<float> coord(0.0f, 640.0f);
+    std::uniform_real_distribution<float> prob(0.0f, 1.0f);
+    for (int class_num : {1, 3, 80})
+    {
+        // yolov8 的转置输出 [4 + class_num, anchor_num], 少量 anchor 的分数恰好等于阈值或有相同的最大值
+        const int          anchor_num = 8400 + 3;
+        std::vector<float> output((4 + class_num) * anchor_num);
+        for (int i = 0; i < 4 * anchor_num; ++i)
+        {
+            output[i] = coord(random);
+        }
+        for (int i = 4 * anchor_num; i < output.size(); ++i)
+        {
+            float p   = prob(random);
+            output[i] = p < 0.01f ? 0.25f : p * p * p * p;
+        }
+
+        std::vector<float> expect;
+        for (int a = 0; a < anchor_num; ++a)
+        {
+            float max_score = output[4 * anchor_num + a];
+            int   label     = 0;
+            for (int c = 1; c < class_num; ++c)
+            {
+                if (output[(4 + c) * anchor_num + a] > max_score)
+                {
+                    max_score = output[(4 + c) * anchor_num + a];
+                    label     = c;
+                }
+            }
+            if (max_score < 0.25f)
+            {
+                continue;
+            }
+            float cx = output[a], cy = output[anchor_num + a], w = output[2 * anchor_num + a],
+                  h = output[3 * anchor_num + a];
+            expect.insert(expect.end(), {(cx - w * 0.5f - 0) / 0.5f, (cy - h * 0.5f - 140) / 0.5f,
+                                         (cx + w * 0.5f - 0) / 0.5f, (cy + h * 0.5f - 140) / 0.5f, max_score,
+                                         (float)label});
+        }
+        std::vector<float> actual;
+        int                num = DecodeYoloColumns(output.data(), anchor_num, class_num, 0.25f, 0.5f, 0, 140, actual);
+        ASSERT_EQ(num * 6, expect.size());
+        ASSERT_EQ(actual.size(), expect.size());
+        for (int i = 0; i < expect.size(); ++i)
+        {
+            ASSERT_FLOAT_EQ(expect[i], actual[i]) << "class_num " << class_num << " index " << i;
+        }
+    }
+}
+
+TEST(CpuPostProcess, SelectRowsExp)
+{
+    std::mt19937                          random(0);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    // 行数不是 8 的倍数, 覆盖标量尾部
+    const int          rows = 8064 + 5;
+    std::vector<float> data(rows * 7);
+    std::generate(data.begin(), data.end(), [&]() { return uniform(random); });
+    data[4] = 0.1f;
+
+    std::vector<int> expect;
+    for (int i = 0; i < rows; ++i)
+    {
+        if (data[i * 7 + 4] >= 0.1f)
+        {
+            expect.push_back(i);
+        }
+    }
+    std::vector<int> actual{-1};
+    ASSERT_EQ(SelectRows(data.data(), rows, 7, 4, 0.1f, actual), expect.size());
+    ASSERT_EQ(actual.front(), -1);
+    ASSERT_TRUE(std::equal(expect.begin(), expect.end(), actual.begin() + 1));
+
+    std::vector<float> x(1003);
+    std::generate(x.begin(), x.end(), [&]() { return uniform(random) * 40.0f - 20.0f; });
+    std::vector<float> y(x.size());
+    ExpArray(x.data(), x.size(), y.data());
+    for (int i = 0; i < x.size(); ++i)
+    {
+        ASSERT_NEAR(y[i] / std::exp(x[i]), 1.0f, 1e-6f) << x[i];
+    }
+}
+
+TEST(Nms, Reference)
+{
+    std::mt19937 random(0);
+    // 所有用例共用一个 workspace, 复用 buffer 不影响结果
+    NmsWorkspace     workspace;
+    std::vector<int> keep;
+    for (int n : {1, 7, 100, 1000, 5000})
+    {
+        for (bool class_aware : {false, true})
+        {
+            for (float iou_threshold : {0.2f, 0.45f, 0.7f})
+            {
+                auto     boxes = RandomNmsBoxes(n, std::max(n / 20, 1), 4, random);
+                // 覆盖大半张图的框, 网格中单独处理
+                for (int i = 0; i < n / 100; ++i)
+                {
+                    boxes.Push(i * 10, i * 5, 1800 - i * 10, 1000 - i * 5, (float)random() / random.max(), i % 4);
+                }
+                NmsParam param;
+                param.iou_threshold = iou_threshold;
+                param.class_aware   = class_aware;
+                auto expect         = NmsReference(boxes, iou_threshold, class_aware);
+                // 分别走网格和逐块比较
+                for (int grid_min_boxes : {0, 1})
+                {
+                    param.grid_min_boxes = grid_min_boxes;
+                    ASSERT_EQ(expect, Nms(boxes, param)) << n << " " << class_aware << " " << iou_threshold;
+                    Nms(boxes, param, workspace, keep);
+                    ASSERT_EQ(expect, keep) << n << " " << class_aware << " " << iou_threshold;
+                }
+                // top_k 截断保留结果的前 k 个
+                param.top_k = 5;
+                auto top    = Nms(boxes, param);
+                ASSERT_EQ(top.size(), std::min<std::size_t>(5, expect.size()));
+                ASSERT_TRUE(std::equal(top.begin(), top.end(), expect.begin()));
+            }
+        }
+    }
+}
 
 int main(int argc, char** argv)
 {
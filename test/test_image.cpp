@@ -1,8 +1,16 @@
 #include <gtest/gtest.h>
 
+#include <filesystem>
+#include <fstream>
+
+#ifdef CVINFER_WITH_TENSORRT
 #include "../src/engine/trt_infer.h"
+#else
+#include "../src/engine/cpu_infer.h"
+#endif
 #include "../src/node/encoder_node.h"
 #include "../src/node/image_loader.h"
+#include "../src/node/image_pack.h"
 #include "../src/node/infer_node.h"
 #include "../src/pipeline/pipeline_base.h"
 #include "model/yolo.h"
@@ -10,6 +18,12 @@
 using namespace cv_infer;
 using namespace std::chrono_literals;
 
+#ifdef CVINFER_WITH_TENSORRT
+using TestEngine = trt::TrtEngine;
+#else
+using TestEngine = cpu::CpuEngine;
+#endif
+
 TEST(Pipeline, ImageLoader)
 {
     auto image_loader = std::make_shared<ImageLoader>();
@@ -23,7 +37,7 @@ TEST(Pipeline, ImageLoader)
     model_path      = "/workspace/github/CVInfer/test/yolov7.onnx";
     std::string dst = "./ut_output.mp4";
 
-    auto infer = std::make_shared<InferNode<Yolo<trt::TrtEngine, YoloType::YOLOV7>>>();
+    auto infer = std::make_shared<InferNode<Yolo<TestEngine, YoloType::YOLOV7>>>();
 
     EXPECT_TRUE(encoder->Init(dst));
     EXPECT_TRUE(infer->Init(model_path));
@@ -34,4 +48,165 @@ TEST(Pipeline, ImageLoader)
 
     std::this_thread::sleep_for(15s);
     EXPECT_TRUE(pipeline->Stop());
-}
\ No newline at end of file
+}
+TEST(Node, ImageLoaderOrderedPrefetch)
+{
+    auto dir = std::filesystem::temp_directory_path() / "cv_infer_image_loader";
+    std::filesystem::create_directories(dir);
+    std::ofstream list(dir / "list.txt");
+    for (int i = 0; i < 12; ++i)
+    {
+        // the width tells which file an image came from
+        auto name = "img_" + std::to_string(100 + i) + ".png";
+        cv::imwrite((dir / name).string(), cv::Mat(8, 16 + i, CV_8UC3, cv::Scalar(i, i, i)));
+        list << name << "\n";
+    }
+    list.close();
+
+    for (const auto& src : {dir.string(), (dir / "list.txt").string()})
+    {
+        auto loader = std::make_shared<ImageLoader>();
+        auto output = std::make_shared<SignalQue>();
+        loader->SetWorkerNum(4);
+        loader->SetPrefetchNum(64);
+        EXPECT_TRUE(loader->AddOutputs(output));
+        // the directory also holds list.txt, which fails to decode and is skipped
+        EXPECT_TRUE(loader->Init(src));
+        EXPECT_TRUE(loader->Start());
+        for (int i = 0; i < 100 and output->Size() < 12; ++i)
+        {
+            std::this_thread::sleep_for(10ms);
+        }
+        EXPECT_TRUE(loader->Stop());
+
+        ASSERT_EQ(output->Size(), 12);
+        for (int i = 0; i < 12; ++i)
+        {
+            SignalBasePtr signal;
+            ASSERT_TRUE(output->Pop(signal));
+            auto image = std::dynamic_pointer_cast<SignalImageBGR>(signal);
+            ASSERT_NE(image, nullptr);
+            EXPECT_EQ(image->FrameIdx, static_cast<std::uint64_t>(i));
+            EXPECT_EQ(image->Val.cols, 16 + i);
+        }
+    }
+    std::filesystem::remove_all(dir);
+}
+
+TEST(Node, ImageLoaderPack)
+{
+    auto dir = std::filesystem::temp_directory_path() / "cv_infer_image_pack";
+    std::filesystem::create_directories(dir);
+    std::vector<std::string> files;
+    for (int i = 0; i < 8; ++i)
+    {
+        files.push_back((dir / ("img_" + std::to_string(i) + ".png")).string());
+        cv::imwrite(files.back(), cv::Mat(8, 16 + i, CV_8UC3, cv::Scalar(i, i, i)));
+    }
+    auto pack_path = (dir / "images.pack").string();
+    ASSERT_TRUE(PackImages(files, pack_path));
+    EXPECT_TRUE(IsImagePack(pack_path));
+    EXPECT_FALSE(IsImagePack(files.front()));
+
+    MappedImagePack pack;
+    ASSERT_TRUE(pack.Open(pack_path));
+    ASSERT_EQ(pack.Size(), files.size());
+    EXPECT_EQ(pack.Get(3).size(), std::filesystem::file_size(files[3]));
+    pack.Close();
+
+    // one shard of the pack, FrameIdx stays the index in the pack
+    auto loader = std::make_shared<ImageLoader>();
+    auto output = std::make_shared<SignalQue>();
+    EXPECT_TRUE(loader->AddOutputs(output));
+    EXPECT_TRUE(loader->Init(pack_path));
+    loader->SetRange(2, 6);
+    EXPECT_TRUE(loader->Start());
+    for (int i = 0; i < 100 and output->Size() < 4; ++i)
+    {
+        std::this_thread::sleep_for(10ms);
+    }
+    EXPECT_TRUE(loader->Stop());
+    ASSERT_EQ(output->Size(), 4);
+    for (int i = 2; i < 6; ++i)
+    {
+        SignalBasePtr signal;
+        ASSERT_TRUE(output->Pop(signal));
+        auto image = std::dynamic_pointer_cast<SignalImageBGR>(signal);
+        ASSERT_NE(image, nullptr);
+        EXPECT_EQ(image->FrameIdx, static_cast<std::uint64_t>(i));
+        EXPECT_EQ(image->Val.cols, 16 + i);
+    }
+    std::filesystem::remove_all(dir);
+}
+
+TEST(Node, ImageLoaderReducedJpeg)
+{
+    auto dir = std::filesystem::temp_directory_path() / "cv_infer_reduced_jpeg";
+    std::filesystem::create_directories(dir);
+    auto jpg = (dir / "big.jpg").string();
+    auto png = (dir / "big.png").string();
+    cv::imwrite(jpg, cv::Mat(1200, 1600, CV_8UC3, cv::Scalar(40, 80, 120)));
+    cv::imwrite(png, cv::Mat(1200, 1600, CV_8UC3, cv::Scalar(40, 80, 120)));
+
+    auto loader = std::make_shared<ImageLoader>();
+    auto output = std::make_shared<SignalQue>();
+    EXPECT_TRUE(loader->AddOutputs(output));
+    EXPECT_TRUE(loader->Init(std::vector<std::string>{jpg, png}));
+    // 1/2 still covers 640x480, 1/4 does not. png has no DCT scaling and keeps its size
+    loader->SetTargetSize(cv::Size(640, 480));
+    EXPECT_TRUE(loader->Start());
+    for (int i = 0; i < 100 and output->Size() < 2; ++i)
+    {
+        std::this_thread::sleep_for(10ms);
+    }
+    EXPECT_TRUE(loader->Stop());
+    ASSERT_EQ(output->Size(), 2);
+    for (auto size : {cv::Size(800, 600), cv::Size(1600, 1200)})
+    {
+        SignalBasePtr signal;
+        ASSERT_TRUE(output->Pop(signal));
+        auto image = std::dynamic_pointer_cast<SignalImageBGR>(signal);
+        ASSERT_NE(image, nullptr);
+        EXPECT_EQ(image->Val.size(), size);
+    }
+    std::filesystem::remove_all(dir);
+}
+
+TEST(Node, ImageLoaderReducedJpegExif)
+{
+    auto dir = std::filesystem::temp_directory_path() / "cv_infer_reduced_jpeg_exif";
+    std::filesystem::create_directories(dir);
+    auto jpg = (dir / "portrait.jpg").string();
+
+    // stored 1600x1200 with EXIF orientation 6 (rotate 90 cw), imdecode returns it as 1200x1600
+    std::vector<std::uint8_t> bytes;
+    ASSERT_TRUE(cv::imencode(".jpg", cv::Mat(1200, 1600, CV_8UC3, cv::Scalar(40, 80, 120)), bytes));
+    const std::vector<std::uint8_t> app1{
+        0xFF, 0xE1, 0x00, 0x22, 'E', 'x', 'i', 'f', 0x00, 0x00,  // APP1, length 34
+        'I',  'I',  0x2A, 0x00, 0x08, 0x00, 0x00, 0x00,          // little endian TIFF header, IFD0 at 8
+        0x01, 0x00,                                              // one entry
+        0x12, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00,  // orientation, SHORT, 6
+        0x00, 0x00, 0x00, 0x00,                                                  // no next IFD
+    };
+    bytes.insert(bytes.begin() + 2, app1.begin(), app1.end());
+    std::ofstream(jpg, std::ios::binary).write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+
+    auto loader = std::make_shared<ImageLoader>();
+    auto output = std::make_shared<SignalQue>();
+    EXPECT_TRUE(loader->AddOutputs(output));
+    EXPECT_TRUE(loader->Init(std::vector<std::string>{jpg}));
+    // a portrait model input: 1/2 of the rotated image (600x800) covers it, 1/2 of the stored size (800x600) does not
+    loader->SetTargetSize(cv::Size(480, 640));
+    EXPECT_TRUE(loader->Start());
+    for (int i = 0; i < 100 and output->Size() < 1; ++i)
+    {
+        std::this_thread::sleep_for(10ms);
+    }
+    EXPECT_TRUE(loader->Stop());
+    SignalBasePtr signal;
+    ASSERT_TRUE(output->Pop(signal));
+    auto image = std::dynamic_pointer_cast<SignalImageBGR>(signal);
+    ASSERT_NE(image, nullptr);
+    EXPECT_EQ(image->Val.size(), cv::Size(600, 800));
+    std::filesystem::remove_all(dir);
+}
@@ -1,12 +1,28 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iterator>
 #include <memory>
+#include <numeric>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
 #include <thread>
 
 #include "node/decoder_node.h"
 #include "node/encoder_node.h"
+#include "node/event_clip_node.h"
+#include "node/keyframe_index.h"
+#include "node/multi_encoder_node.h"
+#include "node/remux_node.h"
+#include "node/segmented_decoder_node.h"
+#include "node/stream_source.h"
+#include "node/sws_converter.h"
 #include "pipeline/pipeline_base.h"
 #include "signal/signal.h"
 
@@ -98,4 +114,1073 @@ TEST(runTests, encoder)
     std::this_thread::sleep_for(2s);
     EXPECT_TRUE(pipeline->Stop());
     LOGI("encoder done");
-}
\ No newline at end of file
+}
+
+// 320x240 @ 25 fps, libx264 with a key frame every 10 frames. open GOP: the leading B frames of every key frame but
+// the first come after it in decode order
+static OutCfg MakeTestClipCfg(const std::string& out_url)
+{
+    OutCfg cfg;
+    cfg.out_url            = out_url;
+    cfg.codec              = "libx264";
+    cfg.width              = 320;
+    cfg.height             = 240;
+    cfg.fps                = 25.0;
+    cfg.opt["x264-params"] = "keyint=10:min-keyint=10:scenecut=0:bframes=3:open-gop=1";
+    return cfg;
+}
+
+// a rectangle moving over a changing background, no two frames are alike
+static cv::Mat MakeTestFrame(int i, cv::Size size = cv::Size(320, 240))
+{
+    cv::Mat image(size, CV_8UC3, cv::Scalar(i * 4 % 256, 128, 255 - i * 4 % 256));
+    cv::rectangle(image, cv::Rect(i * 4 % size.width, size.height / 3, 40, 40), cv::Scalar(255, 255, 255), -1);
+    return image;
+}
+
+// feeds frame_num frames to an initialized encoder, then stops it and writes the trailer
+static bool EncodeTestFrames(const std::shared_ptr<EncoderNode>& encoder, std::size_t frame_num,
+                             cv::Size size = cv::Size(320, 240))
+{
+    auto input = std::make_shared<SignalQue>();
+    if (not encoder->AddInputs(input) or not encoder->Start())
+    {
+        return false;
+    }
+    for (std::size_t i = 0; i < frame_num; ++i)
+    {
+        auto signal      = std::make_shared<SignalImageBGR>(MakeTestFrame(static_cast<int>(i), size));
+        signal->FrameIdx = i;
+        input->Push(signal);
+    }
+    while (not input->Empty())
+    {
+        std::this_thread::sleep_for(10ms);
+    }
+    return encoder->Stop() and encoder->Close();
+}
+
+static bool WriteTestClip(const std::string& out_url, std::size_t frame_num)
+{
+    auto encoder = std::make_shared<EncoderNode>();
+    return encoder->Init(MakeTestClipCfg(out_url)) and EncodeTestFrames(encoder, frame_num);
+}
+
+// frames on que until count of them arrived, or nothing for a few seconds
+static std::vector<std::shared_ptr<SignalImageBGR>> PopFrames(SignalQue& que, std::size_t count)
+{
+    std::vector<std::shared_ptr<SignalImageBGR>> frames;
+    auto                                         deadline = std::chrono::steady_clock::now() + 10s;
+    while (frames.size() < count and std::chrono::steady_clock::now() < deadline)
+    {
+        SignalBasePtr signal;
+        if (que.Pop(signal))
+        {
+            frames.push_back(std::dynamic_pointer_cast<SignalImageBGR>(signal));
+        }
+        else
+        {
+            std::this_thread::sleep_for(1ms);
+        }
+    }
+    return frames;
+}
+
+// decodes source with a DecoderNode set up by setup, count is the number of frames expected. frames that come after
+// the count are returned as well
+static std::vector<std::shared_ptr<SignalImageBGR>> DecodeTestClip(
+    const std::string& source, std::size_t count, const std::function<bool(DecoderNode&)>& setup = nullptr)
+{
+    auto decoder = std::make_shared<DecoderNode>();
+    auto output  = std::make_shared<SignalQue>();
+    if (not decoder->Init(source) or (setup != nullptr and not setup(*decoder)) or
+        not decoder->AddOutputs(output) or not decoder->Start())
+    {
+        return {};
+    }
+    auto frames = PopFrames(*output, count);
+    decoder->Stop();
+    for (SignalBasePtr signal; output->Pop(signal);)
+    {
+        frames.push_back(std::dynamic_pointer_cast<SignalImageBGR>(signal));
+    }
+    return frames;
+}
+
+TEST(runTests, segmented_decoder_open_gop)
+{
+    const std::string out_url   = "segmented_source.mp4";
+    const std::size_t frame_num = 60;
+    ASSERT_TRUE(WriteTestClip(out_url, frame_num));
+
+    // two ranges, the numbers have to run on across the range boundary without a gap or a duplicate
+    auto decoder = std::make_shared<SegmentedDecoderNode>();
+    auto output  = std::make_shared<SignalQue>();
+    decoder->SetWorkerNum(2);
+    decoder->SetSegmentNum(2);
+    ASSERT_TRUE(decoder->Init(out_url));
+    ASSERT_TRUE(decoder->AddOutputs(output));
+    ASSERT_TRUE(decoder->Start());
+    auto frames = PopFrames(*output, frame_num);
+    EXPECT_TRUE(decoder->Stop());
+    ASSERT_EQ(frames.size(), frame_num);
+    for (std::size_t i = 0; i < frames.size(); ++i)
+    {
+        EXPECT_EQ(frames[i]->FrameIdx, i);
+    }
+    std::filesystem::remove(out_url);
+}
+
+TEST(runTests, decoder_seek_open_gop)
+{
+    const std::string source    = "seek_source.mp4";
+    const std::string sidecar   = source + ".kfi";
+    const std::size_t frame_num = 60;
+    std::filesystem::remove(sidecar);
+    ASSERT_TRUE(WriteTestClip(source, frame_num));
+
+    // the first full pass writes the key frame index, later decoders seek with it
+    auto full = DecodeTestClip(source, frame_num);
+    ASSERT_EQ(full.size(), frame_num);
+    for (std::size_t i = 0; i < full.size(); ++i)
+    {
+        ASSERT_EQ(full[i]->FrameIdx, i);
+    }
+    ASSERT_TRUE(std::filesystem::exists(sidecar));
+
+    // 28 is a leading frame of the key frame 30, 30 the key frame itself, 35 in the middle of its GOP
+    for (std::uint64_t start : {0, 28, 30, 35})
+    {
+        const std::uint64_t end    = std::min<std::uint64_t>(start + 15, frame_num);
+        auto                frames = DecodeTestClip(source, end - start,
+                                                    [&](DecoderNode& decoder) { return decoder.DecodeRange(start, end); });
+        ASSERT_EQ(frames.size(), end - start) << "range start " << start;
+        for (std::size_t i = 0; i < frames.size(); ++i)
+        {
+            EXPECT_EQ(frames[i]->FrameIdx, start + i);
+            EXPECT_EQ(cv::norm(frames[i]->Val, full[start + i]->Val, cv::NORM_INF), 0) << "frame " << start + i;
+        }
+    }
+    // Seek has no end, the output runs to the last frame
+    auto tail = DecodeTestClip(source, frame_num - 28, [](DecoderNode& decoder) { return decoder.Seek(28); });
+    ASSERT_EQ(tail.size(), frame_num - 28);
+    EXPECT_EQ(tail.front()->FrameIdx, 28u);
+    EXPECT_EQ(tail.back()->FrameIdx, frame_num - 1);
+
+    std::filesystem::remove(source);
+    std::filesystem::remove(sidecar);
+}
+
+TEST(runTests, decoder_sample_modes)
+{
+    // 30 fps, a key frame every 10 frames and no B frames, so no frame is a non-reference frame
+    const std::string source    = "sample_source.mp4";
+    const std::size_t frame_num = 60;
+    auto              cfg       = MakeTestClipCfg(source);
+    cfg.fps                     = 30.0;
+    cfg.opt["x264-params"]      = "keyint=10:min-keyint=10:scenecut=0:bframes=0";
+    auto encoder                = std::make_shared<EncoderNode>();
+    ASSERT_TRUE(encoder->Init(cfg));
+    ASSERT_TRUE(EncodeTestFrames(encoder, frame_num));
+
+    auto sample = [&](const DecodeSampleCfg& sample_cfg, std::size_t count)
+    {
+        auto frames = DecodeTestClip(source, count,
+                                     [&](DecoderNode& decoder) { return decoder.SetSampleCfg(sample_cfg); });
+        std::vector<std::uint64_t> numbers;
+        for (const auto& frame : frames)
+        {
+            numbers.push_back(frame->FrameIdx);
+        }
+        return numbers;
+    };
+    auto range = [](std::uint64_t step, std::uint64_t end)
+    {
+        std::vector<std::uint64_t> numbers;
+        for (std::uint64_t i = 0; i < end; i += step)
+        {
+            numbers.push_back(i);
+        }
+        return numbers;
+    };
+
+    // the codec never sees the other frames, the numbers come from the timestamps instead of the decoded count
+    EXPECT_EQ(sample({DecodeSampleMode::KEY_FRAME}, 6), range(10, frame_num));
+    // every frame is decoded and counted
+    EXPECT_EQ(sample({DecodeSampleMode::STRIDE, 3}, 20), range(3, frame_num));
+    // 30 -> 15 fps lets the codec skip non-reference frames, so numbering switches to timestamps as well
+    EXPECT_EQ(sample({DecodeSampleMode::FPS, 1, 15.0}, 30), range(2, frame_num));
+    EXPECT_EQ(sample({DecodeSampleMode::FPS, 1, 10.0}, 20), range(3, frame_num));
+    // above the source rate every frame passes
+    EXPECT_EQ(sample({DecodeSampleMode::FPS, 1, 60.0}, frame_num), range(1, frame_num));
+
+    std::filesystem::remove(source);
+    std::filesystem::remove(source + ".kfi");
+}
+
+TEST(runTests, keyframe_index_sidecar)
+{
+    std::string source  = "kfi_source.bin";
+    std::string sidecar = source + ".kfi";
+    std::ofstream(source) << "not a real video";
+
+    KeyFrameIndex index{{0, 0, 48, 0}, {3000, 2000, 9000, 50}, {6000, 5000, 18000, 100}};
+    EXPECT_TRUE(SaveKeyFrameIndex(sidecar, source, index, 120));
+
+    MappedKeyFrameIndex mapped;
+    EXPECT_TRUE(mapped.Open(sidecar, source));
+    auto entries = mapped.Entries();
+    ASSERT_EQ(entries.size(), index.size());
+    EXPECT_EQ(mapped.FrameCount(), 120);
+    for (std::size_t i = 0; i < index.size(); ++i)
+    {
+        EXPECT_EQ(entries[i].pts, index[i].pts);
+        EXPECT_EQ(entries[i].pos, index[i].pos);
+        EXPECT_EQ(entries[i].frame_idx, index[i].frame_idx);
+    }
+    EXPECT_EQ(FindKeyFrame(entries, 0)->frame_idx, 0);
+    EXPECT_EQ(FindKeyFrame(entries, 75)->frame_idx, 50);
+    EXPECT_EQ(FindKeyFrame(entries, 100)->frame_idx, 100);
+    mapped.Close();
+
+    // a changed source invalidates the sidecar
+    std::ofstream(source, std::ios::app) << "more bytes";
+    EXPECT_FALSE(mapped.Open(sidecar, source));
+
+    std::filesystem::remove(source);
+    std::filesystem::remove(sidecar);
+}
+
+TEST(runTests, sws_converter_threads)
+{
+    cv::Mat bgr(1080, 1920, CV_8UC3);
+    cv::randu(bgr, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    auto make_yuv = []()
+    {
+        AVFramePtr frame{av_frame_alloc()};
+        frame->width  = 1280;
+        frame->height = 720;
+        frame->format = AV_PIX_FMT_YUV420P;
+        EXPECT_EQ(av_frame_get_buffer(frame.get(), 0), 0);
+        return frame;
+    };
+    auto yuv_single = make_yuv();
+    auto yuv_slices = make_yuv();
+
+    SwsConverter single(1);
+    SwsConverter slices(4);
+    EXPECT_TRUE(single.FromBGR(bgr, yuv_single.get()));
+    EXPECT_TRUE(slices.FromBGR(bgr, yuv_slices.get()));
+    for (int plane = 0; plane < 3; ++plane)
+    {
+        int rows  = plane == 0 ? 720 : 360;
+        int bytes = plane == 0 ? 1280 : 640;
+        for (int y = 0; y < rows; ++y)
+        {
+            ASSERT_EQ(0, std::memcmp(yuv_single->data[plane] + y * yuv_single->linesize[plane],
+                                     yuv_slices->data[plane] + y * yuv_slices->linesize[plane], bytes));
+        }
+    }
+
+    cv::Mat bgr_single;
+    cv::Mat bgr_slices;
+    EXPECT_TRUE(single.ToBGR(yuv_single.get(), bgr_single));
+    EXPECT_TRUE(slices.ToBGR(yuv_single.get(), bgr_slices));
+    EXPECT_EQ(cv::norm(bgr_single, bgr_slices, cv::NORM_INF), 0);
+}
+
+TEST(runTests, multi_encoder_sizes)
+{
+    std::vector<OutCfg> cfgs(5);
+    cfgs[0].height = 360;   // width from the aspect ratio
+    cfgs[1].width  = 1281;  // height from the aspect ratio, rounded down to even
+    cfgs[2].width  = 0;     // source size
+    cfgs[3].width  = 1280;
+    cfgs[3].height = 720;
+    cfgs[4].width  = 853;
+    cfgs[4].height = 481;
+
+    std::vector<std::size_t> order;
+    EXPECT_TRUE(MultiEncoderNode::ResolveSizes(cv::Size(1920, 1080), cfgs, order));
+    EXPECT_EQ(cv::Size(cfgs[0].width, cfgs[0].height), cv::Size(640, 360));
+    EXPECT_EQ(cv::Size(cfgs[1].width, cfgs[1].height), cv::Size(1280, 720));
+    EXPECT_EQ(cv::Size(cfgs[2].width, cfgs[2].height), cv::Size(1920, 1080));
+    EXPECT_EQ(cv::Size(cfgs[3].width, cfgs[3].height), cv::Size(1280, 720));
+    EXPECT_EQ(cv::Size(cfgs[4].width, cfgs[4].height), cv::Size(852, 480));
+    // largest first, equal sizes keep their order
+    EXPECT_EQ(order, (std::vector<std::size_t>{2, 1, 3, 4, 0}));
+
+    // too small to survive the even rounding
+    std::vector<OutCfg> tiny(1);
+    tiny[0].height = 1;
+    EXPECT_FALSE(MultiEncoderNode::ResolveSizes(cv::Size(1920, 1080), tiny, order));
+}
+
+// pts of the video packets of url in file order, in the time base of the stream (stored to time_base)
+static std::vector<std::int64_t> ReadPacketPts(const std::string& url, AVRational* time_base = nullptr)
+{
+    AVFormatContext* ctx = nullptr;
+    if (avformat_open_input(&ctx, url.c_str(), nullptr, nullptr) != 0)
+    {
+        return {};
+    }
+    AVFormatInputPtr input{ctx};
+    if (avformat_find_stream_info(ctx, nullptr) < 0)
+    {
+        return {};
+    }
+    const int                 index = av_find_best_stream(ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    std::vector<std::int64_t> pts;
+    AVPacketPtr               packet{av_packet_alloc()};
+    if (index >= 0 and time_base != nullptr)
+    {
+        *time_base = ctx->streams[index]->time_base;
+    }
+    while (index >= 0 and av_read_frame(ctx, packet.get()) == 0)
+    {
+        if (packet->stream_index == index)
+        {
+            pts.push_back(packet->pts);
+        }
+        av_packet_unref(packet.get());
+    }
+    return pts;
+}
+
+static std::string ReadText(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static std::size_t CountOf(const std::string& text, const std::string& token)
+{
+    std::size_t count = 0;
+    for (auto pos = text.find(token); pos != std::string::npos; pos = text.find(token, pos + token.size()))
+    {
+        count++;
+    }
+    return count;
+}
+
+// 100 frames @ 25 fps cut every second: 4 segments of 25 frames, x264 adds no key frames of its own
+static OutCfg MakeSegmentCfg(const std::string& out_url, OutFormat format)
+{
+    OutCfg cfg;
+    cfg.out_url            = out_url;
+    cfg.codec              = "libx264";
+    cfg.width              = 320;
+    cfg.height             = 240;
+    cfg.fps                = 25.0;
+    cfg.opt["x264-params"] = "scenecut=0";
+    cfg.format             = format;
+    cfg.segment_seconds    = 1.0;
+    return cfg;
+}
+
+TEST(runTests, encoder_fmp4)
+{
+    const std::string out_url   = "fmp4_output.mp4";
+    const std::size_t frame_num = 100;
+    auto              encoder   = std::make_shared<EncoderNode>();
+    ASSERT_TRUE(encoder->Init(MakeSegmentCfg(out_url, OutFormat::FMP4)));
+    ASSERT_TRUE(EncodeTestFrames(encoder, frame_num));
+
+    // one fragment per forced key frame, all frames readable
+    EXPECT_EQ(ReadPacketPts(out_url).size(), frame_num);
+    EXPECT_EQ(CountOf(ReadText(out_url), "moof"), frame_num / 25);
+    std::filesystem::remove(out_url);
+
+    // only the segment muxer writes an index
+    auto cfg          = MakeSegmentCfg(out_url, OutFormat::FMP4);
+    cfg.segment_index = "fmp4_output.csv";
+    EXPECT_FALSE(std::make_shared<EncoderNode>()->Init(cfg));
+}
+
+TEST(runTests, encoder_hls)
+{
+    const std::filesystem::path dir       = "hls_output";
+    const std::size_t           frame_num = 100;
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    auto cfg         = MakeSegmentCfg((dir / "index.m3u8").string(), OutFormat::HLS);
+    cfg.segment_keep = 2;
+    auto encoder     = std::make_shared<EncoderNode>();
+    ASSERT_TRUE(encoder->Init(cfg));
+    ASSERT_TRUE(EncodeTestFrames(encoder, frame_num));
+
+    // the playlist is a window over the last segment_keep segments, every entry is on disk
+    const auto playlist = ReadText(cfg.out_url);
+    EXPECT_EQ(CountOf(playlist, "#EXTINF:"), 2u) << playlist;
+    EXPECT_NE(playlist.find("#EXT-X-MEDIA-SEQUENCE:2"), std::string::npos) << playlist;
+    EXPECT_NE(playlist.find("#EXT-X-MAP:URI=\"init.mp4\""), std::string::npos) << playlist;
+    std::size_t segments = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(dir))
+    {
+        if (entry.path().extension() == ".m4s")
+        {
+            EXPECT_NE(playlist.find(entry.path().filename().string()), std::string::npos) << entry.path();
+            segments++;
+        }
+    }
+    // segments that left the playlist are deleted, hls_delete_threshold (1) of them may still be on disk
+    EXPECT_GE(segments, 2u);
+    EXPECT_LE(segments, 3u);
+    std::filesystem::remove_all(dir);
+}
+
+TEST(runTests, encoder_segment)
+{
+    const std::filesystem::path dir       = "segment_output";
+    const std::size_t           frame_num = 100;
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    auto cfg          = MakeSegmentCfg((dir / "rec_%03d.mp4").string(), OutFormat::SEGMENT);
+    cfg.segment_keep  = 2;
+    cfg.segment_index = (dir / "rec.csv").string();
+    auto encoder      = std::make_shared<EncoderNode>();
+    ASSERT_TRUE(encoder->Init(cfg));
+    ASSERT_TRUE(EncodeTestFrames(encoder, frame_num));
+
+    // file names are reused in a ring of segment_keep, the last two segments (2 and 3) are left
+    std::vector<std::string> files;
+    for (const auto& entry : std::filesystem::directory_iterator(dir))
+    {
+        if (entry.path().extension() == ".mp4")
+        {
+            files.push_back(entry.path().filename().string());
+            EXPECT_EQ(ReadPacketPts(entry.path().string()).size(), 25u) << entry.path();
+        }
+    }
+    std::sort(files.begin(), files.end());
+    EXPECT_EQ(files, (std::vector<std::string>{"rec_000.mp4", "rec_001.mp4"}));
+
+    // the index lists "file,start,end" of the same two segments, cut on the forced key frames
+    std::ifstream            index(cfg.segment_index);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(index, line);)
+    {
+        lines.push_back(line);
+    }
+    ASSERT_EQ(lines.size(), 2u);
+    const char* expect_files[] = {"rec_000.mp4", "rec_001.mp4"};
+    for (std::size_t i = 0; i < lines.size(); ++i)
+    {
+        char   file[64] = {};
+        double start    = 0.0;
+        double end      = 0.0;
+        ASSERT_EQ(std::sscanf(lines[i].c_str(), "%63[^,],%lf,%lf", file, &start, &end), 3) << lines[i];
+        EXPECT_STREQ(file, expect_files[i]);
+        EXPECT_NEAR(start, 2.0 + i, 0.05);
+        EXPECT_NEAR(end, 3.0 + i, 0.05);
+    }
+    std::filesystem::remove_all(dir);
+}
+
+TEST(runTests, encoder_fallback_odd_size)
+{
+    // no codec and no size: the first encoder that opens is used, the geometry comes from the first frame
+    const std::string source    = "fallback_output.mp4";
+    const std::size_t frame_num = 30;
+
+    OutCfg cfg;
+    cfg.out_url  = source;
+    cfg.fps      = 25.0;
+    auto encoder = std::make_shared<EncoderNode>();
+    encoder->SetEncodersPriority({"no_such_encoder", "libx264"});
+    ASSERT_TRUE(encoder->Init(cfg));
+    EXPECT_TRUE(encoder->GetEncoderName().empty());
+    ASSERT_TRUE(EncodeTestFrames(encoder, frame_num, cv::Size(321, 241)));
+    EXPECT_EQ(encoder->GetEncoderName(), "libx264");
+
+    // yuv420p needs even sizes, the odd frame is rounded down
+    auto frames = DecodeTestClip(source, frame_num);
+    ASSERT_EQ(frames.size(), frame_num);
+    for (const auto& frame : frames)
+    {
+        EXPECT_EQ(frame->Val.size(), cv::Size(320, 240));
+    }
+    std::filesystem::remove(source);
+    std::filesystem::remove(source + ".kfi");
+}
+
+TEST(runTests, encoder_frame_pool)
+{
+    // two pool frames for 50 input frames: a frame may only be reused once the encoder let go of it
+    const std::string source    = "frame_pool_output.mp4";
+    const std::size_t frame_num = 50;
+    auto              cfg       = MakeTestClipCfg(source);
+    cfg.opt["x264-params"]      = "bframes=0";
+    auto encoder                = std::make_shared<EncoderNode>();
+    encoder->SetFramePoolSize(2);
+    ASSERT_TRUE(encoder->Init(cfg));
+    ASSERT_TRUE(EncodeTestFrames(encoder, frame_num));
+
+    // without B frames the muxed order is the presentation order
+    auto pts = ReadPacketPts(source);
+    ASSERT_EQ(pts.size(), frame_num);
+    for (std::size_t i = 1; i < pts.size(); ++i)
+    {
+        EXPECT_GT(pts[i], pts[i - 1]) << "packet " << i;
+    }
+
+    // a pool frame overwritten too early would show the picture of a later frame
+    auto frames = DecodeTestClip(source, frame_num);
+    ASSERT_EQ(frames.size(), frame_num);
+    for (std::size_t i = 0; i + 2 < frames.size(); ++i)
+    {
+        const auto& image = frames[i]->Val;
+        EXPECT_LT(cv::norm(image, MakeTestFrame(static_cast<int>(i)), cv::NORM_L1),
+                  cv::norm(image, MakeTestFrame(static_cast<int>(i + 2)), cv::NORM_L1))
+            << "frame " << i;
+    }
+    std::filesystem::remove(source);
+    std::filesystem::remove(source + ".kfi");
+}
+
+TEST(runTests, remux_sidecar)
+{
+    const std::string source    = "remux_source.mp4";
+    const std::string out_url   = "remux_output.mp4";
+    const std::string sidecar   = out_url + ".det.jsonl";
+    const std::size_t frame_num = 40;
+    ASSERT_TRUE(WriteTestClip(source, frame_num));
+
+    AVFormatContext* ctx = nullptr;
+    ASSERT_EQ(avformat_open_input(&ctx, source.c_str(), nullptr, nullptr), 0);
+    AVFormatInputPtr input{ctx};
+    ASSERT_GE(avformat_find_stream_info(ctx, nullptr), 0);
+    const int index = av_find_best_stream(ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    ASSERT_GE(index, 0);
+    const auto* stream = ctx->streams[index];
+
+    auto remux   = std::make_shared<RemuxNode>();
+    auto packets = std::make_shared<SignalQue>();
+    auto boxes   = std::make_shared<SignalQue>();
+    ASSERT_TRUE(remux->Init(out_url, stream->codecpar, stream->time_base, av_q2d(stream->avg_frame_rate)));
+    ASSERT_TRUE(remux->AddInputs(boxes));
+    ASSERT_TRUE(remux->AddInputs(packets));
+    ASSERT_TRUE(remux->Start());
+
+    // the compressed packets as a DecoderNode with SetForwardPackets(true) sends them
+    AVPacketPtr packet{av_packet_alloc()};
+    while (av_read_frame(ctx, packet.get()) == 0)
+    {
+        if (packet->stream_index == index)
+        {
+            std::shared_ptr<AVPacket> copy{AVPacketPtr{av_packet_clone(packet.get())}};
+            packets->Push(std::make_shared<SignalPacket>(std::move(copy), stream->time_base.num,
+                                                         stream->time_base.den));
+        }
+        av_packet_unref(packet.get());
+    }
+    // one box on frame 1, nothing on frames 0 and 2
+    for (int frame = 0; frame < 3; ++frame)
+    {
+        Detections detections;
+        if (frame == 1)
+        {
+            detections.boxes.push_back({10, 20, 30, 40, 0.5f, 3, 0});
+        }
+        auto signal      = std::make_shared<SignalDetections>(std::move(detections));
+        signal->FrameIdx = frame;
+        boxes->Push(signal);
+    }
+    EXPECT_TRUE(remux->Stop());
+    remux.reset();  // writes the trailer
+    input.reset();
+
+    // the same packets at the same times, nothing was decoded
+    AVRational source_time_base{};
+    AVRational output_time_base{};
+    auto       source_pts = ReadPacketPts(source, &source_time_base);
+    auto       output_pts = ReadPacketPts(out_url, &output_time_base);
+    ASSERT_EQ(source_pts.size(), frame_num);
+    ASSERT_EQ(output_pts.size(), frame_num);
+    for (std::size_t i = 0; i < frame_num; ++i)
+    {
+        EXPECT_NEAR(source_pts[i] * av_q2d(source_time_base), output_pts[i] * av_q2d(output_time_base), 1e-3)
+            << "packet " << i;
+    }
+
+    std::ifstream            file(sidecar);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(file, line);)
+    {
+        lines.push_back(line);
+    }
+    EXPECT_EQ(lines, (std::vector<std::string>{
+                         R"({"frame":0,"time":0.000,"boxes":[]})",
+                         R"({"frame":1,"time":0.040,"boxes":[[10,20,30,40,0.5,3]]})",
+                         R"({"frame":2,"time":0.080,"boxes":[]})",
+                     }));
+
+    std::filesystem::remove(source);
+    std::filesystem::remove(out_url);
+    std::filesystem::remove(sidecar);
+}
+
+TEST(runTests, multi_encoder_stop_closes)
+{
+    std::vector<OutCfg> cfgs(2);
+    cfgs[0].out_url = "multi_full.mp4";
+    cfgs[0].codec   = "libx264";
+    cfgs[1].out_url = "multi_half.mp4";
+    cfgs[1].codec   = "libx264";
+    cfgs[1].height  = 120;
+
+    auto node  = std::make_shared<MultiEncoderNode>();
+    auto input = std::make_shared<SignalQue>();
+    ASSERT_TRUE(node->Init(cfgs, 25.0));
+    ASSERT_TRUE(node->AddInputs(input));
+    ASSERT_TRUE(node->Start());
+    for (int i = 0; i < 20; ++i)
+    {
+        auto signal      = std::make_shared<SignalImageBGR>(MakeTestFrame(i));
+        signal->FrameIdx = i;
+        input->Push(signal);
+    }
+    while (not input->Empty())
+    {
+        std::this_thread::sleep_for(10ms);
+    }
+    EXPECT_TRUE(node->Stop());
+
+    // the node is still alive, Stop() alone has to leave complete files behind
+    for (const auto& cfg : cfgs)
+    {
+        auto pts = ReadPacketPts(cfg.out_url);
+        EXPECT_GT(pts.size(), 0u) << cfg.out_url;
+        EXPECT_LE(pts.size(), 20u) << cfg.out_url;
+    }
+    node.reset();
+    for (const auto& cfg : cfgs)
+    {
+        std::filesystem::remove(cfg.out_url);
+    }
+}
+
+// nb_frames of the video stream of url, 0 when the container does not store it
+static std::int64_t ReadFrameCount(const std::string& url)
+{
+    AVFormatContext* ctx = nullptr;
+    if (avformat_open_input(&ctx, url.c_str(), nullptr, nullptr) != 0)
+    {
+        return 0;
+    }
+    AVFormatInputPtr input{ctx};
+    if (avformat_find_stream_info(ctx, nullptr) < 0)
+    {
+        return 0;
+    }
+    const int index = av_find_best_stream(ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    return index < 0 ? 0 : ctx->streams[index]->nb_frames;
+}
+
+TEST(runTests, decoder_all_frames)
+{
+    // B frames come out of the codec late and several at once after the last packet, the flush has to drain them
+    const std::string source = "all_frames_source.mp4";
+    ASSERT_TRUE(WriteTestClip(source, 123));
+    const auto frame_num = static_cast<std::size_t>(ReadFrameCount(source));
+    ASSERT_EQ(frame_num, 123u);
+
+    auto frames = DecodeTestClip(source, frame_num);
+    ASSERT_EQ(frames.size(), frame_num);
+    for (std::size_t i = 0; i < frames.size(); ++i)
+    {
+        EXPECT_EQ(frames[i]->FrameIdx, i);
+    }
+    std::filesystem::remove(source);
+    std::filesystem::remove(source + ".kfi");
+}
+
+TEST(runTests, decoder_stop_mid_stream)
+{
+    const std::string source    = "stop_source.mp4";
+    const std::size_t frame_num = 300;
+    auto              encoder   = std::make_shared<EncoderNode>();
+    auto              cfg       = MakeTestClipCfg(source);
+    cfg.width                   = 640;
+    cfg.height                  = 480;
+    ASSERT_TRUE(encoder->Init(cfg));
+    ASSERT_TRUE(EncodeTestFrames(encoder, frame_num, cv::Size(640, 480)));
+
+    // stop after a few frames, the reader thread and the decoder loop both have to exit promptly
+    auto decoder = std::make_shared<DecoderNode>();
+    auto output  = std::make_shared<SignalQue>();
+    ASSERT_TRUE(decoder->Init(source));
+    ASSERT_TRUE(decoder->AddOutputs(output));
+    ASSERT_TRUE(decoder->Start());
+    auto frames = PopFrames(*output, 10);
+    ASSERT_EQ(frames.size(), 10u);
+
+    auto begin = std::chrono::steady_clock::now();
+    EXPECT_TRUE(decoder->Stop());
+    EXPECT_LT(std::chrono::steady_clock::now() - begin, 1s);
+
+    // whatever was decoded before the stop is complete and in order
+    for (SignalBasePtr signal; output->Pop(signal);)
+    {
+        frames.push_back(std::dynamic_pointer_cast<SignalImageBGR>(signal));
+    }
+    EXPECT_LE(frames.size(), frame_num);
+    for (std::size_t i = 0; i < frames.size(); ++i)
+    {
+        EXPECT_EQ(frames[i]->FrameIdx, i);
+    }
+    decoder.reset();
+    std::filesystem::remove(source);
+    std::filesystem::remove(source + ".kfi");
+}
+
+TEST(runTests, stream_source_push)
+{
+    std::vector<std::uint8_t> data(10000);
+    std::iota(data.begin(), data.end(), 0);
+
+    // two chunks at most in the queue, Submit blocks until the reader catches up
+    StreamSource source(2);
+    auto*        ctx = source.CreateAVIOContext(256);
+    ASSERT_NE(ctx, nullptr);
+    auto produce = [&]()
+    {
+        for (std::size_t offset = 0; offset < data.size(); offset += 700)
+        {
+            auto size = std::min<std::size_t>(700, data.size() - offset);
+            EXPECT_TRUE(source.Submit(data.data() + offset, size));
+        }
+        source.Finish();
+    };
+    std::thread producer(produce);
+
+    std::vector<std::uint8_t> read(data.size() + 100);
+    int                       total = 0;
+    while (true)
+    {
+        auto ret = avio_read(ctx, read.data() + total, static_cast<int>(read.size()) - total);
+        if (ret <= 0)
+        {
+            EXPECT_EQ(ret, AVERROR_EOF);
+            break;
+        }
+        total += ret;
+    }
+    producer.join();
+    ASSERT_EQ(total, static_cast<int>(data.size()));
+    read.resize(total);
+    EXPECT_EQ(read, data);
+    // no more data after Finish
+    EXPECT_FALSE(source.Submit(data.data(), data.size()));
+    StreamSource::FreeAVIOContext(&ctx);
+    EXPECT_EQ(ctx, nullptr);
+}
+
+TEST(runTests, stream_source_abort)
+{
+    StreamSource source;
+    auto*        ctx = source.CreateAVIOContext(256);
+    ASSERT_NE(ctx, nullptr);
+    // the reader waits for data that never comes until Abort
+    auto read = [&]()
+    {
+        std::uint8_t buf[64];
+        return avio_read(ctx, buf, sizeof(buf));
+    };
+    auto reader = std::async(std::launch::async, read);
+    EXPECT_EQ(reader.wait_for(50ms), std::future_status::timeout);
+    source.Abort();
+    ASSERT_EQ(reader.wait_for(5s), std::future_status::ready);
+    EXPECT_EQ(reader.get(), AVERROR_EXIT);
+    EXPECT_FALSE(source.Submit(std::vector<std::uint8_t>{1, 2, 3}));
+    StreamSource::FreeAVIOContext(&ctx);
+}
+
+TEST(runTests, stream_source_interrupt)
+{
+    StreamSource source;
+    auto*        ctx = source.CreateAVIOContext(256);
+    ASSERT_NE(ctx, nullptr);
+    auto read = [&]()
+    {
+        std::uint8_t buf[3];
+        return avio_read(ctx, buf, sizeof(buf));
+    };
+    auto reader = std::async(std::launch::async, read);
+    EXPECT_EQ(reader.wait_for(50ms), std::future_status::timeout);
+    source.Interrupt();
+    ASSERT_EQ(reader.wait_for(5s), std::future_status::ready);
+    EXPECT_EQ(reader.get(), AVERROR_EXIT);
+
+    // unlike Abort the source stays usable, as DecoderNode::Run() does the avio error is cleared for the next read
+    source.Resume();
+    ctx->eof_reached = 0;
+    ctx->error       = 0;
+    EXPECT_TRUE(source.Submit(std::vector<std::uint8_t>{1, 2, 3}));
+    source.Finish();
+    std::uint8_t buf[3];
+    ASSERT_EQ(avio_read(ctx, buf, sizeof(buf)), 3);
+    EXPECT_EQ(buf[0], 1);
+    EXPECT_EQ(buf[2], 3);
+    EXPECT_EQ(avio_read(ctx, buf, sizeof(buf)), AVERROR_EOF);
+    StreamSource::FreeAVIOContext(&ctx);
+}
+
+TEST(runTests, stream_source_zero_copy)
+{
+    auto buffer = std::make_shared<std::vector<std::uint8_t>>(1000);
+    std::iota(buffer->begin(), buffer->end(), 0);
+    std::vector<std::uint8_t> expected(buffer->begin() + 100, buffer->begin() + 600);
+    std::weak_ptr<std::vector<std::uint8_t>> watch = buffer;
+
+    StreamSource source;
+    auto*        ctx = source.CreateAVIOContext(256);
+    ASSERT_NE(ctx, nullptr);
+    // 500 bytes in the middle of the caller's buffer, the source holds the buffer instead of a copy
+    EXPECT_TRUE(source.Submit(std::shared_ptr<const void>(buffer, buffer->data() + 100), 500));
+    buffer.reset();
+    EXPECT_FALSE(watch.expired());
+    source.Finish();
+
+    std::vector<std::uint8_t> read(600);
+    ASSERT_EQ(avio_read(ctx, read.data(), static_cast<int>(read.size())), 500);
+    read.resize(500);
+    EXPECT_EQ(read, expected);
+    // released once the demuxer has read it all
+    EXPECT_TRUE(watch.expired());
+    StreamSource::FreeAVIOContext(&ctx);
+}
+
+TEST(runTests, stream_source_pull)
+{
+    std::vector<std::uint8_t> data(4096);
+    std::iota(data.begin(), data.end(), 0);
+    std::int64_t position = 0;
+
+    auto read = [&](std::uint8_t* buf, int size) -> int
+    {
+        auto n = std::min<std::int64_t>(size, static_cast<std::int64_t>(data.size()) - position);
+        if (n <= 0)
+        {
+            return 0;
+        }
+        std::memcpy(buf, data.data() + position, n);
+        position += n;
+        return static_cast<int>(n);
+    };
+    auto seek = [&](std::int64_t offset, int whence) -> std::int64_t
+    {
+        auto size = static_cast<std::int64_t>(data.size());
+        switch (whence & ~AVSEEK_FORCE)
+        {
+            case AVSEEK_SIZE:
+                return size;
+            case SEEK_SET:
+                break;
+            case SEEK_CUR:
+                offset += position;
+                break;
+            case SEEK_END:
+                offset += size;
+                break;
+            default:
+                return -1;
+        }
+        if (offset < 0 or offset > size)
+        {
+            return -1;
+        }
+        return position = offset;
+    };
+
+    StreamSource source(read, seek);
+    // a pull source takes no pushed data
+    EXPECT_FALSE(source.Submit(std::vector<std::uint8_t>{1, 2, 3}));
+    auto* ctx = source.CreateAVIOContext(64);
+    ASSERT_NE(ctx, nullptr);
+    EXPECT_EQ(avio_size(ctx), static_cast<std::int64_t>(data.size()));
+
+    std::uint8_t buf[100];
+    ASSERT_EQ(avio_read(ctx, buf, sizeof(buf)), static_cast<int>(sizeof(buf)));
+    EXPECT_EQ(0, std::memcmp(buf, data.data(), sizeof(buf)));
+    // far out of the avio buffer, the seek callback is used
+    ASSERT_EQ(avio_seek(ctx, 3000, SEEK_SET), 3000);
+    ASSERT_EQ(avio_read(ctx, buf, sizeof(buf)), static_cast<int>(sizeof(buf)));
+    EXPECT_EQ(0, std::memcmp(buf, data.data() + 3000, sizeof(buf)));
+    ASSERT_EQ(avio_seek(ctx, 4000, SEEK_SET), 4000);
+    EXPECT_EQ(avio_read(ctx, buf, sizeof(buf)), 96);
+    EXPECT_EQ(avio_read(ctx, buf, sizeof(buf)), AVERROR_EOF);
+    StreamSource::FreeAVIOContext(&ctx);
+}
+
+TEST(runTests, stream_source_pull_error)
+{
+    // 100 bytes, then the read fails: a truncated input, not the end of the stream
+    int  calls = 0;
+    auto read  = [&](std::uint8_t* buf, int size) -> int
+    {
+        if (calls++ > 0)
+        {
+            return -1;
+        }
+        std::memset(buf, 7, std::min(size, 100));
+        return std::min(size, 100);
+    };
+    StreamSource source(read);
+    auto*        ctx = source.CreateAVIOContext(64);
+    ASSERT_NE(ctx, nullptr);
+    std::uint8_t buf[200];
+    EXPECT_EQ(avio_read(ctx, buf, sizeof(buf)), 100);
+    EXPECT_EQ(avio_read(ctx, buf, sizeof(buf)), AVERROR(EIO));
+    StreamSource::FreeAVIOContext(&ctx);
+}
+
+// synthetic packets of a 25 fps stream, the payload is never decoded
+static std::shared_ptr<SignalPacket> MakeClipPacket(std::int64_t pts, bool key, int size = 100)
+{
+    std::shared_ptr<AVPacket> pkt{AVPacketPtr{av_packet_alloc()}};
+    EXPECT_EQ(av_new_packet(pkt.get(), size), 0);
+    std::memset(pkt->data, static_cast<int>(pts & 0xff), size);
+    pkt->pts      = pts;
+    pkt->dts      = pts;
+    pkt->duration = 1;
+    pkt->flags    = key ? AV_PKT_FLAG_KEY : 0;
+    return std::make_shared<SignalPacket>(std::move(pkt), 1, 25);
+}
+
+TEST(runTests, gop_ring_pre_seconds)
+{
+    GopRing ring;
+    ring.SetLimits(1.0, 1 << 20);
+    // nothing to start a clip from before the first key frame
+    ring.Append(MakeClipPacket(-5, false), -0.2);
+    EXPECT_TRUE(ring.Empty());
+    EXPECT_EQ(ring.GetBytes(), 0u);
+
+    // a key frame every 10 packets, 0.4 s per GOP
+    for (int i = 0; i < 100; ++i)
+    {
+        ring.Append(MakeClipPacket(i, i % 10 == 0), i / 25.0);
+        const auto& gops      = ring.GetGops();
+        double      threshold = ring.GetNewestTime() - 1.0;
+        ASSERT_FALSE(gops.empty());
+        EXPECT_TRUE(gops.front().packets.front()->Val->flags & AV_PKT_FLAG_KEY);
+        // the oldest GOP covers pre_seconds, the next one alone would not
+        EXPECT_TRUE(gops.front().start <= std::max(threshold, 0.0));
+        EXPECT_TRUE(gops.size() < 2 or gops[1].start > threshold);
+        std::size_t bytes = 0;
+        for (const auto& gop : gops)
+        {
+            bytes += gop.packets.size() * 100;
+            EXPECT_EQ(gop.bytes, gop.packets.size() * 100);
+        }
+        EXPECT_EQ(ring.GetBytes(), bytes);
+    }
+    EXPECT_EQ(ring.GetGops().size(), 3u);
+    EXPECT_DOUBLE_EQ(ring.GetGops().front().start, 70 / 25.0);
+    EXPECT_EQ(ring.GetBytes(), 3000u);
+}
+
+TEST(runTests, gop_ring_max_bytes)
+{
+    GopRing ring;
+    ring.SetLimits(100.0, 2500);
+    for (int i = 0; i < 100; ++i)
+    {
+        ring.Append(MakeClipPacket(i, i % 10 == 0), i / 25.0);
+        // whole GOPs are dropped, the newest one is always kept
+        EXPECT_TRUE(ring.GetBytes() <= 2500 or ring.GetGops().size() == 1);
+        EXPECT_TRUE(ring.GetGops().front().packets.front()->Val->flags & AV_PKT_FLAG_KEY);
+    }
+    EXPECT_EQ(ring.GetGops().size(), 2u);
+    EXPECT_EQ(ring.GetBytes(), 2000u);
+
+    // a single GOP over the cap stays until the next key frame
+    GopRing small;
+    small.SetLimits(100.0, 500);
+    for (int i = 0; i < 10; ++i)
+    {
+        small.Append(MakeClipPacket(i, i == 0), i / 25.0);
+    }
+    EXPECT_EQ(small.GetGops().size(), 1u);
+    EXPECT_EQ(small.GetBytes(), 1000u);
+    small.Append(MakeClipPacket(10, true), 10 / 25.0);
+    EXPECT_EQ(small.GetGops().size(), 1u);
+    EXPECT_EQ(small.GetBytes(), 100u);
+}
+
+TEST(runTests, event_clip_extend)
+{
+    std::shared_ptr<AVCodecParameters> par{avcodec_parameters_alloc(),
+                                           [](AVCodecParameters* p) { avcodec_parameters_free(&p); }};
+    par->codec_type = AVMEDIA_TYPE_VIDEO;
+    par->codec_id   = AV_CODEC_ID_MJPEG;
+    par->width      = 320;
+    par->height     = 240;
+
+    ClipCfg cfg;
+    cfg.out_prefix   = "event_clip";
+    cfg.pre_seconds  = 1.0;
+    cfg.post_seconds = 0.98;  // clip ends between two packets, not on one
+
+    std::string first_clip  = cfg.out_prefix + "_0.mp4";
+    std::string second_clip = cfg.out_prefix + "_1.mp4";
+    std::filesystem::remove(first_clip);
+    std::filesystem::remove(second_clip);
+
+    auto node  = std::make_shared<EventClipNode>();
+    auto input = std::make_shared<SignalQue>();
+    ASSERT_TRUE(node->Init(cfg, par.get(), AVRational{1, 25}));
+    ASSERT_TRUE(node->AddInputs(input));
+    ASSERT_TRUE(node->Start());
+    // the node has taken every packet once the queue is empty, a trigger then sees all of them
+    auto push = [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            input->Push(MakeClipPacket(i, i % 10 == 0));
+        }
+        while (not input->Empty())
+        {
+            std::this_thread::sleep_for(1ms);
+        }
+    };
+
+    // 0 ~ 1.96 s, the clip starts at the key frame of 0.8 s and runs to 2.94 s
+    push(0, 50);
+    node->Trigger("first");
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (not std::filesystem::exists(first_clip) and std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(1ms);
+    }
+    ASSERT_TRUE(std::filesystem::exists(first_clip));
+    // a trigger while the clip is written extends it to 3.34 s instead of starting a new one
+    push(50, 60);
+    node->Trigger("second");
+    push(60, 100);
+    EXPECT_TRUE(node->Stop());
+    node.reset();
+
+    AVFormatContext* raw_ctx = nullptr;
+    ASSERT_EQ(avformat_open_input(&raw_ctx, first_clip.c_str(), nullptr, nullptr), 0);
+    AVFormatInputPtr ctx{raw_ctx};
+    AVPacketPtr      pkt{av_packet_alloc()};
+    int              packet_num = 0;
+    while (av_read_frame(ctx.get(), pkt.get()) == 0)
+    {
+        if (packet_num++ == 0)
+        {
+            EXPECT_TRUE(pkt->flags & AV_PKT_FLAG_KEY);
+        }
+        av_packet_unref(pkt.get());
+    }
+    // packets 20 ~ 84, one more if the second trigger was taken after the next packet
+    EXPECT_GE(packet_num, 65);
+    EXPECT_LE(packet_num, 66);
+    EXPECT_FALSE(std::filesystem::exists(second_clip));
+    std::filesystem::remove(first_clip);
+}
@@ -53,6 +53,36 @@ TEST(runTests, Que)
     }
 }
 
+TEST(runTests, BoundedQue)
+{
+    BoundedQueue<std::unique_ptr<int>> que(4);
+    auto producer = std::async(std::launch::async,
+                               [&que]()
+                               {
+                                   for (int i = 0; i < 100; i++)
+                                   {
+                                       auto item = std::make_unique<int>(i);
+                                       while (not que.Push(std::move(item), 1ms))
+                                       {
+                                       }
+                                   }
+                                   que.Close();
+                               });
+    int  expected = 0;
+    auto item     = std::unique_ptr<int>();
+    while (not(que.IsClosed() and que.Empty()))
+    {
+        if (que.Pop(item, 1ms))
+        {
+            EXPECT_LE(que.Size(), 4);
+            EXPECT_EQ(*item, expected++);
+        }
+    }
+    producer.wait();
+    EXPECT_EQ(expected, 100);
+    EXPECT_FALSE(que.Push(std::make_unique<int>(0), 1ms));
+}
+
 class NodeImplTestBase : public NodeBase
 {
 public:
@@ -164,3 +194,44 @@ TEST(runTests, NodeBaseIcr)
     }
     pipeline->Stop();
 }
+
+TEST(runTests, PipelineCallbacks)
+{
+    PipelineBase     pipeline;
+    std::vector<int> calls;
+    EXPECT_FALSE(pipeline.Notify(EventId::EventTriggered, "nobody"));
+
+    // a second callback of the same event is added, not swapped in
+    EXPECT_TRUE(pipeline.RegisterCallback(EventId::EventTriggered, [&](const char*) { calls.push_back(1); }));
+    EXPECT_TRUE(pipeline.RegisterCallback(EventId::EventTriggered, [&](const char*) { calls.push_back(2); }));
+    EXPECT_FALSE(pipeline.RegisterCallback(EventId::EventTriggered, nullptr));
+    EXPECT_TRUE(pipeline.Notify(EventId::EventTriggered, "event"));
+    EXPECT_EQ(calls, (std::vector<int>{1, 2}));
+    EXPECT_FALSE(pipeline.Notify(EventId::AllFrameDone, "nobody"));
+
+    // nodes notify from their own threads while the application registers more callbacks
+    std::atomic<int>               count{0};
+    std::vector<std::future<void>> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.push_back(std::async(std::launch::async,
+                                     [&]()
+                                     {
+                                         for (int i = 0; i < 1000; ++i)
+                                         {
+                                             pipeline.Notify(EventId::OneFrameDone, "frame");
+                                         }
+                                     }));
+    }
+    for (int i = 0; i < 100; ++i)
+    {
+        pipeline.RegisterCallback(EventId::OneFrameDone, [&](const char*) { count++; });
+    }
+    for (auto& thread : threads)
+    {
+        thread.wait();
+    }
+    count = 0;
+    EXPECT_TRUE(pipeline.Notify(EventId::OneFrameDone, "frame"));
+    EXPECT_EQ(count, 100);
+}